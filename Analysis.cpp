@@ -0,0 +1,70 @@
+
+#include "Analysis.h"
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+// NOTE(eteran): the builtins whose result depends on nothing but their
+// arguments, and which change nothing. A call to anything else may be to a
+// macro defined elsewhere, or to a builtin which reads or changes the state
+// of the editor (search_string, for one, sets $search_end)
+constexpr std::string_view pure_builtins[] = {
+	"length",
+	"max",
+	"min",
+	"replace_in_string",
+	"replace_substring",
+	"split",
+	"substring",
+	"tolower",
+	"toupper",
+	"valid_number",
+};
+
+// NOTE(eteran): the globals which hold the same value for as long as a macro
+// runs, no matter what it calls
+constexpr std::string_view constant_globals[] = {
+	"$1",
+	"$2",
+	"$3",
+	"$4",
+	"$5",
+	"$6",
+	"$7",
+	"$8",
+	"$9",
+	"$empty_array",
+	"$n_args",
+	"$sub_sep",
+};
+
+}
+
+/**
+ * @brief is_pure_builtin
+ * @param name
+ * @return true if a call to name can be moved, or made once rather than many times
+ */
+bool is_pure_builtin(std::string_view name) {
+	return std::find(std::begin(pure_builtins), std::end(pure_builtins), name) != std::end(pure_builtins);
+}
+
+/**
+ * @brief is_global
+ * @param name
+ * @return true if name is a global variable, a change to which can be seen
+ * once the macro stops
+ */
+bool is_global(std::string_view name) {
+	return !name.empty() && name[0] == '$';
+}
+
+/**
+ * @brief changed_by_calls
+ * @param name
+ * @return true if calling a macro or builtin may change the variable name
+ */
+bool changed_by_calls(std::string_view name) {
+	return is_global(name) && std::find(std::begin(constant_globals), std::end(constant_globals), name) == std::end(constant_globals);
+}
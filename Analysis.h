@@ -0,0 +1,28 @@
+
+#ifndef ANALYSIS_H_
+#define ANALYSIS_H_
+
+#include <cstddef>
+#include <string_view>
+#include <unordered_map>
+
+bool is_pure_builtin(std::string_view name);
+bool is_global(std::string_view name);
+bool changed_by_calls(std::string_view name);
+
+/**
+ * @brief node_key
+ * @param ast
+ * @param expression
+ * @return the address of the node, which identifies it in either form
+ */
+template <class Ast>
+const void *node_key(Ast &ast, typename Ast::ExpressionRef expression) {
+	return ast.visit(expression, [](auto node) -> const void * { return node; });
+}
+
+// the expressions which have been moved out of the loops being generated, by
+// node (see node_key), and the index of the variable that holds each
+using Hoisted = std::unordered_map<const void *, size_t>;
+
+#endif
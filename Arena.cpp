@@ -0,0 +1,119 @@
+
+#include "Arena.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+
+namespace {
+
+/**
+ * @brief padding_for
+ * @param ptr
+ * @param alignment
+ * @return how many bytes to skip so that ptr is aligned to alignment
+ */
+size_t padding_for(const char *ptr, size_t alignment) noexcept {
+	return (alignment - reinterpret_cast<uintptr_t>(ptr) % alignment) % alignment;
+}
+
+}
+
+/**
+ * @brief Arena::add_block
+ * @param size
+ * @return a new block of at least size bytes
+ */
+char *Arena::add_block(size_t size) {
+	blocks_.push_back(Block{std::unique_ptr<char[]>(new char[size]), size});
+	return blocks_.back().data.get();
+}
+
+/**
+ * @brief Arena::allocate
+ * @param size
+ * @param alignment must be a power of two
+ * @return size bytes of uninitialized memory, aligned to alignment
+ */
+void *Arena::allocate(size_t size, size_t alignment) {
+
+	size_t padding = padding_for(current_, alignment);
+
+	if (padding + size > remaining_) {
+
+		// NOTE(eteran): large requests get a block to themselves, so that
+		// they don't waste what is left of the current one
+		if (size + alignment > BlockSize / 4) {
+			char *block = add_block(size + alignment);
+			return block + padding_for(block, alignment);
+		}
+
+		current_   = add_block(BlockSize);
+		remaining_ = BlockSize;
+		padding    = padding_for(current_, alignment);
+	}
+
+	void *ptr = current_ + padding;
+	current_ += padding + size;
+	remaining_ -= padding + size;
+	return ptr;
+}
+
+/**
+ * @brief Arena::copy
+ * @param s
+ * @return a copy of s, which lives as long as the arena's contents
+ */
+std::string_view Arena::copy(std::string_view s) {
+	if (s.empty()) {
+		return std::string_view();
+	}
+
+	auto data = static_cast<char *>(allocate(s.size(), 1));
+	std::memcpy(data, s.data(), s.size());
+	return std::string_view(data, s.size());
+}
+
+/**
+ * @brief Arena::reset
+ *
+ * Releases everything allocated from the arena in one step. One block is
+ * kept, so that an arena reused for many small inputs doesn't go back to the
+ * system allocator each time
+ */
+void Arena::reset() noexcept {
+
+	auto it = std::find_if(blocks_.begin(), blocks_.end(), [](const Block &block) {
+		return block.size == BlockSize;
+	});
+
+	if (it == blocks_.end()) {
+		blocks_.clear();
+		current_   = nullptr;
+		remaining_ = 0;
+		return;
+	}
+
+	std::swap(*it, blocks_.front());
+	blocks_.resize(1);
+	current_   = blocks_.front().data.get();
+	remaining_ = BlockSize;
+}
+
+/**
+ * @brief Arena::splice
+ * @param other
+ *
+ * Takes over everything allocated from other, which then lives as long as
+ * this arena's contents do, and leaves other empty. This lets a tree be built
+ * in several arenas at once (one per thread) and then owned as a whole
+ */
+void Arena::splice(Arena &other) {
+
+	blocks_.reserve(blocks_.size() + other.blocks_.size());
+	std::move(other.blocks_.begin(), other.blocks_.end(), std::back_inserter(blocks_));
+
+	other.blocks_.clear();
+	other.current_   = nullptr;
+	other.remaining_ = 0;
+}
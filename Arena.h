@@ -0,0 +1,105 @@
+
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief A fixed length list of node pointers, whose storage lives in an Arena
+ */
+template <class T>
+class NodeList {
+public:
+	NodeList() = default;
+	NodeList(T **data, size_t size) noexcept
+		: data_(data), size_(size) {
+	}
+
+public:
+	T **begin() const noexcept { return data_; }
+	T **end() const noexcept { return data_ + size_; }
+	size_t size() const noexcept { return size_; }
+	bool empty() const noexcept { return size_ == 0; }
+	T *&operator[](size_t n) const noexcept { return data_[n]; }
+
+	void erase(T **first, T **last) noexcept {
+		std::move(last, end(), first);
+		size_ -= static_cast<size_t>(std::distance(first, last));
+	}
+
+private:
+	T **data_    = nullptr;
+	size_t size_ = 0;
+};
+
+/**
+ * @brief A bump pointer allocator. Memory is handed out from large blocks and
+ * is only ever released all at once, when the arena is reset or destroyed.
+ *
+ * NOTE(eteran): destructors are NEVER run for objects made in the arena, so
+ * anything allocated here must not own memory of its own. Strings and lists
+ * should be allocated in the arena too (see copy() and make_list())
+ */
+class Arena {
+public:
+	static constexpr size_t BlockSize = 64 * 1024;
+
+public:
+	Arena()                            = default;
+	Arena(const Arena &other)          = delete;
+	Arena &operator=(const Arena &rhs) = delete;
+	~Arena()                           = default;
+
+public:
+	template <class T, class... Args>
+	T *make(Args &&...args) {
+		return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+	}
+
+	template <class It>
+	auto make_list(It first, It last) {
+		using T = std::remove_pointer_t<typename std::iterator_traits<It>::value_type>;
+
+		const auto size = static_cast<size_t>(std::distance(first, last));
+		if (size == 0) {
+			return NodeList<T>();
+		}
+
+		auto data = static_cast<T **>(allocate(sizeof(T *) * size, alignof(T *)));
+		std::copy(first, last, data);
+		return NodeList<T>(data, size);
+	}
+
+	template <class T>
+	NodeList<T> make_list(const std::vector<T *> &nodes) {
+		return make_list(nodes.begin(), nodes.end());
+	}
+
+	std::string_view copy(std::string_view s);
+	void *allocate(size_t size, size_t alignment);
+	void reset() noexcept;
+	void splice(Arena &other);
+
+private:
+	char *add_block(size_t size);
+
+private:
+	struct Block {
+		std::unique_ptr<char[]> data;
+		size_t size;
+	};
+
+	std::vector<Block> blocks_;
+	char *current_    = nullptr;
+	size_t remaining_ = 0;
+};
+
+#endif
@@ -1,65 +1,25 @@
 
 #include "CodeGenerator.h"
-#include "Expression.h"
-#include "Statement.h"
-#include <climits>
+#include "Analysis.h"
+#include "CommonSubexpressions.h"
+#include "FlatAst.h"
+#include "IR.h"
+#include "LoopInvariants.h"
+#include "Peephole.h"
+#include "PointerAst.h"
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
 #include <list>
 #include <stack>
+#include <string_view>
 #include <variant>
+#include <vector>
 
 namespace {
 
-struct Node {
-	int64_t location;
-	std::string instr;
-};
-
-struct BranchNode {
-	int64_t location;
-	std::string instr;
-	int64_t target = LONG_LONG_MAX; // default to blatantly invalid
-};
-
-struct AssignNode {
-	int64_t location;
-	std::string instr;
-	std::string symbol;
-};
-
-struct PushSymbolNode {
-	int64_t location;
-	std::string instr;
-	std::string symbol;
-};
-
-struct PushStringNode {
-	int64_t location;
-	std::string instr;
-	std::string string;
-};
-
-struct PushArraySymbolNode {
-	int64_t location;
-	std::string instr;
-	std::string symbol;
-	std::string suffix;
-};
-
-struct ArrayOpNode {
-	int64_t location;
-	std::string instr;
-	size_t dimensions;
-};
-
-struct CallNode {
-	int64_t location;
-	std::string instr;
-	std::string target;
-	size_t args;
-};
-
-using node_type = std::variant<Node, BranchNode, AssignNode, PushSymbolNode, PushStringNode, PushArraySymbolNode, ArrayOpNode, CallNode>;
-
 struct Visitor {
 	void operator()(const Node &node) const {
 		printf("%-16ld %s\n", node.location, node.instr.c_str());
@@ -124,7 +84,6 @@ private:
 };
 
 struct LoopContext {
-	const LoopStatement *loop;
 	std::vector<BranchNode *> continues;
 	std::vector<BranchNode *> breaks;
 };
@@ -135,13 +94,6 @@ std::stack<LoopContext> loopStack;
 
 int in_binary_expression = 0;
 
-void generate_ir(const std::unique_ptr<Expression> &expression);
-void generate_ir(const std::unique_ptr<Statement> &statement);
-void generate_ir(const Expression *expression);
-void generate_ir(const Statement *statement);
-void generate_ir(const ExpressionStatement *statement);
-void generate_ir(const std::vector<std::unique_ptr<Statement>> &statements);
-
 /**
  * @brief current_location
  * @return
@@ -150,20 +102,6 @@ int64_t current_location() {
 	return static_cast<int64_t>(nodes.size());
 }
 
-/**
- * @brief to_string
- * @param statement
- * @return
- */
-std::string to_string(const std::unique_ptr<Expression> &statement) {
-	if (auto atom_expression = dynamic_cast<AtomExpression *>(statement.get())) {
-		return atom_expression->value;
-	}
-
-	printf("(to_string) EXPRESSION - UNHANDLED\n");
-	abort();
-}
-
 /**
  * @brief emit_node
  * @param args
@@ -192,180 +130,392 @@ T *c_emit_node(bool enabled, Args... args) {
 }
 
 /**
- * @brief generate_ir
- * @param statement
+ * @brief Generates IR from either form of the AST, Ast is one of PointerAst
+ * or FlatAst
  */
-void generate_ir(const ExpressionStatement *statement) {
-	generate_ir(statement->expression);
-}
+template <class Ast>
+class Generator {
+private:
+	using ExpressionRef = typename Ast::ExpressionRef;
+	using StatementRef  = typename Ast::StatementRef;
+	using StatementList = typename Ast::StatementList;
+
+	using BinaryExpression     = typename Ast::BinaryExpression;
+	using UnaryExpression      = typename Ast::UnaryExpression;
+	using AtomExpression       = typename Ast::AtomExpression;
+	using CallExpression       = typename Ast::CallExpression;
+	using ArrayIndexExpression = typename Ast::ArrayIndexExpression;
+
+	using DeleteStatement     = typename Ast::DeleteStatement;
+	using FunctionStatement   = typename Ast::FunctionStatement;
+	using BlockStatement      = typename Ast::BlockStatement;
+	using CondStatement       = typename Ast::CondStatement;
+	using LoopStatement       = typename Ast::LoopStatement;
+	using ForEachStatement    = typename Ast::ForEachStatement;
+	using BreakStatement      = typename Ast::BreakStatement;
+	using ContinueStatement   = typename Ast::ContinueStatement;
+	using ExpressionStatement = typename Ast::ExpressionStatement;
+	using ReturnStatement     = typename Ast::ReturnStatement;
+
+	/**
+	 * @brief a pending step of generating an expression
+	 */
+	struct Task {
+		enum Stage : uint8_t {
+			Generate, // generate the code for an expression
+			Open,     // the first operand of a chain of && or || is done
+			Link,     // an operand in the middle of a chain is done
+			Finish,   // all of the operands are done
+			Save,     // keep the value of an expression which is read again
+		};
+
+		Stage stage;
+		ExpressionRef expression;
+	};
+
+public:
+	Generator(Ast &ast, bool rotate_loops) noexcept
+		: ast_(ast), rotate_loops_(rotate_loops), invariants_(ast), subexpressions_(ast) {
+	}
 
-/**
- * @brief generate_ir
- * @param statement
- */
-void generate_ir(const Expression *statement) {
-	if (auto binary_expression = dynamic_cast<const BinaryExpression *>(statement)) {
+public:
+	/**
+	 * @brief to_string
+	 * @param expression
+	 * @return
+	 */
+	std::string to_string(ExpressionRef expression) {
+		if (auto atom_expression = ast_.template as<AtomExpression>(expression)) {
+			return std::string(ast_.text(atom_expression->value));
+		}
+
+		printf("(to_string) EXPRESSION - UNHANDLED\n");
+		abort();
+	}
 
+	/**
+	 * @brief generate_ir
+	 * @param statement
+	 */
+	void generate_ir(ExpressionStatement *statement) {
+		generate_ir(statement->expression);
+	}
+
+	/**
+	 * @brief generate_ir
+	 * @param expression
+	 *
+	 * Generates the code for an expression using an explicit stack of tasks
+	 * rather than recursion, so that no matter how deeply the expression is
+	 * nested, the native stack doesn't grow. Generating a node schedules its
+	 * operands followed by a task to finish the node once they are done.
+	 */
+	void generate_ir(ExpressionRef expression) {
+
+		tasks_.clear();
+		schedule(expression);
+
+		while (!tasks_.empty()) {
+			const Task task = tasks_.back();
+			tasks_.pop_back();
+
+			switch (task.stage) {
+			case Task::Generate:
+				if (task.expression && generate_reused(task.expression)) {
+					break;
+				}
+
+				if (task.expression) {
+
+					// NOTE(eteran): any value which is read back is dealt with
+					// above, what is left is one to keep
+					if (subexpressions_.mark(task.expression)) {
+						schedule(Task::Save, task.expression);
+					}
+
+					// NOTE(eteran): tasks are scheduled in the order that they
+					// should run, and then reversed to suit the stack
+					const size_t first = tasks_.size();
+					ast_.visit(task.expression, [this, &task](auto node) { generate_ir(task.expression, node); });
+					std::reverse(tasks_.begin() + static_cast<ptrdiff_t>(first), tasks_.end());
+				}
+				break;
+			case Task::Open:
+				open_ir(ast_.template as<BinaryExpression>(task.expression));
+				break;
+			case Task::Link:
+				link_ir(ast_.template as<BinaryExpression>(task.expression));
+				break;
+			case Task::Finish:
+				ast_.visit(task.expression, [this](auto node) { finish_ir(node); });
+				break;
+			case Task::Save:
+				emit_node<Node>("DUP");
+				emit_node<AssignNode>("ASSIGN", subexpression(subexpressions_.mark(task.expression)->temporary));
+				break;
+			}
+		}
+	}
+
+	/**
+	 * @brief generate_ir
+	 * @param expression
+	 * @param binary_expression
+	 */
+	void generate_ir(ExpressionRef expression, BinaryExpression *binary_expression) {
 		++in_binary_expression;
 
 		switch (binary_expression->op) {
 		case Token::Assign:
-			if (auto array_index = dynamic_cast<const ArrayIndexExpression *>(binary_expression->lhs.get())) {
+			if (auto array_index = ast_.template as<ArrayIndexExpression>(binary_expression->lhs)) {
 
 				emit_node<PushArraySymbolNode>("PUSH_ARRAY_SYM", to_string(array_index->array), "createAndRef");
 
-				for (const std::unique_ptr<Expression> &index_expr : array_index->index) {
-					generate_ir(index_expr);
+				for (ExpressionRef index_expr : ast_.list(array_index->index)) {
+					schedule(index_expr);
 				}
-				generate_ir(binary_expression->rhs);
 
-				emit_node<ArrayOpNode>("ARRAY_ASSIGN", array_index->index.size());
+				setup_ = subexpressions_.read_modify_write(binary_expression);
+			}
+
+			schedule(binary_expression->rhs);
+			break;
+		case Token::Add:
+		case Token::Sub:
+		case Token::Mul:
+		case Token::Div:
+		case Token::Mod:
+		case Token::Exponent:
+		case Token::Equal:
+		case Token::NotEqual:
+		case Token::LessThan:
+		case Token::GreaterThan:
+		case Token::GreaterThanOrEqual:
+		case Token::LessThanOrEqual:
+			schedule(binary_expression->lhs);
+			schedule(binary_expression->rhs);
+			break;
+		case Token::Concatenate:
+		case Token::LogicalAnd:
+		case Token::LogicalOr: {
+
+			// NOTE(eteran): a chain of these nests to the right, rather than
+			// descending into each link of the chain, its operands are
+			// generated one after the other, with a link between each pair
+			schedule(binary_expression->lhs);
+
+			if (binary_expression->op != Token::Concatenate) {
+				schedule(Task::Open, expression);
+			}
+
+			ExpressionRef ptr = binary_expression->rhs;
+
+			while (auto binary_rhs = ast_.template as<BinaryExpression>(ptr)) {
+				if (binary_rhs->op != binary_expression->op) {
+					break;
+				}
 
+				schedule(binary_rhs->lhs);
+				schedule(Task::Link, expression);
+				ptr = binary_rhs->rhs;
+			}
+
+			schedule(ptr);
+			break;
+		}
+		default:
+			printf("BINARY EXPRESSION - UNHANDLED [%d]\n", binary_expression->op);
+			abort();
+		}
+
+		schedule(Task::Finish, expression);
+	}
+
+	/**
+	 * @brief generate_ir
+	 * @param expression
+	 * @param unary_expression
+	 */
+	void generate_ir(ExpressionRef expression, UnaryExpression *unary_expression) {
+		switch (unary_expression->op) {
+		case Token::Sub:
+		case Token::Increment:
+		case Token::Decrement:
+			schedule(unary_expression->operand);
+			schedule(Task::Finish, expression);
+			break;
+		default:
+			printf("UNARY EXPRESSION - UNHANDLED [%d]\n", unary_expression->op);
+			abort();
+		}
+	}
+
+	/**
+	 * @brief generate_ir
+	 * @param expression
+	 * @param atom_expression
+	 */
+	void generate_ir(ExpressionRef expression, AtomExpression *atom_expression) {
+		(void)expression;
+
+		switch (atom_expression->type) {
+		case Token::Integer:
+			emit_node<PushSymbolNode>("PUSH_SYM const", std::string(ast_.text(atom_expression->value)));
+			break;
+		case Token::String:
+			emit_node<PushStringNode>("PUSH_SYM string", std::string(ast_.text(atom_expression->value)));
+			break;
+		case Token::Identifier:
+			emit_node<PushSymbolNode>("PUSH_SYM", std::string(ast_.text(atom_expression->value)));
+			break;
+		case Token::ArrayIdentifier:
+			emit_node<PushArraySymbolNode>("PUSH_ARRAY_SYM", std::string(ast_.text(atom_expression->value)), "refOnly");
+			break;
+		default:
+			printf("ATOM EXPRESSION - UNHANDLED (%d)\n", atom_expression->type);
+			abort();
+		}
+	}
+
+	/**
+	 * @brief generate_ir
+	 * @param expression
+	 * @param call_expression
+	 */
+	void generate_ir(ExpressionRef expression, CallExpression *call_expression) {
+		for (ExpressionRef parameter : ast_.list(call_expression->parameters)) {
+			schedule(parameter);
+		}
+
+		schedule(Task::Finish, expression);
+	}
+
+	/**
+	 * @brief generate_ir
+	 * @param expression
+	 * @param index_expression
+	 */
+	void generate_ir(ExpressionRef expression, ArrayIndexExpression *index_expression) {
+		schedule(index_expression->array);
+		for (ExpressionRef index_expr : ast_.list(index_expression->index)) {
+			schedule(index_expr);
+		}
+
+		schedule(Task::Finish, expression);
+	}
+
+	/**
+	 * @brief open_ir
+	 * @param binary_expression a chain of && or ||, whose first operand is done
+	 */
+	void open_ir(BinaryExpression *binary_expression) {
+		emit_node<Node>("DUP");
+		branches_.push_back(emit_node<BranchNode>(binary_expression->op == Token::LogicalAnd ? "BRANCH_FALSE" : "BRANCH_TRUE"));
+	}
+
+	/**
+	 * @brief link_ir
+	 * @param binary_expression a chain, one of whose middle operands is done
+	 */
+	void link_ir(BinaryExpression *binary_expression) {
+		switch (binary_expression->op) {
+		case Token::Concatenate:
+			emit_node<Node>("CONCAT");
+			break;
+		case Token::LogicalAnd:
+		case Token::LogicalOr: {
+			emit_node<Node>(binary_expression->op == Token::LogicalAnd ? "AND" : "OR");
+
+			BranchNode *br = branches_.back();
+			br->target     = current_location() - br->location;
+
+			emit_node<Node>("DUP");
+			branches_.back() = emit_node<BranchNode>(binary_expression->op == Token::LogicalAnd ? "BRANCH_FALSE" : "BRANCH_TRUE");
+			break;
+		}
+		default:
+			abort();
+		}
+	}
+
+	/**
+	 * @brief finish_ir
+	 * @param binary_expression
+	 */
+	void finish_ir(BinaryExpression *binary_expression) {
+		switch (binary_expression->op) {
+		case Token::Assign:
+			if (auto array_index = ast_.template as<ArrayIndexExpression>(binary_expression->lhs)) {
+				emit_node<ArrayOpNode>("ARRAY_ASSIGN", ast_.list(array_index->index).size());
 			} else {
-				generate_ir(binary_expression->rhs);
 				emit_node<AssignNode>("ASSIGN", to_string(binary_expression->lhs));
 			}
 			break;
 		case Token::Add:
-			generate_ir(binary_expression->lhs);
-			generate_ir(binary_expression->rhs);
 			emit_node<Node>("ADD");
 			break;
 		case Token::Sub:
-			generate_ir(binary_expression->lhs);
-			generate_ir(binary_expression->rhs);
 			emit_node<Node>("SUB");
 			break;
 		case Token::Mul:
-			generate_ir(binary_expression->lhs);
-			generate_ir(binary_expression->rhs);
 			emit_node<Node>("MUL");
 			break;
 		case Token::Div:
-			generate_ir(binary_expression->lhs);
-			generate_ir(binary_expression->rhs);
 			emit_node<Node>("DIV");
 			break;
 		case Token::Mod:
-			generate_ir(binary_expression->lhs);
-			generate_ir(binary_expression->rhs);
 			emit_node<Node>("MOD");
 			break;
+		case Token::Exponent:
+			emit_node<Node>("POWER");
+			break;
 		case Token::Equal:
-			generate_ir(binary_expression->lhs);
-			generate_ir(binary_expression->rhs);
 			emit_node<Node>("EQ");
 			break;
 		case Token::NotEqual:
-			generate_ir(binary_expression->lhs);
-			generate_ir(binary_expression->rhs);
 			emit_node<Node>("NE");
 			break;
 		case Token::LessThan:
-			generate_ir(binary_expression->lhs);
-			generate_ir(binary_expression->rhs);
 			emit_node<Node>("LT");
 			break;
 		case Token::GreaterThan:
-			generate_ir(binary_expression->lhs);
-			generate_ir(binary_expression->rhs);
 			emit_node<Node>("GT");
 			break;
 		case Token::GreaterThanOrEqual:
-			generate_ir(binary_expression->lhs);
-			generate_ir(binary_expression->rhs);
 			emit_node<Node>("GE");
 			break;
 		case Token::LessThanOrEqual:
-			generate_ir(binary_expression->lhs);
-			generate_ir(binary_expression->rhs);
 			emit_node<Node>("LE");
 			break;
-		case Token::Concatenate: {
-			generate_ir(binary_expression->lhs);
-
-			Expression *ptr = binary_expression->rhs.get();
-
-			while (auto binary_rhs = dynamic_cast<BinaryExpression *>(ptr)) {
-				if (binary_rhs->op == Token::Concatenate) {
-					generate_ir(binary_rhs->lhs);
-					emit_node<Node>("CONCAT");
-					ptr = binary_rhs->rhs.get();
-				} else {
-					break;
-				}
-			}
-
-			generate_ir(ptr);
+		case Token::Concatenate:
 			emit_node<Node>("CONCAT");
 			break;
-		}
-		case Token::LogicalAnd: {
-
-			generate_ir(binary_expression->lhs);
-			emit_node<Node>("DUP");
-
-			BranchNode *br  = emit_node<BranchNode>("BRANCH_FALSE");
-			Expression *ptr = binary_expression->rhs.get();
-
-			while (auto binary_rhs = dynamic_cast<BinaryExpression *>(ptr)) {
-				if (binary_rhs->op != Token::LogicalAnd) {
-					break;
-				}
-
-				generate_ir(binary_rhs->lhs);
-				emit_node<Node>("AND");
-				br->target = current_location() - br->location;
-				emit_node<Node>("DUP");
-				br  = emit_node<BranchNode>("BRANCH_FALSE");
-				ptr = binary_rhs->rhs.get();
-			}
-
-			generate_ir(ptr);
-			emit_node<Node>("AND");
-			br->target = current_location() - br->location;
-			break;
-		}
+		case Token::LogicalAnd:
 		case Token::LogicalOr: {
-			generate_ir(binary_expression->lhs);
-			emit_node<Node>("DUP");
-
-			BranchNode *br  = emit_node<BranchNode>("BRANCH_TRUE");
-			Expression *ptr = binary_expression->rhs.get();
-
-			while (auto binary_rhs = dynamic_cast<BinaryExpression *>(ptr)) {
-				if (binary_rhs->op != Token::LogicalOr) {
-					break;
-				}
+			emit_node<Node>(binary_expression->op == Token::LogicalAnd ? "AND" : "OR");
 
-				generate_ir(binary_rhs->lhs);
-				emit_node<Node>("OR");
-				br->target = current_location() - br->location;
-				emit_node<Node>("DUP");
-				br  = emit_node<BranchNode>("BRANCH_TRUE");
-				ptr = binary_rhs->rhs.get();
-			}
-
-			generate_ir(ptr);
-			emit_node<Node>("OR");
-			br->target = current_location() - br->location;
+			BranchNode *br = branches_.back();
+			br->target     = current_location() - br->location;
+			branches_.pop_back();
 			break;
 		}
 		default:
-			printf("BINARY EXPRESSION - UNHANDLED [%d]\n", binary_expression->op);
 			abort();
 		}
 
 		--in_binary_expression;
+	}
 
-	} else if (auto unary_expression = dynamic_cast<const UnaryExpression *>(statement)) {
+	/**
+	 * @brief finish_ir
+	 * @param unary_expression
+	 */
+	void finish_ir(UnaryExpression *unary_expression) {
 		switch (unary_expression->op) {
 		case Token::Sub:
-			generate_ir(unary_expression->operand);
 			emit_node<Node>("NEGATE");
 			break;
 		case Token::Increment:
-			generate_ir(unary_expression->operand);
 			if (unary_expression->prefix) {
 				c_emit_node<Node>(in_binary_expression, "DUP");
 				emit_node<Node>("INCR");
@@ -378,7 +528,6 @@ void generate_ir(const Expression *statement) {
 			emit_node<AssignNode>("ASSIGN", to_string(unary_expression->operand));
 			break;
 		case Token::Decrement:
-			generate_ir(unary_expression->operand);
 			if (unary_expression->prefix) {
 				c_emit_node<Node>(in_binary_expression, "DUP");
 				emit_node<Node>("DECR");
@@ -390,73 +539,91 @@ void generate_ir(const Expression *statement) {
 			emit_node<AssignNode>("ASSIGN", to_string(unary_expression->operand));
 			break;
 		default:
-			printf("UNARY EXPRESSION - UNHANDLED [%d]\n", unary_expression->op);
-			abort();
-		}
-	} else if (auto atom_expression = dynamic_cast<const AtomExpression *>(statement)) {
-		switch (atom_expression->type) {
-		case Token::Integer:
-			emit_node<PushSymbolNode>("PUSH_SYM const", atom_expression->value);
-			break;
-		case Token::String:
-			emit_node<PushStringNode>("PUSH_SYM string", atom_expression->value);
-			break;
-		case Token::Identifier:
-			emit_node<PushSymbolNode>("PUSH_SYM", atom_expression->value);
-			break;
-		case Token::ArrayIdentifier:
-			emit_node<PushArraySymbolNode>("PUSH_ARRAY_SYM", atom_expression->value, "refOnly");
-			break;
-		default:
-			printf("ATOM EXPRESSION - UNHANDLED (%d)\n", atom_expression->type);
 			abort();
 		}
-	} else if (auto call_expression = dynamic_cast<const CallExpression *>(statement)) {
+	}
 
-		for (auto &parameter : call_expression->parameters) {
-			generate_ir(parameter);
-		}
+	/**
+	 * @brief finish_ir
+	 * @param atom_expression
+	 */
+	void finish_ir(AtomExpression *atom_expression) {
+		(void)atom_expression;
+	}
 
-		emit_node<CallNode>("SUBR_CALL", to_string(call_expression->function), call_expression->parameters.size());
+	/**
+	 * @brief finish_ir
+	 * @param call_expression
+	 */
+	void finish_ir(CallExpression *call_expression) {
+		emit_node<CallNode>("SUBR_CALL", to_string(call_expression->function), ast_.list(call_expression->parameters).size());
 
 		c_emit_node<Node>(in_binary_expression, "FETCH_RET_VAL");
+	}
 
-	} else if (auto index_expression = dynamic_cast<const ArrayIndexExpression *>(statement)) {
-
-		generate_ir(index_expression->array);
-		for (const std::unique_ptr<Expression> &index_expr : index_expression->index) {
-			generate_ir(index_expr);
-		}
+	/**
+	 * @brief finish_ir
+	 * @param index_expression
+	 */
+	void finish_ir(ArrayIndexExpression *index_expression) {
+		emit_node<ArrayOpNode>("ARRAY_REF", ast_.list(index_expression->index).size());
+	}
 
-		emit_node<ArrayOpNode>("ARRAY_REF", index_expression->index.size());
+	/**
+	 * @brief schedule
+	 * @param expression
+	 */
+	void schedule(ExpressionRef expression) {
+		tasks_.push_back(Task{Task::Generate, expression});
 	}
-}
 
-/**
- * @brief generate_ir
- * @param statement
- */
-void generate_ir(const Statement *statement) {
-	if (auto delete_statement = dynamic_cast<const DeleteStatement *>(statement)) {
+	/**
+	 * @brief schedule
+	 * @param stage
+	 * @param expression
+	 */
+	void schedule(typename Task::Stage stage, ExpressionRef expression) {
+		tasks_.push_back(Task{stage, expression});
+	}
 
+	/**
+	 * @brief generate_ir
+	 * @param delete_statement
+	 */
+	void generate_ir(DeleteStatement *delete_statement) {
 		generate_ir(delete_statement->expression);
-		for (const std::unique_ptr<Expression> &index_expr : delete_statement->index) {
+		for (ExpressionRef index_expr : ast_.list(delete_statement->index)) {
 			generate_ir(index_expr);
 		}
-		emit_node<ArrayOpNode>("ARRAY_DELETE", delete_statement->index.size());
+		emit_node<ArrayOpNode>("ARRAY_DELETE", ast_.list(delete_statement->index).size());
+	}
 
-	} else if (auto function_statement = dynamic_cast<const FunctionStatement *>(statement)) {
+	/**
+	 * @brief generate_ir
+	 * @param function_statement
+	 */
+	void generate_ir(FunctionStatement *function_statement) {
 		(void)function_statement;
 		printf("FUNCTION - UNHANDLED\n");
 		// NOTE(eteran): NEdit handles functions wierd, they are plucked out and treated like independently compiled programs...
-#if 1
+	#if 1
 		abort();
-#endif
-	} else if (auto block_statement = dynamic_cast<const BlockStatement *>(statement)) {
-		generate_ir(block_statement->statements);
+	#endif
+	}
 
-	} else if (auto cond_statement = dynamic_cast<const CondStatement *>(statement)) {
+	/**
+	 * @brief generate_ir
+	 * @param block_statement
+	 */
+	void generate_ir(BlockStatement *block_statement) {
+		generate_ir(block_statement->statements);
+	}
 
+	/**
+	 * @brief generate_ir
+	 * @param cond_statement
+	 */
+	void generate_ir(CondStatement *cond_statement) {
 		generate_ir(cond_statement->cond);
 
 		BranchNode *br = emit_node<BranchNode>("BRANCH_FALSE");
@@ -471,17 +638,31 @@ void generate_ir(const Statement *statement) {
 		}
 
 		br->target = current_location() - br->location;
+	}
 
-	} else if (auto loop_statement = dynamic_cast<const LoopStatement *>(statement)) {
+	/**
+	 * @brief generate_ir
+	 * @param loop_statement
+	 */
+	void generate_ir(LoopStatement *loop_statement) {
+		if (rotate_loops_) {
+			generate_rotated_ir(loop_statement);
+			return;
+		}
 
 		BranchNode *cond_br;
 
-		loopStack.push({loop_statement, {}, {}});
+		loopStack.push({});
 
-		for (auto &&init_expr : loop_statement->init) {
+		for (ExpressionRef init_expr : ast_.list(loop_statement->init)) {
 			generate_ir(init_expr);
 		}
 
+		// NOTE(eteran): the condition is tested before anything else in the
+		// loop, so only the invariants of the body of a loop which is always
+		// entered can be computed here
+		const size_t hoisted = hoist(loop_statement, !loop_statement->cond || always_true(loop_statement->cond));
+
 		auto loop_start = current_location();
 
 		if (!loop_statement->cond) {
@@ -495,7 +676,7 @@ void generate_ir(const Statement *statement) {
 
 		auto loop_incr = current_location();
 
-		for (auto &&incr_expr : loop_statement->incr) {
+		for (ExpressionRef incr_expr : ast_.list(loop_statement->incr)) {
 			generate_ir(incr_expr);
 		}
 
@@ -518,12 +699,191 @@ void generate_ir(const Statement *statement) {
 		}
 
 		loopStack.pop();
-	} else if (auto foreach_statement = dynamic_cast<const ForEachStatement *>(statement)) {
+		unhoist(hoisted);
+	}
+
+	/**
+	 * @brief generate_rotated_ir
+	 * @param loop_statement
+	 *
+	 * Lays the loop out with its condition at the bottom, so that each
+	 * iteration only runs the one branch which goes back to the top. The
+	 * condition is tested once more on the way in, to skip the loop when it
+	 * fails from the start
+	 */
+	void generate_rotated_ir(LoopStatement *loop_statement) {
+		BranchNode *guard_br = nullptr;
+
+		loopStack.push({});
+
+		for (ExpressionRef init_expr : ast_.list(loop_statement->init)) {
+			generate_ir(init_expr);
+		}
+
+		if (loop_statement->cond) {
+			generate_ir(loop_statement->cond);
+			guard_br = emit_node<BranchNode>("BRANCH_FALSE");
+		}
+
+		// NOTE(eteran): past the guard, the loop is known to be entered
+		const size_t hoisted = hoist(loop_statement, true);
+
+		auto loop_start = current_location();
+
+		generate_ir(loop_statement->body);
+
+		auto loop_incr = current_location();
+
+		for (ExpressionRef incr_expr : ast_.list(loop_statement->incr)) {
+			generate_ir(incr_expr);
+		}
+
+		BranchNode *br;
+		if (loop_statement->cond) {
+			generate_ir(loop_statement->cond);
+			br = emit_node<BranchNode>("BRANCH_TRUE");
+		} else {
+			br = emit_node<BranchNode>("BRANCH");
+		}
+
+		br->target = loop_start - br->location;
+
+		auto loop_end = current_location();
+
+		if (guard_br) {
+			guard_br->target = loop_end - guard_br->location;
+		}
+
+		for (BranchNode *break_br : loopStack.top().breaks) {
+			break_br->target = loop_end - break_br->location;
+		}
+
+		for (BranchNode *cont_br : loopStack.top().continues) {
+			cont_br->target = loop_incr - cont_br->location;
+		}
+
+		loopStack.pop();
+		unhoist(hoisted);
+	}
+
+	/**
+	 * @brief hoist
+	 * @param loop_statement
+	 * @param entered if true, the loop is known to be entered from here
+	 * @return how many expressions were hoisted before this loop's, to give to
+	 * unhoist once the loop is done
+	 *
+	 * Computes the invariants of the loop here, each into a variable of its
+	 * own, which the loop then reads instead
+	 */
+	size_t hoist(LoopStatement *loop_statement, bool entered) {
+		const size_t size = temporaries_.size();
+
+		for (ExpressionRef expression : invariants_.find(loop_statement, entered, hoisted_)) {
+			std::string temporary = "<licm" + std::to_string(temporary_count_++) + ">";
+
+			// NOTE(eteran): generated the way that it would be as the right
+			// hand side of an assignment
+			++in_binary_expression;
+			generate_ir(expression);
+			--in_binary_expression;
+
+			emit_node<AssignNode>("ASSIGN", temporary);
+			hoisted_.emplace(node_key(ast_, expression), temporaries_.size());
+			hoisted_keys_.push_back(node_key(ast_, expression));
+			temporaries_.push_back(std::move(temporary));
+		}
+
+		return size;
+	}
+
+	/**
+	 * @brief unhoist
+	 * @param size what hoist returned for the loop which is done
+	 */
+	void unhoist(size_t size) {
+		while (hoisted_keys_.size() > size) {
+			hoisted_.erase(hoisted_keys_.back());
+			hoisted_keys_.pop_back();
+		}
+
+		temporaries_.resize(size);
+	}
+
+	/**
+	 * @brief generate_reused
+	 * @param expression
+	 * @return true if the value of expression has already been computed, in
+	 * which case the code to take it from where it is has been generated
+	 */
+	bool generate_reused(ExpressionRef expression) {
+
+		if (expression == setup_) {
+			emit_node<ArrayOpNode>("ARRAY_REF_ASSIGN_SETUP", ast_.list(ast_.template as<ArrayIndexExpression>(expression)->index).size());
+			setup_ = ExpressionRef();
+			return true;
+		}
+
+		auto it = hoisted_.empty() ? hoisted_.end() : hoisted_.find(node_key(ast_, expression));
+		if (it != hoisted_.end()) {
+			emit_node<PushSymbolNode>("PUSH_SYM", temporaries_[it->second]);
+			return true;
+		}
+
+		auto mark = subexpressions_.mark(expression);
+		if (mark && !mark->keep) {
+			emit_node<PushSymbolNode>("PUSH_SYM", subexpression(mark->temporary));
+			return true;
+		}
+
+		return false;
+	}
+
+	/**
+	 * @brief subexpression
+	 * @param temporary
+	 * @return the name of the variable which keeps a common subexpression
+	 */
+	static std::string subexpression(size_t temporary) {
+		return "<cse" + std::to_string(temporary) + ">";
+	}
+
+	/**
+	 * @brief always_true
+	 * @param expression
+	 * @return true if expression is an integer constant other than zero
+	 */
+	bool always_true(ExpressionRef expression) {
+		if (auto atom = ast_.template as<AtomExpression>(expression)) {
+			if (atom->type == Token::Integer) {
+				std::string_view text = ast_.text(atom->value);
+
+				int64_t n       = 0;
+				const char *end = text.data() + text.size();
+
+				auto [ptr, ec] = std::from_chars(text.data(), end, n, 10);
+				return ec == std::errc() && ptr == end && n != 0;
+			}
+		}
+
+		return false;
+	}
+
+	/**
+	 * @brief generate_ir
+	 * @param foreach_statement
+	 */
+	void generate_ir(ForEachStatement *foreach_statement) {
 		(void)foreach_statement;
 		printf("FOREACH - UNHANDLED\n");
 		abort();
-	} else if (auto break_statement = dynamic_cast<const BreakStatement *>(statement)) {
+	}
 
+	/**
+	 * @brief generate_ir
+	 * @param break_statement
+	 */
+	void generate_ir(BreakStatement *break_statement) {
 		(void)break_statement;
 
 		if (loopStack.empty()) {
@@ -533,8 +893,13 @@ void generate_ir(const Statement *statement) {
 
 		BranchNode *br = emit_node<BranchNode>("BRANCH");
 		loopStack.top().breaks.push_back(br);
-	} else if (auto continue_statement = dynamic_cast<const ContinueStatement *>(statement)) {
+	}
 
+	/**
+	 * @brief generate_ir
+	 * @param continue_statement
+	 */
+	void generate_ir(ContinueStatement *continue_statement) {
 		(void)continue_statement;
 
 		if (loopStack.empty()) {
@@ -544,11 +909,13 @@ void generate_ir(const Statement *statement) {
 
 		BranchNode *br = emit_node<BranchNode>("BRANCH");
 		loopStack.top().continues.push_back(br);
+	}
 
-	} else if (auto expression_statement = dynamic_cast<const ExpressionStatement *>(statement)) {
-		generate_ir(expression_statement);
-	} else if (auto return_statement = dynamic_cast<const ReturnStatement *>(statement)) {
-
+	/**
+	 * @brief generate_ir
+	 * @param return_statement
+	 */
+	void generate_ir(ReturnStatement *return_statement) {
 		if (return_statement->expression) {
 			generate_ir(return_statement->expression);
 			emit_node<Node>("RETURN");
@@ -556,43 +923,122 @@ void generate_ir(const Statement *statement) {
 			emit_node<Node>("RETURN_NO_VAL");
 		}
 	}
+
+	/**
+	 * @brief generate_ir
+	 * @param statement
+	 */
+	void generate_ir(StatementRef statement) {
+		if (statement) {
+			ast_.visit(statement, [this](auto node) { generate_ir(node); });
+		}
+	}
+
+	/**
+	 * @brief generate_ir
+	 * @param statements
+	 *
+	 * Runs of statements which are evaluated one after the other, without any
+	 * branch between them, are generated together so that what one of them
+	 * computes can be reused by those after it
+	 */
+	void generate_ir(const StatementList &statements) {
+		for (StatementRef statement : ast_.list(statements)) {
+			if (ast_.template as<ExpressionStatement>(statement) || ast_.template as<DeleteStatement>(statement)) {
+				run_.push_back(statement);
+				continue;
+			}
+
+			generate_run();
+			generate_ir(statement);
+		}
+
+		generate_run();
+	}
+
+	/**
+	 * @brief generate_run
+	 */
+	void generate_run() {
+		if (run_.empty()) {
+			return;
+		}
+
+		subexpressions_.find(run_, hoisted_);
+
+		for (StatementRef statement : run_) {
+			generate_ir(statement);
+		}
+
+		subexpressions_.clear();
+		run_.clear();
+	}
+
+private:
+	Ast &ast_;
+	std::vector<Task> tasks_;
+	bool rotate_loops_;
+
+	// NOTE(eteran): the invariants of the loops being generated, which have
+	// been computed ahead of them, and the variables that hold their values
+	LoopInvariants<Ast> invariants_;
+	Hoisted hoisted_;
+	std::vector<const void *> hoisted_keys_;
+	std::vector<std::string> temporaries_;
+	size_t temporary_count_ = 0;
+
+	// NOTE(eteran): the run of statements being gathered, what they compute
+	// more than once, and the read of an array element which is to reuse the
+	// reference made by the assignment to it (see read_modify_write)
+	std::vector<StatementRef> run_;
+	CommonSubexpressions<Ast> subexpressions_;
+	ExpressionRef setup_;
+
+	// NOTE(eteran): the pending branch of each chain of && or || being
+	// generated, innermost last
+	std::vector<BranchNode *> branches_;
+};
+
 }
 
 /**
- * @brief generate_ir
- * @param statement
+ * @brief CodeGenerator::generate
+ * @param statements
+ * @param rotate_loops if true, loops test their condition at the bottom
  */
-void generate_ir(const std::unique_ptr<Statement> &statement) {
-	generate_ir(statement.get());
+void CodeGenerator::generate(const NodeList<Statement> &statements, bool rotate_loops) {
+	PointerAst ast;
+	Generator<PointerAst>(ast, rotate_loops).generate_ir(statements);
+	emit_node<Node>("RETURN_NO_VAL");
 }
 
 /**
- * @brief generate_ir
- * @param expression
+ * @brief CodeGenerator::generate
+ * @param ast
+ * @param rotate_loops if true, loops test their condition at the bottom
  */
-void generate_ir(const std::unique_ptr<Expression> &expression) {
-	generate_ir(expression.get());
+void CodeGenerator::generate(FlatAst &ast, bool rotate_loops) {
+	Generator<FlatAst>(ast, rotate_loops).generate_ir(ast.statements());
+	emit_node<Node>("RETURN_NO_VAL");
 }
 
 /**
- * @brief generate_ir
- * @param statements
+ * @brief CodeGenerator::optimize_ir
+ *
+ * Applies the peephole rules to the code generated so far
  */
-void generate_ir(const std::vector<std::unique_ptr<Statement>> &statements) {
-	for (auto it = statements.begin(); it != statements.end(); ++it) {
-		generate_ir(*it);
-	}
-}
-
+void CodeGenerator::optimize_ir() {
+	Peephole::optimize(nodes);
 }
 
 /**
- * @brief CodeGenerator::generate
- * @param statements
+ * @brief CodeGenerator::print_statistics
+ *
+ * Prints how many times each peephole rule was applied, and how many
+ * instructions that saved
  */
-void CodeGenerator::generate(const std::vector<std::unique_ptr<Statement>> &statements) {
-	generate_ir(statements);
-	emit_node<Node>("RETURN_NO_VAL");
+void CodeGenerator::print_statistics() {
+	Peephole::print_statistics();
 }
 
 /**
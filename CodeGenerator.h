@@ -1,15 +1,18 @@
 #ifndef CODEGENERATOR_H
 #define CODEGENERATOR_H
 
-#include <memory>
-#include <vector>
+#include "Arena.h"
 
+class FlatAst;
 class Statement;
 
 namespace CodeGenerator {
 
-void generate(const std::vector<std::unique_ptr<Statement>> &statements);
+void generate(const NodeList<Statement> &statements, bool rotate_loops = false);
+void generate(FlatAst &ast, bool rotate_loops = false);
+void optimize_ir();
 void print_ir();
+void print_statistics();
 
 }
 
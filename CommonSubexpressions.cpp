@@ -0,0 +1,700 @@
+
+#include "CommonSubexpressions.h"
+#include "FlatAst.h"
+#include "PointerAst.h"
+#include <algorithm>
+
+/**
+ * @brief CommonSubexpressions::find
+ * @param statements a run of statements which are evaluated one after
+ * the other, each of them an expression or delete statement
+ * @param hoisted expressions which have been moved out of the loops that
+ * they are in, these are left alone
+ */
+template <class Ast>
+void CommonSubexpressions<Ast>::find(const std::vector<StatementRef> &statements, const Hoisted &hoisted) {
+
+	hoisted_ = &hoisted;
+	ids_.clear();
+	entries_.clear();
+	uses_.clear();
+	log_.clear();
+	marks_     = {};
+	index_     = {};
+	writes_    = {};
+	time_      = 0;
+	last_call_ = 0;
+	rmw_       = ExpressionRef();
+
+	// NOTE(eteran): everything that may be read back is, or is within, an
+	// array lookup, most runs have none and needn't be walked properly
+	if (!has_lookup(statements)) {
+		return;
+	}
+
+	auto walker = Overloaded{
+		[&](ExpressionStatement *expression_statement) {
+			walk(expression_statement->expression);
+		},
+		[&](DeleteStatement *delete_statement) {
+			for (ExpressionRef index_expr : ast_.list(delete_statement->index)) {
+				walk(index_expr);
+			}
+
+			write(delete_statement->expression);
+		},
+		[](auto) {},
+	};
+
+	for (StatementRef statement : statements) {
+		ast_.visit(statement, walker);
+	}
+
+	// NOTE(eteran): keeping a value costs two instructions, which an index
+	// must save to be worth it, a lookup is always worth saving
+	for (Entry &entry : entries_) {
+		if (entry.uses != 0 && (entry.lookup || entry.uses * (entry.size - 1) > 2)) {
+			entry.temporary = temporaries_++;
+			marks_.emplace(node_key(ast_, entry.expression), Mark{true, entry.temporary});
+		}
+	}
+
+	for (const auto &[expression, entry] : uses_) {
+		if (entries_[entry].temporary != NoTemporary) {
+			marks_.emplace(node_key(ast_, expression), Mark{false, entries_[entry].temporary});
+		}
+	}
+}
+
+/**
+ * @brief CommonSubexpressions::mark
+ * @param expression
+ * @return what to do with the expression, or nullptr if it is generated
+ * as usual
+ */
+template <class Ast>
+const typename CommonSubexpressions<Ast>::Mark *CommonSubexpressions<Ast>::mark(ExpressionRef expression) {
+	if (marks_.empty()) {
+		return nullptr;
+	}
+
+	auto it = marks_.find(node_key(ast_, expression));
+	return it != marks_.end() ? &it->second : nullptr;
+}
+
+/**
+ * @brief CommonSubexpressions::clear
+ */
+template <class Ast>
+void CommonSubexpressions<Ast>::clear() {
+	marks_.clear();
+}
+
+/**
+ * @brief CommonSubexpressions::read_modify_write
+ * @param assign an assignment
+ * @return if assign is to an array element, and the right hand side
+ * starts by reading that same element, that read. The read can then take
+ * the element through the reference which the assignment has already
+ * made, rather than looking it up again
+ */
+template <class Ast>
+typename CommonSubexpressions<Ast>::ExpressionRef CommonSubexpressions<Ast>::read_modify_write(BinaryExpression *assign) {
+
+	auto lhs = ast_.template as<ArrayIndexExpression>(assign->lhs);
+	if (!lhs || !ast_.template as<AtomExpression>(lhs->array)) {
+		return ExpressionRef();
+	}
+
+	for (ExpressionRef index_expr : ast_.list(lhs->index)) {
+		if (!pure(index_expr)) {
+			return ExpressionRef();
+		}
+	}
+
+	// NOTE(eteran): follows the operands which are evaluated first
+	ExpressionRef expression = assign->rhs;
+	while (expression) {
+		if (auto arr = ast_.template as<ArrayIndexExpression>(expression)) {
+			if (same(arr->array, lhs->array) && same(arr->index, lhs->index)) {
+				return expression;
+			}
+
+			expression = arr->array;
+		} else if (auto bin = ast_.template as<BinaryExpression>(expression)) {
+			if (bin->op == Token::Assign || bin->op == Token::LogicalAnd || bin->op == Token::LogicalOr) {
+				break;
+			}
+
+			expression = bin->lhs;
+		} else if (auto unary = ast_.template as<UnaryExpression>(expression)) {
+			if (unary->op == Token::Increment || unary->op == Token::Decrement) {
+				break;
+			}
+
+			expression = unary->operand;
+		} else if (auto call = ast_.template as<CallExpression>(expression)) {
+			auto parameters = ast_.list(call->parameters);
+			if (parameters.empty()) {
+				break;
+			}
+
+			expression = *parameters.begin();
+		} else {
+			break;
+		}
+	}
+
+	return ExpressionRef();
+}
+
+/**
+ * @brief CommonSubexpressions::name
+ * @param expression
+ * @return the name of the variable that expression is, or an empty string
+ * if it isn't an atom
+ */
+template <class Ast>
+std::string_view CommonSubexpressions<Ast>::name(ExpressionRef expression) {
+	if (auto atom = ast_.template as<AtomExpression>(expression)) {
+		return ast_.text(atom->value);
+	}
+
+	return std::string_view();
+}
+
+/**
+ * @brief CommonSubexpressions::write
+ * @param expression a variable which is written
+ */
+template <class Ast>
+void CommonSubexpressions<Ast>::write(ExpressionRef expression) {
+	writes_[name(expression)] = ++time_;
+}
+
+/**
+ * @brief CommonSubexpressions::has_lookup
+ * @param statements
+ * @return true if any of the statements indexes an array
+ */
+template <class Ast>
+bool CommonSubexpressions<Ast>::has_lookup(const std::vector<StatementRef> &statements) {
+
+	pending_.clear();
+
+	auto collector = Overloaded{
+		[&](ExpressionStatement *expression_statement) {
+			pending_.push_back(expression_statement->expression);
+		},
+		[&](DeleteStatement *delete_statement) {
+			for (ExpressionRef index_expr : ast_.list(delete_statement->index)) {
+				pending_.push_back(index_expr);
+			}
+		},
+		[](auto) {},
+	};
+
+	for (StatementRef statement : statements) {
+		ast_.visit(statement, collector);
+	}
+
+	while (!pending_.empty()) {
+		const ExpressionRef ref = pending_.back();
+		pending_.pop_back();
+
+		if (!ref) {
+			continue;
+		}
+
+		auto checker = Overloaded{
+			[&](BinaryExpression *bin) {
+				pending_.push_back(bin->lhs);
+				pending_.push_back(bin->rhs);
+				return false;
+			},
+			[&](UnaryExpression *unary) {
+				pending_.push_back(unary->operand);
+				return false;
+			},
+			[&](CallExpression *call) {
+				for (ExpressionRef parameter : ast_.list(call->parameters)) {
+					pending_.push_back(parameter);
+				}
+
+				return false;
+			},
+			[](ArrayIndexExpression *) {
+				return true;
+			},
+			[](AtomExpression *) {
+				return false;
+			},
+		};
+
+		if (ast_.visit(ref, checker)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * @brief CommonSubexpressions::pure
+ * @param expression
+ * @return true if evaluating the expression has no side effect
+ */
+template <class Ast>
+bool CommonSubexpressions<Ast>::pure(ExpressionRef expression) {
+
+	pending_.clear();
+	pending_.push_back(expression);
+
+	while (!pending_.empty()) {
+		const ExpressionRef ref = pending_.back();
+		pending_.pop_back();
+
+		auto checker = Overloaded{
+			[&](BinaryExpression *bin) {
+				pending_.push_back(bin->lhs);
+				pending_.push_back(bin->rhs);
+				return bin->op != Token::Assign;
+			},
+			[&](UnaryExpression *unary) {
+				pending_.push_back(unary->operand);
+				return unary->op != Token::Increment && unary->op != Token::Decrement;
+			},
+			[&](CallExpression *call) {
+				for (ExpressionRef parameter : ast_.list(call->parameters)) {
+					pending_.push_back(parameter);
+				}
+
+				return is_pure_builtin(name(call->function));
+			},
+			[&](ArrayIndexExpression *arr) {
+				pending_.push_back(arr->array);
+				for (ExpressionRef index_expr : ast_.list(arr->index)) {
+					pending_.push_back(index_expr);
+				}
+
+				return true;
+			},
+			[](AtomExpression *) {
+				return true;
+			},
+		};
+
+		if (!ast_.visit(ref, checker)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * @brief CommonSubexpressions::same
+ * @param a
+ * @param b
+ * @return true if the two lists of expressions are the same
+ */
+template <class Ast>
+template <class List>
+bool CommonSubexpressions<Ast>::same(const List &a, const List &b) {
+	const auto &first = ast_.list(a);
+	const auto &other = ast_.list(b);
+	if (first.size() != other.size()) {
+		return false;
+	}
+
+	auto it = other.begin();
+	for (ExpressionRef expression : first) {
+		if (!same(expression, *it++)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * @brief CommonSubexpressions::same
+ * @param a
+ * @param b
+ * @return true if the two expressions are written the same way
+ */
+template <class Ast>
+bool CommonSubexpressions<Ast>::same(ExpressionRef a, ExpressionRef b) {
+
+	pairs_.clear();
+	pairs_.emplace_back(a, b);
+
+	auto both = [this](const auto &x, const auto &y) {
+		const auto &first = ast_.list(x);
+		const auto &other = ast_.list(y);
+		if (first.size() != other.size()) {
+			return false;
+		}
+
+		auto it = other.begin();
+		for (ExpressionRef expression : first) {
+			pairs_.emplace_back(expression, *it++);
+		}
+
+		return true;
+	};
+
+	while (!pairs_.empty()) {
+		const auto [x, y] = pairs_.back();
+		pairs_.pop_back();
+
+		if (!x || !y) {
+			if (x || y) {
+				return false;
+			}
+
+			continue;
+		}
+
+		auto comparer = Overloaded{
+			[&](BinaryExpression *bin) {
+				auto other = ast_.template as<BinaryExpression>(y);
+				if (!other || other->op != bin->op) {
+					return false;
+				}
+
+				pairs_.emplace_back(bin->lhs, other->lhs);
+				pairs_.emplace_back(bin->rhs, other->rhs);
+				return true;
+			},
+			[&](UnaryExpression *unary) {
+				auto other = ast_.template as<UnaryExpression>(y);
+				if (!other || other->op != unary->op || other->prefix != unary->prefix) {
+					return false;
+				}
+
+				pairs_.emplace_back(unary->operand, other->operand);
+				return true;
+			},
+			[&](AtomExpression *atom) {
+				auto other = ast_.template as<AtomExpression>(y);
+				return other && other->type == atom->type && ast_.text(other->value) == ast_.text(atom->value);
+			},
+			[&](CallExpression *call) {
+				auto other = ast_.template as<CallExpression>(y);
+				if (!other) {
+					return false;
+				}
+
+				pairs_.emplace_back(call->function, other->function);
+				return both(call->parameters, other->parameters);
+			},
+			[&](ArrayIndexExpression *arr) {
+				auto other = ast_.template as<ArrayIndexExpression>(y);
+				if (!other) {
+					return false;
+				}
+
+				pairs_.emplace_back(arr->array, other->array);
+				return both(arr->index, other->index);
+			},
+		};
+
+		if (!ast_.visit(x, comparer)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * @brief CommonSubexpressions::walk
+ * @param expression the expression of a statement
+ *
+ * Walks the expression in the order that it is evaluated using an
+ * explicit stack, working out bottom up what is known of each node. Each
+ * node that may be read back is looked for among those evaluated before,
+ * and if it is one of them, whatever was found within it is undone
+ */
+template <class Ast>
+void CommonSubexpressions<Ast>::walk(ExpressionRef expression) {
+
+	if (!expression) {
+		return;
+	}
+
+	tasks_.clear();
+	results_.clear();
+	conditional_ = 0;
+	tasks_.push_back(Task{Task::Visit, false, expression, 0, 0});
+
+	while (!tasks_.empty()) {
+		const Task task = tasks_.back();
+		tasks_.pop_back();
+
+		switch (task.step) {
+		case Task::Visit:
+			break;
+		case Task::Finish:
+			finish(task);
+			continue;
+		case Task::Enter:
+			++conditional_;
+			continue;
+		case Task::Leave:
+			--conditional_;
+			continue;
+		}
+
+		if (task.expression == rmw_ || (!hoisted_->empty() && hoisted_->count(node_key(ast_, task.expression)) != 0)) {
+			results_.push_back(Result{0, 1, 0, false});
+			continue;
+		}
+
+		// NOTE(eteran): tasks are pushed in the order that they should
+		// run, and then reversed to suit the stack
+		const size_t first   = tasks_.size();
+		const size_t results = results_.size();
+
+		auto walker = Overloaded{
+			[&](BinaryExpression *bin) {
+				switch (bin->op) {
+				case Token::Assign:
+					if (auto array_index = ast_.template as<ArrayIndexExpression>(bin->lhs)) {
+						for (ExpressionRef index_expr : ast_.list(array_index->index)) {
+							schedule(Task::Visit, index_expr, true);
+						}
+
+						rmw_ = read_modify_write(bin);
+					}
+
+					schedule(Task::Visit, bin->rhs);
+					break;
+				case Token::LogicalAnd:
+				case Token::LogicalOr:
+					schedule(Task::Visit, bin->lhs);
+					schedule(Task::Enter, bin->rhs);
+					schedule(Task::Visit, bin->rhs);
+					schedule(Task::Leave, bin->rhs);
+					break;
+				default:
+					schedule(Task::Visit, bin->lhs);
+					schedule(Task::Visit, bin->rhs);
+					break;
+				}
+			},
+			[&](UnaryExpression *unary) {
+				if (unary->op != Token::Increment && unary->op != Token::Decrement) {
+					schedule(Task::Visit, unary->operand);
+				}
+			},
+			[&](CallExpression *call) {
+				for (ExpressionRef parameter : ast_.list(call->parameters)) {
+					schedule(Task::Visit, parameter);
+				}
+			},
+			[&](ArrayIndexExpression *arr) {
+				schedule(Task::Visit, arr->array);
+				for (ExpressionRef index_expr : ast_.list(arr->index)) {
+					schedule(Task::Visit, index_expr, true);
+				}
+			},
+			[&](AtomExpression *atom) {
+				results_.push_back(read(atom));
+			},
+		};
+
+		ast_.visit(task.expression, walker);
+
+		if (!ast_.template as<AtomExpression>(task.expression)) {
+			tasks_.push_back(Task{Task::Finish, task.index, task.expression, results, log_.size()});
+		}
+
+		std::reverse(tasks_.begin() + static_cast<ptrdiff_t>(first), tasks_.end());
+	}
+}
+
+/**
+ * @brief CommonSubexpressions::read
+ * @param atom
+ * @return the result of an atom
+ */
+template <class Ast>
+typename CommonSubexpressions<Ast>::Result CommonSubexpressions<Ast>::read(AtomExpression *atom) {
+
+	Result result{0, 1, 0, true};
+	std::string_view text = ast_.text(atom->value);
+
+	if (atom->type == Token::Identifier || atom->type == Token::ArrayIdentifier) {
+		auto it = writes_.find(text);
+		if (it != writes_.end()) {
+			result.written = it->second;
+		}
+
+		if (changed_by_calls(text)) {
+			result.written = std::max(result.written, last_call_);
+		}
+	}
+
+	key_.clear();
+	append(static_cast<size_t>(Expression::Kind::Atom));
+	append(atom->type);
+	key_.append(text);
+	result.id = intern();
+	return result;
+}
+
+/**
+ * @brief CommonSubexpressions::finish
+ * @param task the Finish step of an expression
+ *
+ * Works out the result of the expression from those of its operands. An
+ * expression is identified by its kind, what it applies, and the ids of
+ * its operands, so finding out if it is one evaluated before never looks
+ * into it again, and the walk as a whole stays linear in its size
+ */
+template <class Ast>
+void CommonSubexpressions<Ast>::finish(const Task &task) {
+
+	Result result{0, 1, 0, true};
+	bool candidate = false;
+
+	key_.clear();
+	append(static_cast<size_t>(ast_.visit(task.expression, [](auto node) { return node->StaticKind; })));
+	append(results_.size() - task.results);
+
+	for (auto it = results_.begin() + static_cast<ptrdiff_t>(task.results); it != results_.end(); ++it) {
+		append(it->id);
+		result.size += it->size;
+		result.written = std::max(result.written, it->written);
+		result.pure    = result.pure && it->pure;
+	}
+
+	auto finisher = Overloaded{
+		[&](BinaryExpression *bin) {
+			append(bin->op);
+			if (bin->op == Token::Assign) {
+				auto array_index = ast_.template as<ArrayIndexExpression>(bin->lhs);
+				write(array_index ? array_index->array : bin->lhs);
+				result.pure = false;
+			}
+
+			candidate = task.index;
+		},
+		[&](UnaryExpression *unary) {
+			append(unary->op);
+			append(unary->prefix);
+			if (unary->op == Token::Increment || unary->op == Token::Decrement) {
+				write(unary->operand);
+				result.pure = false;
+			}
+
+			candidate = task.index;
+		},
+		[&](CallExpression *call) {
+			key_.append(name(call->function));
+			if (!is_pure_builtin(name(call->function))) {
+				last_call_  = ++time_;
+				result.pure = false;
+			}
+		},
+		[&](ArrayIndexExpression *) {
+			candidate = true;
+		},
+		[](AtomExpression *) {},
+	};
+
+	ast_.visit(task.expression, finisher);
+
+	// NOTE(eteran): an impure expression is never read back, and neither
+	// is anything which contains it, so it needs no id
+	if (result.pure) {
+		result.id = intern();
+	}
+
+	results_.resize(task.results);
+	results_.push_back(result);
+
+	if (!candidate || !result.pure) {
+		return;
+	}
+
+	auto it = index_.find(result.id);
+	if (it != index_.end()) {
+		Entry &entry = entries_[it->second];
+		if (result.written <= entry.time) {
+			undo(task.log);
+			++entry.uses;
+			uses_.emplace_back(task.expression, it->second);
+			log_.push_back(Log{it->second, true});
+			return;
+		}
+	}
+
+	if (conditional_ == 0) {
+		const bool lookup = ast_.template as<ArrayIndexExpression>(task.expression) != nullptr;
+		index_[result.id] = entries_.size();
+		log_.push_back(Log{entries_.size(), false});
+		entries_.push_back(Entry{task.expression, result.id, result.size, time_, 0, lookup, NoTemporary});
+	}
+}
+
+/**
+ * @brief CommonSubexpressions::append
+ * @param value a part of the key of the expression being finished
+ */
+template <class Ast>
+void CommonSubexpressions<Ast>::append(size_t value) {
+	key_.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+/**
+ * @brief CommonSubexpressions::intern
+ * @return the id of the expression whose key has been built, which is a
+ * new one if no expression before it had the same key
+ */
+template <class Ast>
+size_t CommonSubexpressions<Ast>::intern() {
+	return ids_.try_emplace(key_, ids_.size() + 1).first->second;
+}
+
+/**
+ * @brief CommonSubexpressions::undo
+ * @param size how long the log was when the walk got to the expression
+ * which is to be read back
+ */
+template <class Ast>
+void CommonSubexpressions<Ast>::undo(size_t size) {
+	while (log_.size() > size) {
+		const Log log = log_.back();
+		log_.pop_back();
+
+		Entry &entry = entries_[log.entry];
+		if (log.use) {
+			--entry.uses;
+			uses_.pop_back();
+		} else {
+			auto it = index_.find(entry.id);
+			if (it != index_.end() && it->second == log.entry) {
+				index_.erase(it);
+			}
+
+			entry.uses = 0;
+		}
+	}
+}
+
+/**
+ * @brief CommonSubexpressions::schedule
+ * @param step
+ * @param expression
+ * @param index true if expression is an array index
+ */
+template <class Ast>
+void CommonSubexpressions<Ast>::schedule(typename Task::Step step, ExpressionRef expression, bool index) {
+	tasks_.push_back(Task{step, index, expression, 0, 0});
+}
+
+template class CommonSubexpressions<PointerAst>;
+template class CommonSubexpressions<FlatAst>;
@@ -0,0 +1,157 @@
+
+#ifndef COMMON_SUBEXPRESSIONS_H_
+#define COMMON_SUBEXPRESSIONS_H_
+
+#include "Analysis.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Finds the array lookups, and the computations of array indexes,
+ * which a run of straight-line statements makes more than once with nothing
+ * in between which could change their value. The first of them is kept in a
+ * variable, and the rest read it back. The first must be one which is always
+ * evaluated, those after it may be anywhere. Nothing with a side effect is
+ * taken, as it would then happen fewer times
+ */
+template <class Ast>
+class CommonSubexpressions {
+private:
+	using ExpressionRef = typename Ast::ExpressionRef;
+	using StatementRef  = typename Ast::StatementRef;
+
+	using BinaryExpression     = typename Ast::BinaryExpression;
+	using UnaryExpression      = typename Ast::UnaryExpression;
+	using AtomExpression       = typename Ast::AtomExpression;
+	using CallExpression       = typename Ast::CallExpression;
+	using ArrayIndexExpression = typename Ast::ArrayIndexExpression;
+
+	using DeleteStatement     = typename Ast::DeleteStatement;
+	using ExpressionStatement = typename Ast::ExpressionStatement;
+
+	/**
+	 * @brief a pending step of walking an expression
+	 */
+	struct Task {
+		enum Step : uint8_t {
+			Visit,  // an expression
+			Finish, // the operands of an expression are done
+			Enter,  // what follows is only evaluated some of the time
+			Leave,  // the end of what Enter started
+		};
+
+		Step step;
+		bool index; // the expression is an array index
+		ExpressionRef expression;
+		size_t results; // for Finish, where the results of the operands start
+		size_t log;     // for Finish, how long the log was before the expression
+	};
+
+	/**
+	 * @brief what is known of an expression once it has been walked
+	 */
+	struct Result {
+		size_t id;      // the same for expressions written the same way, see intern
+		size_t size;    // how many instructions it takes
+		size_t written; // when what it reads was last changed
+		bool pure;      // true if it may be evaluated fewer times than it is
+	};
+
+	/**
+	 * @brief an expression which later ones may read back
+	 */
+	struct Entry {
+		ExpressionRef expression;
+		size_t id;
+		size_t size;
+		size_t time; // when it was evaluated
+		size_t uses;
+		bool lookup;      // it is an array lookup, rather than an index
+		size_t temporary; // where its value is kept, if it is
+	};
+
+	/**
+	 * @brief something which the walk did, and which is undone if it turns
+	 * out to be within an expression which is read back
+	 */
+	struct Log {
+		size_t entry;
+		bool use; // if false, the entry was added
+	};
+
+public:
+	/**
+	 * @brief what to do with an expression when generating it
+	 */
+	struct Mark {
+		bool keep; // if true, keep its value, otherwise read back the kept value
+		size_t temporary;
+	};
+
+	static constexpr size_t NoTemporary = SIZE_MAX;
+
+public:
+	explicit CommonSubexpressions(Ast &ast) noexcept
+		: ast_(ast) {
+	}
+
+public:
+	void find(const std::vector<StatementRef> &statements, const Hoisted &hoisted);
+	const Mark *mark(ExpressionRef expression);
+	void clear();
+	ExpressionRef read_modify_write(BinaryExpression *assign);
+
+private:
+	std::string_view name(ExpressionRef expression);
+	void write(ExpressionRef expression);
+	bool has_lookup(const std::vector<StatementRef> &statements);
+	bool pure(ExpressionRef expression);
+	template <class List>
+	bool same(const List &a, const List &b);
+	bool same(ExpressionRef a, ExpressionRef b);
+	void walk(ExpressionRef expression);
+	Result read(AtomExpression *atom);
+	void finish(const Task &task);
+	void append(size_t value);
+	size_t intern();
+	void undo(size_t size);
+	void schedule(typename Task::Step step, ExpressionRef expression, bool index = false);
+
+private:
+	Ast &ast_;
+	const Hoisted *hoisted_ = nullptr;
+	std::vector<Task> tasks_;
+	std::vector<Result> results_;
+	std::vector<ExpressionRef> pending_;
+	std::vector<std::pair<ExpressionRef, ExpressionRef>> pairs_;
+
+	std::vector<Entry> entries_;
+	std::vector<std::pair<ExpressionRef, size_t>> uses_;
+	std::vector<Log> log_;
+
+	// NOTE(eteran): the ids given to the expressions of the run, by key (see
+	// finish), and the entries which may be read back, by id. An entry which
+	// is no longer valid is replaced by the next one like it
+	std::unordered_map<std::string, size_t> ids_;
+	std::string key_;
+	std::unordered_map<size_t, size_t> index_;
+	std::unordered_map<const void *, Mark> marks_;
+
+	// NOTE(eteran): the walk counts time in writes, and notes when each
+	// variable was last written, an entry is valid for as long as nothing
+	// that it reads has been written since it was evaluated
+	std::unordered_map<std::string_view, size_t> writes_;
+	size_t time_      = 0;
+	size_t last_call_ = 0;
+
+	ExpressionRef rmw_;
+	size_t conditional_ = 0;
+	size_t temporaries_ = 0;
+};
+
+#endif
@@ -0,0 +1,19 @@
+
+#ifndef COMPILATION_UNIT_H_
+#define COMPILATION_UNIT_H_
+
+#include "Arena.h"
+
+class Statement;
+
+/**
+ * @brief Everything produced by parsing a single input. All of the AST nodes
+ * live in the unit's arena, so the whole tree is released in one step when
+ * the unit is destroyed (or reset, if it is reused for another input).
+ */
+struct CompilationUnit {
+	Arena arena;
+	NodeList<Statement> statements;
+};
+
+#endif
@@ -0,0 +1,70 @@
+
+#ifndef DFA_H_
+#define DFA_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * @brief A table driven deterministic finite automaton over bytes.
+ * The tables are intended to be built at compile time (see the constexpr
+ * helpers below) so that matching a token is nothing more than a series of
+ * table lookups, with no backtracking and no allocation.
+ */
+template <size_t States>
+struct Dfa {
+	static_assert(States < 0xff, "state 0xff is reserved for the dead state");
+
+	static constexpr uint8_t Start = 0;
+	static constexpr uint8_t Dead  = 0xff;
+
+	constexpr Dfa() noexcept {
+		for (auto &row : next) {
+			for (auto &state : row) {
+				state = Dead;
+			}
+		}
+	}
+
+	/**
+	 * @brief adds a transition from state "from" to state "to" for every byte
+	 * for which "pred" returns true
+	 */
+	template <class Pred>
+	constexpr void transition(uint8_t from, uint8_t to, Pred pred) noexcept {
+		for (size_t ch = 0; ch < 256; ++ch) {
+			if (pred(static_cast<char>(ch))) {
+				next[from][ch] = to;
+			}
+		}
+	}
+
+	/**
+	 * @brief returns the length of the longest prefix of "input" which is
+	 * accepted by the automaton, 0 if there is no such prefix
+	 */
+	size_t longest_match(std::string_view input) const noexcept {
+		size_t length = 0;
+		uint8_t state = Start;
+
+		for (size_t i = 0; i < input.size(); ++i) {
+			state = next[state][static_cast<uint8_t>(input[i])];
+			if (state == Dead) {
+				break;
+			}
+
+			if (accept[state]) {
+				length = i + 1;
+			}
+		}
+
+		return length;
+	}
+
+	std::array<std::array<uint8_t, 256>, States> next = {};
+	std::array<bool, States> accept                   = {};
+};
+
+#endif
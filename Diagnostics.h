@@ -0,0 +1,68 @@
+
+#ifndef DIAGNOSTICS_H_
+#define DIAGNOSTICS_H_
+
+#include "Error.h"
+#include "Token.h"
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+/**
+ * @brief one error found in the input
+ */
+struct Diagnostic {
+	const char *what = nullptr; // the name of the error, as its what() gives it
+	size_t index     = 0;
+	bool syntax      = false; // if true, token is where the syntax error was found
+	Token token;
+};
+
+/**
+ * @brief Collects the errors found while parsing an input, in the order they
+ * appear in it, so that the parser can carry on past an error and they can
+ * all be reported at once (see Parser::parseStatements)
+ */
+class Diagnostics {
+public:
+	void report(const SyntaxError &error) {
+		add(Diagnostic{error.what(), error.index(), true, error.token()});
+	}
+
+	void report(const TokenizationError &error) {
+		add(Diagnostic{error.what(), error.index(), false, Token()});
+	}
+
+	void append(const Diagnostics &other) {
+		for (const Diagnostic &diagnostic : other.diagnostics_) {
+			add(diagnostic);
+		}
+	}
+
+	void clear() noexcept { diagnostics_.clear(); }
+
+public:
+	bool empty() const noexcept { return diagnostics_.empty(); }
+	size_t size() const noexcept { return diagnostics_.size(); }
+	std::vector<Diagnostic>::const_iterator begin() const noexcept { return diagnostics_.begin(); }
+	std::vector<Diagnostic>::const_iterator end() const noexcept { return diagnostics_.end(); }
+
+private:
+	void add(const Diagnostic &diagnostic) {
+		// NOTE(eteran): running out of input inside of nested blocks is found
+		// again by each of them, it is only worth reporting once
+		if (!diagnostics_.empty()) {
+			const Diagnostic &last = diagnostics_.back();
+			if (last.index == diagnostic.index && std::strcmp(last.what, diagnostic.what) == 0) {
+				return;
+			}
+		}
+
+		diagnostics_.push_back(diagnostic);
+	}
+
+private:
+	std::vector<Diagnostic> diagnostics_;
+};
+
+#endif
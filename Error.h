@@ -33,6 +33,30 @@ private:
 	const std::string filename_;
 };
 
+class FileReadError : public Error {
+public:
+	FileReadError(const std::string &filename, const std::string &reason)
+		: filename_(filename), reason_(reason) {
+	}
+
+public:
+	const char *what() const noexcept override {
+		return "FileReadError";
+	}
+
+	const std::string &filename() const {
+		return filename_;
+	}
+
+	const std::string &reason() const {
+		return reason_;
+	}
+
+private:
+	const std::string filename_;
+	const std::string reason_;
+};
+
 class SyntaxError : public Error {
 public:
 	explicit SyntaxError(const Token &token)
@@ -46,7 +70,7 @@ public:
 
 public:
 	size_t index() const {
-		return token_.index;
+		return token_.index();
 	}
 
 	const Token &token() const {
@@ -2,39 +2,85 @@
 #ifndef EXPRESSION_H_
 #define EXPRESSION_H_
 
+#include "Arena.h"
 #include "Token.h"
-#include <memory>
-#include <vector>
+#include <cstdint>
+#include <string_view>
 
+// NOTE(eteran): expressions are allocated in an Arena and are never destroyed,
+// so they must not own any memory of their own. Each one carries a tag saying
+// which kind of expression it is, see Visitor.h for how to dispatch on it
 struct Expression {
-	virtual ~Expression() = default;
+	enum class Kind : uint8_t {
+		Binary,
+		Unary,
+		Atom,
+		Call,
+		ArrayIndex,
+	};
+
+	explicit Expression(Kind kind) noexcept
+		: kind(kind) {
+	}
+
+	const Kind kind;
 };
 
 struct BinaryExpression : public Expression {
-	std::unique_ptr<Expression> lhs;
-	std::unique_ptr<Expression> rhs;
-	Token::Type op;
+	static constexpr Kind StaticKind = Kind::Binary;
+
+	BinaryExpression() noexcept
+		: Expression(StaticKind) {
+	}
+
+	Expression *lhs = nullptr;
+	Expression *rhs = nullptr;
+	Token::Type op  = Token::Invalid;
 };
 
 struct UnaryExpression : public Expression {
-	std::unique_ptr<Expression> operand;
-	Token::Type op;
-	bool prefix;
+	static constexpr Kind StaticKind = Kind::Unary;
+
+	UnaryExpression() noexcept
+		: Expression(StaticKind) {
+	}
+
+	Expression *operand = nullptr;
+	Token::Type op      = Token::Invalid;
+	bool prefix         = false;
 };
 
 struct AtomExpression : public Expression {
-	std::string value;
-	Token::Type type;
+	static constexpr Kind StaticKind = Kind::Atom;
+
+	AtomExpression() noexcept
+		: Expression(StaticKind) {
+	}
+
+	std::string_view value;
+	Token::Type type = Token::Invalid;
 };
 
 struct CallExpression : public Expression {
-	std::unique_ptr<Expression> function;
-	std::vector<std::unique_ptr<Expression>> parameters;
+	static constexpr Kind StaticKind = Kind::Call;
+
+	CallExpression() noexcept
+		: Expression(StaticKind) {
+	}
+
+	Expression *function = nullptr;
+	NodeList<Expression> parameters;
 };
 
 struct ArrayIndexExpression : public Expression {
-	std::unique_ptr<Expression> array;
-	std::vector<std::unique_ptr<Expression>> index;
+	static constexpr Kind StaticKind = Kind::ArrayIndex;
+
+	ArrayIndexExpression() noexcept
+		: Expression(StaticKind) {
+	}
+
+	Expression *array = nullptr;
+	NodeList<Expression> index;
 };
 
 #endif
@@ -0,0 +1,249 @@
+
+#include "FlatAst.h"
+#include "Visitor.h"
+
+/**
+ * @brief FlatAst::FlatAst
+ * @param statements the pointer based AST to flatten
+ */
+FlatAst::FlatAst(const NodeList<Statement> &statements) {
+	statements_ = add_statements(statements);
+}
+
+/**
+ * @brief FlatAst::make_atom
+ * @param value
+ * @param type
+ * @return a reference to a new atom
+ */
+FlatAst::ExpressionRef FlatAst::make_atom(std::string_view value, Token::Type type) {
+	const TextRange text = add_text(value);
+	return ExpressionRef(Expression::Kind::Atom, add(atom_, AtomExpression{text, type}));
+}
+
+/**
+ * @brief FlatAst::add_text
+ * @param text
+ * @return
+ */
+FlatAst::TextRange FlatAst::add_text(std::string_view text) {
+	const auto first = static_cast<Index>(text_.size());
+	text_.append(text);
+	return TextRange{first, static_cast<Index>(text.size())};
+}
+
+/**
+ * @brief FlatAst::add_expressions
+ * @param expressions
+ * @return
+ */
+FlatAst::ExpressionRange FlatAst::add_expressions(const NodeList<Expression> &expressions) {
+
+	// NOTE(eteran): the children may have lists of their own, so flatten them
+	// all before reserving our range, to keep it contiguous
+	std::vector<ExpressionRef> refs;
+	refs.reserve(expressions.size());
+
+	for (const Expression *expression : expressions) {
+		refs.push_back(add_expression(expression));
+	}
+
+	return add_expressions(refs.data(), refs.size());
+}
+
+/**
+ * @brief FlatAst::add_expressions
+ * @param refs
+ * @param size
+ * @return a range holding a copy of the size references starting at refs
+ */
+FlatAst::ExpressionRange FlatAst::add_expressions(const ExpressionRef *refs, size_t size) {
+	const auto first = static_cast<Index>(expression_list_.size());
+	expression_list_.insert(expression_list_.end(), refs, refs + size);
+	return ExpressionRange{first, static_cast<Index>(size)};
+}
+
+/**
+ * @brief FlatAst::add_statements
+ * @param statements
+ * @return
+ */
+FlatAst::StatementRange FlatAst::add_statements(const NodeList<Statement> &statements) {
+
+	std::vector<StatementRef> refs;
+	refs.reserve(statements.size());
+
+	for (const Statement *statement : statements) {
+		refs.push_back(add_statement(statement));
+	}
+
+	const auto first = static_cast<Index>(statement_list_.size());
+	statement_list_.insert(statement_list_.end(), refs.begin(), refs.end());
+	return StatementRange{first, static_cast<Index>(refs.size())};
+}
+
+/**
+ * @brief FlatAst::add_expression
+ * @param expression
+ * @return
+ *
+ * Flattens the expression in post-order using an explicit stack rather than
+ * recursion, so that no matter how deeply it is nested, the native stack
+ * doesn't grow. The references to the operands of a node are left on a stack
+ * of their own, in order, until the node itself is added.
+ */
+FlatAst::ExpressionRef FlatAst::add_expression(const Expression *expression) {
+
+	struct Task {
+		const Expression *node;
+		bool operands_added;
+	};
+
+	std::vector<Task> tasks;
+	std::vector<ExpressionRef> refs;
+
+	auto pop = [&refs]() {
+		const ExpressionRef ref = refs.back();
+		refs.pop_back();
+		return ref;
+	};
+
+	auto pop_list = [this, &refs](size_t size) {
+		const ExpressionRange range = add_expressions(refs.data() + refs.size() - size, size);
+		refs.resize(refs.size() - size);
+		return range;
+	};
+
+	auto push_operands = [&tasks](const NodeList<Expression> &operands) {
+		for (size_t i = operands.size(); i != 0; --i) {
+			tasks.push_back(Task{operands[i - 1], false});
+		}
+	};
+
+	auto schedule = Overloaded{
+		[&](const ::BinaryExpression *binary) {
+			tasks.push_back(Task{binary->rhs, false});
+			tasks.push_back(Task{binary->lhs, false});
+		},
+		[&](const ::UnaryExpression *unary) {
+			tasks.push_back(Task{unary->operand, false});
+		},
+		[](const ::AtomExpression *) {},
+		[&](const ::CallExpression *call) {
+			push_operands(call->parameters);
+			tasks.push_back(Task{call->function, false});
+		},
+		[&](const ::ArrayIndexExpression *array_index) {
+			push_operands(array_index->index);
+			tasks.push_back(Task{array_index->array, false});
+		},
+	};
+
+	auto flatten = Overloaded{
+		[&](const ::BinaryExpression *binary) {
+			const ExpressionRef rhs = pop();
+			const ExpressionRef lhs = pop();
+			return add(binary_, BinaryExpression{lhs, rhs, binary->op});
+		},
+		[&](const ::UnaryExpression *unary) {
+			const ExpressionRef operand = pop();
+			return add(unary_, UnaryExpression{operand, unary->op, unary->prefix});
+		},
+		[&](const ::AtomExpression *atom) {
+			const TextRange value = add_text(atom->value);
+			return add(atom_, AtomExpression{value, atom->type});
+		},
+		[&](const ::CallExpression *call) {
+			const ExpressionRange parameters = pop_list(call->parameters.size());
+			const ExpressionRef function     = pop();
+			return add(call_, CallExpression{function, parameters});
+		},
+		[&](const ::ArrayIndexExpression *array_index) {
+			const ExpressionRange index = pop_list(array_index->index.size());
+			const ExpressionRef array   = pop();
+			return add(array_index_, ArrayIndexExpression{array, index});
+		},
+	};
+
+	tasks.push_back(Task{expression, false});
+
+	while (!tasks.empty()) {
+		const Task task = tasks.back();
+		tasks.pop_back();
+
+		if (!task.node) {
+			refs.push_back(ExpressionRef());
+		} else if (!task.operands_added) {
+			tasks.push_back(Task{task.node, true});
+			::visit(task.node, schedule);
+		} else {
+			refs.push_back(ExpressionRef(task.node->kind, ::visit(task.node, flatten)));
+		}
+	}
+
+	return refs.back();
+}
+
+/**
+ * @brief FlatAst::add_statement
+ * @param statement
+ * @return
+ */
+FlatAst::StatementRef FlatAst::add_statement(const Statement *statement) {
+
+	if (!statement) {
+		return StatementRef();
+	}
+
+	auto flatten = Overloaded{
+		[this](const ::DeleteStatement *delete_statement) {
+			const ExpressionRef expression = add_expression(delete_statement->expression);
+			const ExpressionRange index    = add_expressions(delete_statement->index);
+			return add(delete_, DeleteStatement{expression, index});
+		},
+		[this](const ::FunctionStatement *function) {
+			const TextRange name            = add_text(function->name);
+			const StatementRange statements = add_statements(function->statements);
+			return add(function_, FunctionStatement{name, statements});
+		},
+		[this](const ::BlockStatement *block) {
+			const StatementRange statements = add_statements(block->statements);
+			return add(block_, BlockStatement{statements});
+		},
+		[this](const ::CondStatement *cond) {
+			const ExpressionRef condition = add_expression(cond->cond);
+			const StatementRef body       = add_statement(cond->body);
+			const StatementRef else_      = add_statement(cond->else_);
+			return add(cond_, CondStatement{condition, body, else_});
+		},
+		[this](const ::LoopStatement *loop) {
+			const ExpressionRange init = add_expressions(loop->init);
+			const ExpressionRef cond   = add_expression(loop->cond);
+			const ExpressionRange incr = add_expressions(loop->incr);
+			const StatementRef body    = add_statement(loop->body);
+			return add(loop_, LoopStatement{init, cond, incr, body});
+		},
+		[this](const ::ForEachStatement *foreach) {
+			const ExpressionRef iterator  = add_expression(foreach->iterator);
+			const ExpressionRef container = add_expression(foreach->container);
+			const StatementRef body       = add_statement(foreach->body);
+			return add(foreach_, ForEachStatement{iterator, container, body});
+		},
+		[](const ::BreakStatement *) {
+			return Index(0);
+		},
+		[](const ::ContinueStatement *) {
+			return Index(0);
+		},
+		[this](const ::ExpressionStatement *expression_statement) {
+			const ExpressionRef expression = add_expression(expression_statement->expression);
+			return add(expression_, ExpressionStatement{expression});
+		},
+		[this](const ::ReturnStatement *return_statement) {
+			const ExpressionRef expression = add_expression(return_statement->expression);
+			return add(return_, ReturnStatement{expression});
+		},
+	};
+
+	return StatementRef(statement->kind, ::visit(statement, flatten));
+}
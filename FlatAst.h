@@ -0,0 +1,352 @@
+
+#ifndef FLAT_AST_H_
+#define FLAT_AST_H_
+
+#include "Arena.h"
+#include "Expression.h"
+#include "Statement.h"
+#include "Token.h"
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief An alternative, flat, form of the AST. Every kind of node lives in a
+ * contiguous pool of its own, nodes refer to their children by 32-bit
+ * references, and lists of children (and the text of atoms) are ranges in
+ * shared side arrays. The field names match those of the pointer based
+ * nodes, so that passes can be written once for both forms (see PointerAst)
+ */
+class FlatAst {
+public:
+	using Index = uint32_t;
+
+	/**
+	 * @brief a reference to a node, the kind of node is kept in the top bits
+	 * and its index in the pool for that kind in the rest
+	 */
+	template <class Kind>
+	class Ref {
+	public:
+		static constexpr unsigned IndexBits = 28;
+		static constexpr uint32_t IndexMask = (1u << IndexBits) - 1;
+		static constexpr uint32_t Null      = UINT32_MAX;
+
+	public:
+		Ref() = default;
+		Ref(Kind kind, Index index) noexcept
+			: value_((static_cast<uint32_t>(kind) << IndexBits) | index) {
+		}
+
+	public:
+		Kind kind() const noexcept { return static_cast<Kind>(value_ >> IndexBits); }
+		Index index() const noexcept { return value_ & IndexMask; }
+		explicit operator bool() const noexcept { return value_ != Null; }
+		bool operator==(Ref other) const noexcept { return value_ == other.value_; }
+		bool operator!=(Ref other) const noexcept { return value_ != other.value_; }
+
+	private:
+		uint32_t value_ = Null;
+	};
+
+	using ExpressionRef = Ref<Expression::Kind>;
+	using StatementRef  = Ref<Statement::Kind>;
+
+	/**
+	 * @brief a run of entries in one of the side arrays, T says which one
+	 */
+	template <class T>
+	struct Range {
+		Index first = 0;
+		Index size  = 0;
+	};
+
+	using ExpressionRange = Range<ExpressionRef>;
+	using StatementRange  = Range<StatementRef>;
+	using TextRange       = Range<char>;
+	using ExpressionList  = ExpressionRange;
+	using StatementList   = StatementRange;
+
+	/**
+	 * @brief the entries of a Range, viewed in place
+	 */
+	template <class T>
+	class List {
+	public:
+		List(T *first, Index size) noexcept
+			: first_(first), size_(size) {
+		}
+
+	public:
+		T *begin() const noexcept { return first_; }
+		T *end() const noexcept { return first_ + size_; }
+		size_t size() const noexcept { return size_; }
+		bool empty() const noexcept { return size_ == 0; }
+
+	private:
+		T *first_;
+		Index size_;
+	};
+
+	struct BinaryExpression {
+		static constexpr Expression::Kind StaticKind = Expression::Kind::Binary;
+		ExpressionRef lhs;
+		ExpressionRef rhs;
+		Token::Type op;
+	};
+
+	struct UnaryExpression {
+		static constexpr Expression::Kind StaticKind = Expression::Kind::Unary;
+		ExpressionRef operand;
+		Token::Type op;
+		bool prefix;
+	};
+
+	struct AtomExpression {
+		static constexpr Expression::Kind StaticKind = Expression::Kind::Atom;
+		TextRange value;
+		Token::Type type;
+	};
+
+	struct CallExpression {
+		static constexpr Expression::Kind StaticKind = Expression::Kind::Call;
+		ExpressionRef function;
+		ExpressionRange parameters;
+	};
+
+	struct ArrayIndexExpression {
+		static constexpr Expression::Kind StaticKind = Expression::Kind::ArrayIndex;
+		ExpressionRef array;
+		ExpressionRange index;
+	};
+
+	struct DeleteStatement {
+		static constexpr Statement::Kind StaticKind = Statement::Kind::Delete;
+		ExpressionRef expression;
+		ExpressionRange index;
+	};
+
+	struct FunctionStatement {
+		static constexpr Statement::Kind StaticKind = Statement::Kind::Function;
+		TextRange name;
+		StatementRange statements;
+	};
+
+	struct BlockStatement {
+		static constexpr Statement::Kind StaticKind = Statement::Kind::Block;
+		StatementRange statements;
+	};
+
+	struct CondStatement {
+		static constexpr Statement::Kind StaticKind = Statement::Kind::Cond;
+		ExpressionRef cond;
+		StatementRef body;
+		StatementRef else_;
+	};
+
+	struct LoopStatement {
+		static constexpr Statement::Kind StaticKind = Statement::Kind::Loop;
+		ExpressionRange init;
+		ExpressionRef cond;
+		ExpressionRange incr;
+		StatementRef body;
+	};
+
+	struct ForEachStatement {
+		static constexpr Statement::Kind StaticKind = Statement::Kind::ForEach;
+		ExpressionRef iterator;
+		ExpressionRef container;
+		StatementRef body;
+	};
+
+	struct BreakStatement {
+		static constexpr Statement::Kind StaticKind = Statement::Kind::Break;
+	};
+
+	struct ContinueStatement {
+		static constexpr Statement::Kind StaticKind = Statement::Kind::Continue;
+	};
+
+	struct ExpressionStatement {
+		static constexpr Statement::Kind StaticKind = Statement::Kind::Expression;
+		ExpressionRef expression;
+	};
+
+	struct ReturnStatement {
+		static constexpr Statement::Kind StaticKind = Statement::Kind::Return;
+		ExpressionRef expression;
+	};
+
+public:
+	explicit FlatAst(const NodeList<Statement> &statements);
+
+public:
+	/**
+	 * @brief calls the visitor with a pointer to the node that ref refers to
+	 * @param ref must not be null
+	 */
+	template <class Visitor>
+	decltype(auto) visit(ExpressionRef ref, Visitor &&visitor) {
+		using Kind = Expression::Kind;
+
+		switch (ref.kind()) {
+		case Kind::Binary:
+			return visitor(&binary_[ref.index()]);
+		case Kind::Unary:
+			return visitor(&unary_[ref.index()]);
+		case Kind::Atom:
+			return visitor(&atom_[ref.index()]);
+		case Kind::Call:
+			return visitor(&call_[ref.index()]);
+		case Kind::ArrayIndex:
+			return visitor(&array_index_[ref.index()]);
+		}
+
+		std::abort();
+	}
+
+	/**
+	 * @brief calls the visitor with a pointer to the node that ref refers to
+	 * @param ref must not be null
+	 */
+	template <class Visitor>
+	decltype(auto) visit(StatementRef ref, Visitor &&visitor) {
+		using Kind = Statement::Kind;
+
+		switch (ref.kind()) {
+		case Kind::Delete:
+			return visitor(&delete_[ref.index()]);
+		case Kind::Function:
+			return visitor(&function_[ref.index()]);
+		case Kind::Block:
+			return visitor(&block_[ref.index()]);
+		case Kind::Cond:
+			return visitor(&cond_[ref.index()]);
+		case Kind::Loop:
+			return visitor(&loop_[ref.index()]);
+		case Kind::ForEach:
+			return visitor(&foreach_[ref.index()]);
+		case Kind::Break:
+			return visitor(&break_);
+		case Kind::Continue:
+			return visitor(&continue_);
+		case Kind::Expression:
+			return visitor(&expression_[ref.index()]);
+		case Kind::Return:
+			return visitor(&return_[ref.index()]);
+		}
+
+		std::abort();
+	}
+
+	/**
+	 * @brief the equivalent of node_cast for the flat form
+	 * @return the node that ref refers to as a T, or nullptr if ref is null or
+	 * doesn't refer to a T
+	 */
+	template <class T, class Kind>
+	T *as(Ref<Kind> ref) {
+		if (ref && ref.kind() == T::StaticKind) {
+			return &pool<T>()[ref.index()];
+		}
+
+		return nullptr;
+	}
+
+	List<ExpressionRef> list(ExpressionRange range) noexcept { return List<ExpressionRef>(expression_list_.data() + range.first, range.size); }
+	List<StatementRef> list(StatementRange range) noexcept { return List<StatementRef>(statement_list_.data() + range.first, range.size); }
+	std::string_view text(TextRange range) const noexcept { return std::string_view(text_).substr(range.first, range.size); }
+
+	StatementRange &statements() noexcept { return statements_; }
+
+	/**
+	 * @brief drops all but the first size entries of a range
+	 */
+	template <class T>
+	void truncate(Range<T> &range, size_t size) noexcept {
+		assert(size <= range.size);
+		range.size = static_cast<Index>(size);
+	}
+
+	ExpressionRef make_atom(std::string_view value, Token::Type type);
+
+private:
+	template <class T>
+	std::vector<T> &pool() noexcept {
+		if constexpr (std::is_same_v<T, BinaryExpression>) {
+			return binary_;
+		} else if constexpr (std::is_same_v<T, UnaryExpression>) {
+			return unary_;
+		} else if constexpr (std::is_same_v<T, AtomExpression>) {
+			return atom_;
+		} else if constexpr (std::is_same_v<T, CallExpression>) {
+			return call_;
+		} else if constexpr (std::is_same_v<T, ArrayIndexExpression>) {
+			return array_index_;
+		} else if constexpr (std::is_same_v<T, DeleteStatement>) {
+			return delete_;
+		} else if constexpr (std::is_same_v<T, FunctionStatement>) {
+			return function_;
+		} else if constexpr (std::is_same_v<T, BlockStatement>) {
+			return block_;
+		} else if constexpr (std::is_same_v<T, CondStatement>) {
+			return cond_;
+		} else if constexpr (std::is_same_v<T, LoopStatement>) {
+			return loop_;
+		} else if constexpr (std::is_same_v<T, ForEachStatement>) {
+			return foreach_;
+		} else if constexpr (std::is_same_v<T, ExpressionStatement>) {
+			return expression_;
+		} else {
+			static_assert(std::is_same_v<T, ReturnStatement>);
+			return return_;
+		}
+	}
+
+	template <class T>
+	Index add(std::vector<T> &pool, const T &node) {
+		assert(pool.size() <= ExpressionRef::IndexMask);
+		pool.push_back(node);
+		return static_cast<Index>(pool.size() - 1);
+	}
+
+	ExpressionRef add_expression(const Expression *expression);
+	StatementRef add_statement(const Statement *statement);
+	ExpressionRange add_expressions(const NodeList<Expression> &expressions);
+	ExpressionRange add_expressions(const ExpressionRef *refs, size_t size);
+	StatementRange add_statements(const NodeList<Statement> &statements);
+	TextRange add_text(std::string_view text);
+
+private:
+	std::vector<BinaryExpression> binary_;
+	std::vector<UnaryExpression> unary_;
+	std::vector<AtomExpression> atom_;
+	std::vector<CallExpression> call_;
+	std::vector<ArrayIndexExpression> array_index_;
+
+	std::vector<DeleteStatement> delete_;
+	std::vector<FunctionStatement> function_;
+	std::vector<BlockStatement> block_;
+	std::vector<CondStatement> cond_;
+	std::vector<LoopStatement> loop_;
+	std::vector<ForEachStatement> foreach_;
+	std::vector<ExpressionStatement> expression_;
+	std::vector<ReturnStatement> return_;
+
+	// NOTE(eteran): break and continue have no fields, so they don't need a pool
+	BreakStatement break_;
+	ContinueStatement continue_;
+
+	// the side arrays which ranges refer to
+	std::vector<ExpressionRef> expression_list_;
+	std::vector<StatementRef> statement_list_;
+	std::string text_;
+
+	StatementRange statements_;
+};
+
+#endif
@@ -0,0 +1,62 @@
+
+#ifndef IR_H_
+#define IR_H_
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <variant>
+
+struct Node {
+	int64_t location;
+	std::string instr;
+};
+
+struct BranchNode {
+	int64_t location;
+	std::string instr;
+	int64_t target = LONG_LONG_MAX; // default to blatantly invalid
+};
+
+struct AssignNode {
+	int64_t location;
+	std::string instr;
+	std::string symbol;
+};
+
+struct PushSymbolNode {
+	int64_t location;
+	std::string instr;
+	std::string symbol;
+};
+
+struct PushStringNode {
+	int64_t location;
+	std::string instr;
+	std::string string;
+};
+
+struct PushArraySymbolNode {
+	int64_t location;
+	std::string instr;
+	std::string symbol;
+	std::string suffix;
+};
+
+struct ArrayOpNode {
+	int64_t location;
+	std::string instr;
+	size_t dimensions;
+};
+
+struct CallNode {
+	int64_t location;
+	std::string instr;
+	std::string target;
+	size_t args;
+};
+
+using node_type = std::variant<Node, BranchNode, AssignNode, PushSymbolNode, PushStringNode, PushArraySymbolNode, ArrayOpNode, CallNode>;
+
+#endif
@@ -0,0 +1,471 @@
+
+#include "LoopInvariants.h"
+#include "FlatAst.h"
+#include "PointerAst.h"
+#include <algorithm>
+
+/**
+ * @brief LoopInvariants::find
+ * @param loop_statement
+ * @param entered if true, the loop is known to be entered where the
+ * expressions will be computed, and so those of its body may be taken too
+ * @param hoisted expressions which have already been moved out of an
+ * enclosing loop, they are treated like atoms
+ * @return the expressions to compute ahead of the loop, in the order that
+ * the loop first evaluates them
+ */
+template <class Ast>
+const std::vector<typename LoopInvariants<Ast>::ExpressionRef> &LoopInvariants<Ast>::find(LoopStatement *loop_statement, bool entered, const Hoisted &hoisted) {
+
+	hoisted_ = &hoisted;
+	written_.clear();
+	candidates_.clear();
+	calls_  = false;
+	opaque_ = false;
+
+	collect(loop_statement->cond);
+	collect(loop_statement->body);
+	for (ExpressionRef incr_expr : ast_.list(loop_statement->incr)) {
+		collect(incr_expr);
+	}
+
+	if (opaque_) {
+		return candidates_;
+	}
+
+	std::sort(written_.begin(), written_.end());
+
+	effects_ = false;
+	walk(loop_statement->cond, true);
+
+	if (entered) {
+		effects_ = false;
+		walk(loop_statement->body);
+	}
+
+	return candidates_;
+}
+
+/**
+ * @brief LoopInvariants::name
+ * @param expression
+ * @return the name of the variable that expression is, or an empty string
+ * if it isn't an atom
+ */
+template <class Ast>
+std::string_view LoopInvariants<Ast>::name(ExpressionRef expression) {
+	if (auto atom = ast_.template as<AtomExpression>(expression)) {
+		return ast_.text(atom->value);
+	}
+
+	return std::string_view();
+}
+
+/**
+ * @brief LoopInvariants::write
+ * @param expression a variable, or array, which the loop writes
+ */
+template <class Ast>
+void LoopInvariants<Ast>::write(ExpressionRef expression) {
+	std::string_view variable = name(expression);
+	if (variable.empty()) {
+		opaque_ = true;
+		return;
+	}
+
+	written_.push_back(variable);
+}
+
+/**
+ * @brief LoopInvariants::invariant
+ * @param atom
+ * @return true if the loop doesn't change the value of atom
+ */
+template <class Ast>
+bool LoopInvariants<Ast>::invariant(AtomExpression *atom) {
+	if (atom->type != Token::Identifier && atom->type != Token::ArrayIdentifier) {
+		return true;
+	}
+
+	std::string_view variable = ast_.text(atom->value);
+	if (calls_ && changed_by_calls(variable)) {
+		return false;
+	}
+
+	return !std::binary_search(written_.begin(), written_.end(), variable);
+}
+
+/**
+ * @brief LoopInvariants::collect
+ * @param expression
+ *
+ * Notes the variables which the expression writes, and whether it calls
+ * anything which may change a global
+ */
+template <class Ast>
+void LoopInvariants<Ast>::collect(ExpressionRef expression) {
+
+	pending_.clear();
+	if (expression) {
+		pending_.push_back(expression);
+	}
+
+	while (!pending_.empty()) {
+		const ExpressionRef ref = pending_.back();
+		pending_.pop_back();
+
+		auto collector = Overloaded{
+			[&](BinaryExpression *bin) {
+				if (bin->op == Token::Assign) {
+					if (auto array_index = ast_.template as<ArrayIndexExpression>(bin->lhs)) {
+						write(array_index->array);
+					} else {
+						write(bin->lhs);
+					}
+				}
+
+				pending_.push_back(bin->lhs);
+				pending_.push_back(bin->rhs);
+			},
+			[&](UnaryExpression *unary) {
+				if (unary->op == Token::Increment || unary->op == Token::Decrement) {
+					write(unary->operand);
+				}
+
+				pending_.push_back(unary->operand);
+			},
+			[&](CallExpression *call) {
+				if (!is_pure_builtin(name(call->function))) {
+					calls_ = true;
+				}
+
+				for (ExpressionRef parameter : ast_.list(call->parameters)) {
+					pending_.push_back(parameter);
+				}
+			},
+			[&](ArrayIndexExpression *arr) {
+				pending_.push_back(arr->array);
+				for (ExpressionRef index_expr : ast_.list(arr->index)) {
+					pending_.push_back(index_expr);
+				}
+			},
+			[](AtomExpression *) {},
+		};
+
+		ast_.visit(ref, collector);
+	}
+}
+
+/**
+ * @brief LoopInvariants::collect
+ * @param statement
+ */
+template <class Ast>
+void LoopInvariants<Ast>::collect(StatementRef statement) {
+	if (!statement) {
+		return;
+	}
+
+	auto collector = Overloaded{
+		[&](DeleteStatement *delete_statement) {
+			write(delete_statement->expression);
+			for (ExpressionRef index_expr : ast_.list(delete_statement->index)) {
+				collect(index_expr);
+			}
+		},
+		[&](FunctionStatement *) {
+			opaque_ = true;
+		},
+		[&](BlockStatement *block_statement) {
+			for (StatementRef child : ast_.list(block_statement->statements)) {
+				collect(child);
+			}
+		},
+		[&](CondStatement *cond_statement) {
+			collect(cond_statement->cond);
+			collect(cond_statement->body);
+			collect(cond_statement->else_);
+		},
+		[&](LoopStatement *loop_statement) {
+			for (ExpressionRef init_expr : ast_.list(loop_statement->init)) {
+				collect(init_expr);
+			}
+
+			collect(loop_statement->cond);
+			collect(loop_statement->body);
+			for (ExpressionRef incr_expr : ast_.list(loop_statement->incr)) {
+				collect(incr_expr);
+			}
+		},
+		[&](ForEachStatement *foreach_statement) {
+			write(foreach_statement->iterator);
+			collect(foreach_statement->container);
+			collect(foreach_statement->body);
+		},
+		[&](ExpressionStatement *expression_statement) {
+			collect(expression_statement->expression);
+		},
+		[&](ReturnStatement *return_statement) {
+			collect(return_statement->expression);
+		},
+		[](auto) {},
+	};
+
+	ast_.visit(statement, collector);
+}
+
+/**
+ * @brief LoopInvariants::walk
+ * @param statement
+ * @return false if what follows the statement isn't always evaluated
+ * after it, and so can't be taken
+ */
+template <class Ast>
+bool LoopInvariants<Ast>::walk(StatementRef statement) {
+	if (!statement) {
+		return true;
+	}
+
+	auto walker = Overloaded{
+		[&](DeleteStatement *delete_statement) {
+			for (ExpressionRef index_expr : ast_.list(delete_statement->index)) {
+				walk(index_expr, true);
+			}
+
+			effects_ |= is_global(name(delete_statement->expression));
+			return true;
+		},
+		[&](BlockStatement *block_statement) {
+			for (StatementRef child : ast_.list(block_statement->statements)) {
+				if (!walk(child)) {
+					return false;
+				}
+			}
+
+			return true;
+		},
+		[&](CondStatement *cond_statement) {
+			walk(cond_statement->cond, true);
+			return false;
+		},
+		[&](LoopStatement *loop_statement) {
+			for (ExpressionRef init_expr : ast_.list(loop_statement->init)) {
+				walk(init_expr, false);
+			}
+
+			walk(loop_statement->cond, true);
+			return false;
+		},
+		[&](ForEachStatement *foreach_statement) {
+			walk(foreach_statement->container, true);
+			return false;
+		},
+		[&](ExpressionStatement *expression_statement) {
+			walk(expression_statement->expression, false);
+			return true;
+		},
+		[&](ReturnStatement *return_statement) {
+			walk(return_statement->expression, true);
+			return false;
+		},
+		[](auto) {
+			// NOTE(eteran): break, continue and functions
+			return false;
+		},
+	};
+
+	return ast_.visit(statement, walker);
+}
+
+/**
+ * @brief LoopInvariants::walk
+ * @param expression
+ * @param value true if the value of the expression is used
+ *
+ * Finds the invariant expressions within expression, which is evaluated
+ * whenever the walk gets to it. The expression is walked in the order that
+ * it is evaluated using an explicit stack, working out bottom up whether
+ * each node is invariant. When one is, the candidates found within it are
+ * replaced by the node itself
+ */
+template <class Ast>
+void LoopInvariants<Ast>::walk(ExpressionRef expression, bool value) {
+
+	if (!expression) {
+		return;
+	}
+
+	tasks_.clear();
+	results_.clear();
+	conditional_ = 0;
+	visit(expression, value);
+
+	while (!tasks_.empty()) {
+		const Task task = tasks_.back();
+		tasks_.pop_back();
+
+		switch (task.step) {
+		case Task::Visit:
+			break;
+		case Task::Finish:
+			finish(task);
+			continue;
+		case Task::Enter:
+			++conditional_;
+			continue;
+		case Task::Leave:
+			--conditional_;
+			continue;
+		}
+
+		if (!hoisted_->empty() && hoisted_->count(node_key(ast_, task.expression)) != 0) {
+			results_.push_back(true);
+			continue;
+		}
+
+		// NOTE(eteran): tasks are pushed in the order that they should
+		// run, and then reversed to suit the stack
+		const size_t first = tasks_.size();
+
+		auto walker = Overloaded{
+			[&](BinaryExpression *bin) {
+				switch (bin->op) {
+				case Token::Assign:
+					if (auto array_index = ast_.template as<ArrayIndexExpression>(bin->lhs)) {
+						for (ExpressionRef index_expr : ast_.list(array_index->index)) {
+							schedule(Task::Visit, index_expr);
+						}
+					}
+
+					schedule(Task::Visit, bin->rhs);
+					break;
+				case Token::LogicalAnd:
+				case Token::LogicalOr:
+					schedule(Task::Visit, bin->lhs);
+					schedule(Task::Enter, bin->rhs);
+					schedule(Task::Visit, bin->rhs, !link(bin));
+					schedule(Task::Leave, bin->rhs);
+					break;
+				default:
+					schedule(Task::Visit, bin->lhs);
+					schedule(Task::Visit, bin->rhs, !link(bin));
+					break;
+				}
+			},
+			[&](UnaryExpression *unary) {
+				if (unary->op != Token::Increment && unary->op != Token::Decrement) {
+					schedule(Task::Visit, unary->operand);
+				}
+			},
+			[&](CallExpression *call) {
+				for (ExpressionRef parameter : ast_.list(call->parameters)) {
+					schedule(Task::Visit, parameter);
+				}
+			},
+			[&](ArrayIndexExpression *arr) {
+				schedule(Task::Visit, arr->array);
+				for (ExpressionRef index_expr : ast_.list(arr->index)) {
+					schedule(Task::Visit, index_expr);
+				}
+			},
+			[&](AtomExpression *atom) {
+				results_.push_back(invariant(atom));
+			},
+		};
+
+		const size_t results = results_.size();
+		ast_.visit(task.expression, walker);
+
+		if (!ast_.template as<AtomExpression>(task.expression)) {
+			tasks_.push_back(Task{Task::Finish, task.value, task.expression, results, candidates_.size()});
+		}
+
+		std::reverse(tasks_.begin() + static_cast<ptrdiff_t>(first), tasks_.end());
+	}
+}
+
+/**
+ * @brief LoopInvariants::finish
+ * @param task the Finish step of an expression
+ */
+template <class Ast>
+void LoopInvariants<Ast>::finish(const Task &task) {
+
+	bool invariant = std::all_of(results_.begin() + static_cast<ptrdiff_t>(task.results), results_.end(), [](bool result) {
+		return result;
+	});
+
+	auto finisher = Overloaded{
+		[&](BinaryExpression *bin) {
+			if (bin->op == Token::Assign) {
+				auto array_index = ast_.template as<ArrayIndexExpression>(bin->lhs);
+				effects_ |= is_global(name(array_index ? array_index->array : bin->lhs));
+				invariant = false;
+			}
+		},
+		[&](UnaryExpression *unary) {
+			if (unary->op == Token::Increment || unary->op == Token::Decrement) {
+				effects_ |= is_global(name(unary->operand));
+				invariant = false;
+			}
+		},
+		[&](CallExpression *call) {
+			if (!is_pure_builtin(name(call->function))) {
+				effects_  = true;
+				invariant = false;
+			}
+		},
+		[](auto) {},
+	};
+
+	ast_.visit(task.expression, finisher);
+
+	results_.resize(task.results);
+	results_.push_back(invariant);
+
+	if (invariant && task.value && conditional_ == 0 && !effects_) {
+		candidates_.resize(task.candidates);
+		candidates_.push_back(task.expression);
+	}
+}
+
+/**
+ * @brief LoopInvariants::visit
+ * @param expression
+ * @param value
+ */
+template <class Ast>
+void LoopInvariants<Ast>::visit(ExpressionRef expression, bool value) {
+	tasks_.push_back(Task{Task::Visit, value, expression, 0, 0});
+}
+
+/**
+ * @brief LoopInvariants::schedule
+ * @param step
+ * @param expression an operand
+ * @param value false if the operand can't be replaced by its value
+ */
+template <class Ast>
+void LoopInvariants<Ast>::schedule(typename Task::Step step, ExpressionRef expression, bool value) {
+	tasks_.push_back(Task{step, value, expression, 0, 0});
+}
+
+/**
+ * @brief LoopInvariants::link
+ * @param bin
+ * @return true if the right operand of bin continues a chain of the same
+ * operator. The generator doesn't generate such a link as a node of its
+ * own, only its operands
+ */
+template <class Ast>
+bool LoopInvariants<Ast>::link(BinaryExpression *bin) {
+	if (bin->op != Token::Concatenate && bin->op != Token::LogicalAnd && bin->op != Token::LogicalOr) {
+		return false;
+	}
+
+	auto rhs = ast_.template as<BinaryExpression>(bin->rhs);
+	return rhs && rhs->op == bin->op;
+}
+
+template class LoopInvariants<PointerAst>;
+template class LoopInvariants<FlatAst>;
@@ -0,0 +1,99 @@
+
+#ifndef LOOP_INVARIANTS_H_
+#define LOOP_INVARIANTS_H_
+
+#include "Analysis.h"
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Finds the expressions in a loop which compute the same value on each
+ * pass through it, so that they can be computed once, ahead of it. Such an
+ * expression reads no variable which the loop writes, and calls nothing but
+ * pure builtins. Computing it early must also not raise an error which
+ * wouldn't have been raised, or raise one sooner than something which can be
+ * seen once the macro stops (a call, or a change to a global), so it must be
+ * one which the first pass through the loop computes before any of those.
+ * Only the largest such expressions are taken, and atoms are left alone as
+ * they cost no more to read than a copy of them would
+ */
+template <class Ast>
+class LoopInvariants {
+private:
+	using ExpressionRef = typename Ast::ExpressionRef;
+	using StatementRef  = typename Ast::StatementRef;
+
+	using BinaryExpression     = typename Ast::BinaryExpression;
+	using UnaryExpression      = typename Ast::UnaryExpression;
+	using AtomExpression       = typename Ast::AtomExpression;
+	using CallExpression       = typename Ast::CallExpression;
+	using ArrayIndexExpression = typename Ast::ArrayIndexExpression;
+
+	using DeleteStatement     = typename Ast::DeleteStatement;
+	using FunctionStatement   = typename Ast::FunctionStatement;
+	using BlockStatement      = typename Ast::BlockStatement;
+	using CondStatement       = typename Ast::CondStatement;
+	using LoopStatement       = typename Ast::LoopStatement;
+	using ForEachStatement    = typename Ast::ForEachStatement;
+	using ExpressionStatement = typename Ast::ExpressionStatement;
+	using ReturnStatement     = typename Ast::ReturnStatement;
+
+	/**
+	 * @brief a pending step of walking an expression
+	 */
+	struct Task {
+		enum Step : uint8_t {
+			Visit,  // an expression, whose value is used if value is set
+			Finish, // the operands of an expression are done
+			Enter,  // what follows is only evaluated some of the time
+			Leave,  // the end of what Enter started
+		};
+
+		Step step;
+		bool value;
+		ExpressionRef expression;
+		size_t results;    // for Finish, where the results of the operands start
+		size_t candidates; // for Finish, how many candidates there were before the expression
+	};
+
+public:
+	explicit LoopInvariants(Ast &ast) noexcept
+		: ast_(ast) {
+	}
+
+public:
+	const std::vector<ExpressionRef> &find(LoopStatement *loop_statement, bool entered, const Hoisted &hoisted);
+
+private:
+	std::string_view name(ExpressionRef expression);
+	void write(ExpressionRef expression);
+	bool invariant(AtomExpression *atom);
+	void collect(ExpressionRef expression);
+	void collect(StatementRef statement);
+	bool walk(StatementRef statement);
+	void walk(ExpressionRef expression, bool value);
+	void finish(const Task &task);
+	void visit(ExpressionRef expression, bool value);
+	void schedule(typename Task::Step step, ExpressionRef expression, bool value = true);
+	bool link(BinaryExpression *bin);
+
+private:
+	Ast &ast_;
+	const Hoisted *hoisted_ = nullptr;
+	std::vector<ExpressionRef> candidates_;
+	std::vector<ExpressionRef> pending_;
+	std::vector<Task> tasks_;
+	std::vector<bool> results_;
+
+	// the variables which the loop writes, sorted
+	std::vector<std::string_view> written_;
+
+	bool calls_         = false; // the loop calls something which may change a global
+	bool opaque_        = false; // the loop writes something which can't be named
+	bool effects_       = false; // something which can be seen once the macro stops has been evaluated
+	size_t conditional_ = 0;     // how many && or || the walk is on the right of
+};
+
+#endif
@@ -1,187 +1,1167 @@
 
 #include "Optimizer.h"
-#include "Expression.h"
-#include "Statement.h"
+#include "FlatAst.h"
+#include "PointerAst.h"
 #include <algorithm>
-#include <cmath>
+#include <charconv>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
 
 namespace Optimizer {
 namespace {
 
-void fold(std::unique_ptr<Expression> &expression);
+/**
+ * @brief to_number
+ * @param text
+ * @param type
+ * @return the value of a constant as an integer, or nothing if it isn't one.
+ * Strings convert the way NEdit converts them at run time (blanks around the
+ * number and a leading sign are allowed), but only if they do so cleanly, a
+ * string which NEdit would reject, or whose value doesn't fit, is left alone
+ */
+std::optional<int32_t> to_number(std::string_view text, Token::Type type) {
 
-void fold_string_expression(AtomExpression *left, AtomExpression *right, Token::Type op, std::unique_ptr<Expression> &expression) {
-	switch (op) {
-	case Token::Type::Concatenate: {
-		std::string v = left->value + right->value;
-
-		auto atom   = std::make_unique<AtomExpression>();
-		atom->value = v;
-		atom->type  = Token::Type::String;
-		expression  = std::move(atom);
-	} break;
+	if (type == Token::String) {
+		auto blank = [](char ch) { return ch == ' ' || ch == '\t'; };
+
+		while (!text.empty() && blank(text.front())) {
+			text.remove_prefix(1);
+		}
+
+		while (!text.empty() && blank(text.back())) {
+			text.remove_suffix(1);
+		}
+
+		if (text.size() > 1 && text[0] == '+' && text[1] != '-') {
+			text.remove_prefix(1);
+		}
+	} else if (type != Token::Integer) {
+		return {};
+	}
+
+	int32_t n       = 0;
+	const char *end = text.data() + text.size();
+
+	auto [ptr, ec] = std::from_chars(text.data(), end, n, 10);
+	if (text.empty() || ec != std::errc() || ptr != end) {
+		return {};
+	}
+
+	return n;
+}
+
+/**
+ * @brief power
+ * @param base
+ * @param exponent
+ * @return base raised to exponent, as NEdit's ^ computes it
+ */
+std::optional<int32_t> power(int32_t base, int32_t exponent) {
+
+	switch (base) {
+	case 0:
+		// NOTE(eteran): a negative power of zero is left to fail at run time
+		if (exponent < 0) {
+			return {};
+		}
+
+		return exponent == 0 ? 1 : 0;
+	case 1:
+		return 1;
+	case -1:
+		return (exponent & 1) ? -1 : 1;
 	default:
 		break;
 	}
+
+	// NOTE(eteran): NEdit truncates a negative power of anything else to zero
+	if (exponent < 0) {
+		return 0;
+	}
+
+	// anything else overflows within 31 steps
+	int64_t v = 1;
+	for (int32_t i = 0; i < exponent; ++i) {
+		v *= base;
+		if (v < INT32_MIN || v > INT32_MAX) {
+			return {};
+		}
+	}
+
+	return static_cast<int32_t>(v);
 }
 
-void fold_numeric_expression(AtomExpression *left, AtomExpression *right, Token::Type op, std::unique_ptr<Expression> &expression) {
+/**
+ * @brief evaluate
+ * @param op
+ * @param l
+ * @param r
+ * @return the result of a binary operator on two integers, as NEdit computes
+ * it. Division by zero and results which don't fit in 32 bits are left to
+ * run time, so that folding never changes what a macro does
+ */
+std::optional<int32_t> evaluate(Token::Type op, int32_t l, int32_t r) {
+
+	const int64_t a = l;
+	const int64_t b = r;
+	int64_t v       = 0;
+
 	switch (op) {
-	case Token::Type::Add: {
-		int32_t l = std::stoi(left->value);
-		int32_t r = std::stoi(right->value);
-		int32_t v = l + r;
-
-		auto atom   = std::make_unique<AtomExpression>();
-		atom->value = std::to_string(v);
-		atom->type  = Token::Type::Integer;
-		expression  = std::move(atom);
-	} break;
-	case Token::Type::Sub: {
-		int32_t l = std::stoi(left->value);
-		int32_t r = std::stoi(right->value);
-		int32_t v = l - r;
-
-		auto atom   = std::make_unique<AtomExpression>();
-		atom->value = std::to_string(v);
-		atom->type  = Token::Type::Integer;
-		expression  = std::move(atom);
-	} break;
-	case Token::Type::Mul: {
-		int32_t l = std::stoi(left->value);
-		int32_t r = std::stoi(right->value);
-		int32_t v = l * r;
-
-		auto atom   = std::make_unique<AtomExpression>();
-		atom->value = std::to_string(v);
-		atom->type  = Token::Type::Integer;
-		expression  = std::move(atom);
-	} break;
-	case Token::Type::Div: {
-		int32_t l = std::stoi(left->value);
-		int32_t r = std::stoi(right->value);
-
-		// NOTE(eteran): we don't HAVE to throw an error (but we could)
-		// we can just let it fail at runtime
-		if (r == 0) {
+	case Token::Add:
+		v = a + b;
+		break;
+	case Token::Sub:
+		v = a - b;
+		break;
+	case Token::Mul:
+		v = a * b;
+		break;
+	case Token::Div:
+		if (b == 0) {
+			return {};
+		}
+
+		v = a / b;
+		break;
+	case Token::Mod:
+		if (b == 0 || (a == INT32_MIN && b == -1)) {
+			return {};
+		}
+
+		v = a % b;
+		break;
+	case Token::Exponent:
+		return power(l, r);
+	case Token::BinaryAnd:
+		v = a & b;
+		break;
+	case Token::BinaryOr:
+		v = a | b;
+		break;
+	case Token::Equal:
+		v = a == b;
+		break;
+	case Token::NotEqual:
+		v = a != b;
+		break;
+	case Token::LessThan:
+		v = a < b;
+		break;
+	case Token::LessThanOrEqual:
+		v = a <= b;
+		break;
+	case Token::GreaterThan:
+		v = a > b;
+		break;
+	case Token::GreaterThanOrEqual:
+		v = a >= b;
+		break;
+	default:
+		return {};
+	}
+
+	if (v < INT32_MIN || v > INT32_MAX) {
+		return {};
+	}
+
+	return static_cast<int32_t>(v);
+}
+
+/**
+ * @brief Folds constant expressions in either form of the AST, Ast is one of
+ * PointerAst or FlatAst. Along the way, identities such as x + 0 are dropped
+ * and operators are rewritten into cheaper ones, where what is known of the
+ * type of the operands shows that this doesn't change the result
+ */
+template <class Ast>
+class Folder {
+private:
+	using ExpressionRef  = typename Ast::ExpressionRef;
+	using StatementRef   = typename Ast::StatementRef;
+	using ExpressionList = typename Ast::ExpressionList;
+	using StatementList  = typename Ast::StatementList;
+
+	using BinaryExpression     = typename Ast::BinaryExpression;
+	using UnaryExpression      = typename Ast::UnaryExpression;
+	using AtomExpression       = typename Ast::AtomExpression;
+	using CallExpression       = typename Ast::CallExpression;
+	using ArrayIndexExpression = typename Ast::ArrayIndexExpression;
+
+	using DeleteStatement     = typename Ast::DeleteStatement;
+	using FunctionStatement   = typename Ast::FunctionStatement;
+	using BlockStatement      = typename Ast::BlockStatement;
+	using CondStatement       = typename Ast::CondStatement;
+	using LoopStatement       = typename Ast::LoopStatement;
+	using ForEachStatement    = typename Ast::ForEachStatement;
+	using ExpressionStatement = typename Ast::ExpressionStatement;
+	using ReturnStatement     = typename Ast::ReturnStatement;
+
+public:
+	explicit Folder(Ast &ast) noexcept
+		: ast_(ast) {
+	}
+
+public:
+	/**
+	 * @brief fold
+	 * @param statements
+	 */
+	void fold(const StatementList &statements) {
+		for (StatementRef &statement : ast_.list(statements)) {
+			fold(statement);
+		}
+	}
+
+private:
+	/**
+	 * @brief constant
+	 * @param expression
+	 * @return the expression as an atom, if it is an integer or string constant
+	 */
+	AtomExpression *constant(ExpressionRef expression) {
+		if (auto atom = ast_.template as<AtomExpression>(expression)) {
+			if (atom->type == Token::Integer || atom->type == Token::String) {
+				return atom;
+			}
+		}
+
+		return nullptr;
+	}
+
+	std::optional<int32_t> to_number(AtomExpression *atom) {
+		return Optimizer::to_number(ast_.text(atom->value), atom->type);
+	}
+
+	ExpressionRef make_integer(int32_t value) {
+		return ast_.make_atom(std::to_string(value), Token::Integer);
+	}
+
+	/**
+	 * @brief fold_binary_expression
+	 * @param bin a binary expression whose operands have been folded
+	 * @param expression where bin is, receives the result if it is constant
+	 */
+	void fold_binary_expression(BinaryExpression *bin, ExpressionRef &expression) {
+
+		AtomExpression *left = constant(bin->lhs);
+		if (!left) {
+			return;
+		}
+
+		if (bin->op == Token::LogicalAnd || bin->op == Token::LogicalOr) {
+			fold_logical_expression(bin, left, expression);
+			return;
+		}
+
+		AtomExpression *right = constant(bin->rhs);
+		if (!right) {
+			return;
+		}
+
+		std::optional<int32_t> v;
+
+		switch (bin->op) {
+		case Token::Equal:
+		case Token::NotEqual:
+			// NOTE(eteran): two strings compare as strings, how a string and
+			// an integer compare is left to run time
+			if (left->type == Token::String && right->type == Token::String) {
+				v = (ast_.text(left->value) == ast_.text(right->value)) == (bin->op == Token::Equal);
+			} else if (left->type == Token::Integer && right->type == Token::Integer) {
+				v = evaluate(bin->op, *to_number(left), *to_number(right));
+			}
+			break;
+		case Token::LessThan:
+		case Token::LessThanOrEqual:
+		case Token::GreaterThan:
+		case Token::GreaterThanOrEqual:
+			if (left->type == Token::Integer && right->type == Token::Integer) {
+				v = evaluate(bin->op, *to_number(left), *to_number(right));
+			}
+			break;
+		default:
+			if (auto l = to_number(left)) {
+				if (auto r = to_number(right)) {
+					v = evaluate(bin->op, *l, *r);
+				}
+			}
 			break;
 		}
 
-		int32_t v = l / r;
+		if (v) {
+			expression = make_integer(*v);
+		}
+	}
 
-		auto atom   = std::make_unique<AtomExpression>();
-		atom->value = std::to_string(v);
-		atom->type  = Token::Type::Integer;
-		expression  = std::move(atom);
-	} break;
-	case Token::Type::Mod: {
-		int32_t l = std::stoi(left->value);
-		int32_t r = std::stoi(right->value);
+	/**
+	 * @brief fold_logical_expression
+	 * @param bin a && or || whose operands have been folded
+	 * @param left its left operand, a constant
+	 * @param expression where bin is, receives the result if it is constant
+	 *
+	 * These only evaluate their right operand if the left one doesn't decide
+	 * the result, and when it does, the left operand is itself the result
+	 */
+	void fold_logical_expression(BinaryExpression *bin, AtomExpression *left, ExpressionRef &expression) {
 
-		// NOTE(eteran): we don't HAVE to throw an error (but we could)
-		// we can just let it fail at runtime
-		if (r == 0) {
+		if (left->type != Token::Integer) {
+			return;
+		}
+
+		const bool decided = (*to_number(left) == 0) == (bin->op == Token::LogicalAnd);
+		if (decided) {
+			expression = bin->lhs;
+			return;
+		}
+
+		if (AtomExpression *right = constant(bin->rhs)) {
+			if (auto r = to_number(right)) {
+				expression = make_integer(*r != 0);
+			}
+		}
+	}
+
+	/**
+	 * @brief fold_unary_expression
+	 * @param unary a unary expression whose operand has been folded
+	 * @param expression where unary is, receives the result if it is constant
+	 */
+	void fold_unary_expression(UnaryExpression *unary, ExpressionRef &expression) {
+
+		AtomExpression *operand = constant(unary->operand);
+		if (!operand) {
+			return;
+		}
+
+		const std::optional<int32_t> n = to_number(operand);
+		if (!n) {
+			return;
+		}
+
+		switch (unary->op) {
+		case Token::Sub:
+			if (*n != INT32_MIN) {
+				expression = make_integer(-*n);
+			}
+			break;
+		case Token::Not:
+			expression = make_integer(*n == 0);
+			break;
+		default:
+			// NOTE(eteran): ++ and -- need a variable
 			break;
 		}
+	}
 
-		int32_t v = l % r;
+	/**
+	 * @brief value
+	 * @param expression
+	 * @return the value of the expression as an integer, if it is a constant
+	 * which converts cleanly to one
+	 */
+	std::optional<int32_t> value(ExpressionRef expression) {
+		if (AtomExpression *atom = constant(expression)) {
+			return to_number(atom);
+		}
 
-		auto atom   = std::make_unique<AtomExpression>();
-		atom->value = std::to_string(v);
-		atom->type  = Token::Type::Integer;
-		expression  = std::move(atom);
-	} break;
-	case Token::Type::Exponent: {
-		int32_t l = std::stoi(left->value);
-		int32_t r = std::stoi(right->value);
-		int32_t v = static_cast<int32_t>(std::pow(static_cast<double>(l), static_cast<double>(r)));
+		return {};
+	}
 
-		auto atom   = std::make_unique<AtomExpression>();
-		atom->value = std::to_string(v);
-		atom->type  = Token::Type::Integer;
-		expression  = std::move(atom);
-	} break;
-	default:
-		break;
+	/**
+	 * @brief boolean
+	 * @param expression
+	 * @return true if the expression is known to evaluate to 0 or 1
+	 */
+	bool boolean(ExpressionRef expression) {
+		if (auto unary = ast_.template as<UnaryExpression>(expression)) {
+			return unary->op == Token::Not;
+		}
+
+		if (auto bin = ast_.template as<BinaryExpression>(expression)) {
+			switch (bin->op) {
+			case Token::Equal:
+			case Token::NotEqual:
+			case Token::LessThan:
+			case Token::LessThanOrEqual:
+			case Token::GreaterThan:
+			case Token::GreaterThanOrEqual:
+				return true;
+			default:
+				break;
+			}
+		}
+
+		return false;
 	}
-}
 
-void fold_binary_expression(BinaryExpression *bin, std::unique_ptr<Expression> &expression) {
-	fold(bin->lhs);
-	fold(bin->rhs);
+	/**
+	 * @brief string
+	 * @param expression
+	 * @return true if the expression is known to evaluate to a string
+	 */
+	bool string(ExpressionRef expression) {
+		if (auto atom = ast_.template as<AtomExpression>(expression)) {
+			return atom->type == Token::String;
+		}
 
-	if (auto left = dynamic_cast<AtomExpression *>(bin->lhs.get())) {
-		if (auto right = dynamic_cast<AtomExpression *>(bin->rhs.get())) {
-			if (left->type == Token::Integer && right->type == Token::Integer) {
-				fold_numeric_expression(left, right, bin->op, expression);
-			} else if (left->type == Token::String && right->type == Token::String) {
-				fold_string_expression(left, right, bin->op, expression);
-			} else if (left->type == Token::String && right->type == Token::Integer) {
-				fold_string_expression(left, right, bin->op, expression);
-			} else if (left->type == Token::Integer && right->type == Token::String) {
-				fold_string_expression(left, right, bin->op, expression);
+		if (auto bin = ast_.template as<BinaryExpression>(expression)) {
+			return bin->op == Token::Concatenate;
+		}
+
+		return false;
+	}
+
+	/**
+	 * @brief integer
+	 * @param expression
+	 * @return true if the expression is known to evaluate to an integer, or
+	 * else to fail. Variables may hold anything, and + - & and | also work on
+	 * arrays, so those only give an integer if both of their operands do
+	 */
+	bool integer(ExpressionRef expression) {
+
+		pending_.clear();
+		pending_.push_back(expression);
+
+		while (!pending_.empty()) {
+			const ExpressionRef ref = pending_.back();
+			pending_.pop_back();
+
+			if (boolean(ref)) {
+				continue;
+			}
+
+			if (auto atom = ast_.template as<AtomExpression>(ref)) {
+				if (atom->type != Token::Integer) {
+					return false;
+				}
+			} else if (auto unary = ast_.template as<UnaryExpression>(ref)) {
+				if (unary->op != Token::Sub && unary->op != Token::Increment && unary->op != Token::Decrement) {
+					return false;
+				}
+			} else if (auto bin = ast_.template as<BinaryExpression>(ref)) {
+				switch (bin->op) {
+				case Token::Mul:
+				case Token::Div:
+				case Token::Mod:
+				case Token::Exponent:
+					break;
+				case Token::Add:
+				case Token::Sub:
+				case Token::BinaryAnd:
+				case Token::BinaryOr:
+					pending_.push_back(bin->lhs);
+					pending_.push_back(bin->rhs);
+					break;
+				default:
+					return false;
+				}
+			} else {
+				return false;
 			}
 		}
+
+		return true;
 	}
-}
 
-/**
- * @brief fold
- * @param expression
- */
-void fold(std::unique_ptr<Expression> &expression) {
+	/**
+	 * @brief safe
+	 * @param expression
+	 * @return true if evaluating the expression can neither fail nor have a
+	 * side effect. Reading a variable fails if it isn't set, or if it holds a
+	 * string which isn't a number, so these are made of integer constants
+	 * which folding couldn't join because the result overflows
+	 */
+	bool safe(ExpressionRef expression) {
+
+		pending_.clear();
+		pending_.push_back(expression);
+
+		while (!pending_.empty()) {
+			const ExpressionRef ref = pending_.back();
+			pending_.pop_back();
+
+			if (auto atom = ast_.template as<AtomExpression>(ref)) {
+				if (atom->type != Token::Integer || !to_number(atom)) {
+					return false;
+				}
+			} else if (auto unary = ast_.template as<UnaryExpression>(ref)) {
+				if (unary->op != Token::Sub && unary->op != Token::Not) {
+					return false;
+				}
+
+				pending_.push_back(unary->operand);
+			} else if (auto bin = ast_.template as<BinaryExpression>(ref)) {
+				if (bin->op != Token::Add && bin->op != Token::Sub && bin->op != Token::Mul && !boolean(ref)) {
+					return false;
+				}
+
+				pending_.push_back(bin->lhs);
+				pending_.push_back(bin->rhs);
+			} else {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * @brief simplify_binary_expression
+	 * @param bin a binary expression whose operands have been folded
+	 * @param expression where bin is, receives what it simplifies to
+	 * @return true if anything was changed
+	 *
+	 * Rewrites identities, and operators which can be done more cheaply.
+	 * Adding zero or multiplying by one converts the other operand to a
+	 * number, so these are only dropped if it is one already
+	 */
+	bool simplify_binary_expression(BinaryExpression *bin, ExpressionRef &expression) {
+
+		const std::optional<int32_t> l = value(bin->lhs);
+		const std::optional<int32_t> r = value(bin->rhs);
+
+		switch (bin->op) {
+		case Token::Add:
+			if (r == 0 && integer(bin->lhs)) {
+				expression = bin->lhs;
+				return true;
+			}
+
+			if (l == 0 && integer(bin->rhs)) {
+				expression = bin->rhs;
+				return true;
+			}
+			break;
+		case Token::Sub:
+			if (r == 0 && integer(bin->lhs)) {
+				expression = bin->lhs;
+				return true;
+			}
+			break;
+		case Token::Mul:
+			if ((r == 0 && safe(bin->lhs)) || (l == 0 && safe(bin->rhs))) {
+				expression = make_integer(0);
+				return true;
+			}
+
+			if (r == 1 && integer(bin->lhs)) {
+				expression = bin->lhs;
+				return true;
+			}
+
+			if (l == 1 && integer(bin->rhs)) {
+				expression = bin->rhs;
+				return true;
+			}
+
+			if (r) {
+				return reassociate(bin, bin->lhs, *r);
+			}
+
+			if (l) {
+				return reassociate(bin, bin->rhs, *l);
+			}
+			break;
+		case Token::Div:
+			if (r == 1 && integer(bin->lhs)) {
+				expression = bin->lhs;
+				return true;
+			}
 
-	if (auto bin = dynamic_cast<BinaryExpression *>(expression.get())) {
-		fold_binary_expression(bin, expression);
-	} else if (auto call = dynamic_cast<CallExpression *>(expression.get())) {
-		for (auto &param : call->parameters) {
-			fold(param);
+			if (r > 0) {
+				return reassociate(bin, bin->lhs, *r);
+			}
+			break;
+		default:
+			break;
 		}
-	} else if (auto arr = dynamic_cast<ArrayIndexExpression *>(expression.get())) {
-		for (auto &idx : arr->index) {
-			fold(idx);
+
+		return false;
+	}
+
+	/**
+	 * @brief reassociate
+	 * @param bin a * or / by a constant
+	 * @param operand the operand of bin which isn't that constant
+	 * @param n the constant
+	 * @return true if operand is itself the same operation by a constant, in
+	 * which case the two are joined into one
+	 *
+	 * This is the strength reduction which suits NEdit. It has no shifts to
+	 * turn a multiplication or division by a power of two into, but scaling
+	 * in steps, as in (x * 4) * 2, can be done in one. Truncating division
+	 * joins the same way, as long as both divisors are positive
+	 */
+	bool reassociate(BinaryExpression *bin, ExpressionRef operand, int32_t n) {
+
+		auto inner = ast_.template as<BinaryExpression>(operand);
+		if (!inner || inner->op != bin->op) {
+			return false;
+		}
+
+		ExpressionRef x;
+		std::optional<int32_t> m = value(inner->rhs);
+		if (m) {
+			x = inner->lhs;
+		} else if (bin->op == Token::Mul && (m = value(inner->lhs))) {
+			x = inner->rhs;
+		} else {
+			return false;
+		}
+
+		if (bin->op == Token::Div && *m <= 0) {
+			return false;
 		}
+
+		const std::optional<int32_t> v = evaluate(Token::Mul, *m, n);
+		if (!v) {
+			return false;
+		}
+
+		bin->lhs = x;
+		bin->rhs = make_integer(*v);
+		return true;
 	}
-}
+
+	/**
+	 * @brief simplify_unary_expression
+	 * @param unary a unary expression whose operand has been folded
+	 * @param expression where unary is, receives what it simplifies to
+	 * @return true if anything was changed
+	 */
+	bool simplify_unary_expression(UnaryExpression *unary, ExpressionRef &expression) {
+
+		auto inner = ast_.template as<UnaryExpression>(unary->operand);
+		if (!inner || inner->op != unary->op) {
+			return false;
+		}
+
+		// NOTE(eteran): negating twice converts to a number, and ! twice to 0
+		// or 1, which is only the operand itself if it is that already
+		switch (unary->op) {
+		case Token::Sub:
+			if (integer(inner->operand)) {
+				expression = inner->operand;
+				return true;
+			}
+			break;
+		case Token::Not:
+			if (boolean(inner->operand)) {
+				expression = inner->operand;
+				return true;
+			}
+			break;
+		default:
+			break;
+		}
+
+		return false;
+	}
+
+	/**
+	 * @brief fold_expression
+	 * @param expression a binary or unary expression whose operands have been
+	 * folded
+	 *
+	 * Folding and simplifying each open the way for the other, so both are
+	 * repeated until the expression no longer changes. The operands are
+	 * already as simple as they get, so this leaves the whole expression so
+	 */
+	void fold_expression(ExpressionRef &expression) {
+		while (true) {
+			const ExpressionRef folded = expression;
+
+			if (auto bin = ast_.template as<BinaryExpression>(expression)) {
+				fold_binary_expression(bin, expression);
+				if (expression == folded && !simplify_binary_expression(bin, expression)) {
+					return;
+				}
+			} else if (auto unary = ast_.template as<UnaryExpression>(expression)) {
+				fold_unary_expression(unary, expression);
+				if (expression == folded && !simplify_unary_expression(unary, expression)) {
+					return;
+				}
+			} else {
+				return;
+			}
+		}
+	}
+
+	/**
+	 * @brief fold_chain
+	 * @param expression a chain of concatenations, whose operands have been folded
+	 *
+	 * Joins each run of constants in the chain into a single string. Folding
+	 * the chain one link at a time would copy the text built so far at each
+	 * step, which is quadratic in the length of the chain, here each run is
+	 * built once. The links which are left over are dropped from the chain
+	 */
+	void fold_chain(ExpressionRef &expression) {
+
+		links_.clear();
+		operands_.clear();
+
+		auto link = ast_.template as<BinaryExpression>(expression);
+		while (true) {
+			links_.push_back(link);
+			operands_.push_back(link->lhs);
+
+			auto next = ast_.template as<BinaryExpression>(link->rhs);
+			if (!next || next->op != Token::Concatenate) {
+				operands_.push_back(link->rhs);
+				break;
+			}
+
+			link = next;
+		}
+
+		std::string run;
+		size_t run_length = 0;
+		size_t size       = 0;
+
+		// NOTE(eteran): in the flat form, making an atom may move the atom pool
+		// and the text, so each constant is copied into the run straight away
+		auto flush = [&]() {
+			if (run_length > 1) {
+				operands_[size - 1] = ast_.make_atom(run, Token::String);
+			}
+
+			run.clear();
+			run_length = 0;
+		};
+
+		for (size_t i = 0; i < operands_.size(); ++i) {
+			const ExpressionRef operand = operands_[i];
+
+			if (AtomExpression *atom = constant(operand)) {
+				if (run_length++ == 0) {
+					operands_[size++] = operand;
+				}
+
+				run.append(ast_.text(atom->value));
+				continue;
+			}
+
+			flush();
+			operands_[size++] = operand;
+		}
+
+		flush();
+
+		// NOTE(eteran): an empty string adds nothing to the result, as long as
+		// what is left is still a concatenation, or a string anyway
+		size_t kept = 0;
+		for (size_t i = 0; i < size; ++i) {
+			AtomExpression *atom = constant(operands_[i]);
+			if (!atom || atom->type != Token::String || !ast_.text(atom->value).empty()) {
+				operands_[kept++] = operands_[i];
+			}
+		}
+
+		if (kept > 1 || (kept == 1 && string(operands_[0]))) {
+			size = kept;
+		}
+
+		if (size == operands_.size()) {
+			return;
+		}
+
+		if (size == 1) {
+			expression = operands_[0];
+			return;
+		}
+
+		for (size_t i = 0; i + 1 < size; ++i) {
+			links_[i]->lhs = operands_[i];
+		}
+
+		links_[size - 2]->rhs = operands_[size - 1];
+	}
+
+	/**
+	 * @brief fold
+	 * @param expression
+	 *
+	 * Walks the expression in post-order using an explicit stack rather than
+	 * recursion, so that the operands of a node are folded before the node
+	 * itself no matter how deeply the expression is nested
+	 */
+	void fold(ExpressionRef &expression) {
+
+		tasks_.clear();
+		tasks_.push_back(Task{&expression, Task::Visit});
+
+		while (!tasks_.empty()) {
+			const Task task = tasks_.back();
+			tasks_.pop_back();
+
+			if (!*task.slot) {
+				continue;
+			}
+
+			switch (task.step) {
+			case Task::Visit:
+				break;
+			case Task::Fold:
+				fold_expression(*task.slot);
+				continue;
+			case Task::FoldChain:
+				fold_chain(*task.slot);
+				continue;
+			}
+
+			auto folder = Overloaded{
+				[&](BinaryExpression *bin) {
+					if (bin->op == Token::Concatenate) {
+						push_chain(task.slot, bin);
+						return;
+					}
+
+					tasks_.push_back(Task{task.slot, Task::Fold});
+					tasks_.push_back(Task{&bin->rhs, Task::Visit});
+					tasks_.push_back(Task{&bin->lhs, Task::Visit});
+				},
+				[&](UnaryExpression *unary) {
+					tasks_.push_back(Task{task.slot, Task::Fold});
+					tasks_.push_back(Task{&unary->operand, Task::Visit});
+				},
+				[&](CallExpression *call) {
+					push_operands(ast_.list(call->parameters));
+				},
+				[&](ArrayIndexExpression *arr) {
+					push_operands(ast_.list(arr->index));
+				},
+				[](auto) {},
+			};
+
+			ast_.visit(*task.slot, folder);
+		}
+	}
+
+	/**
+	 * @brief fold
+	 * @param expressions
+	 */
+	void fold(const ExpressionList &expressions) {
+		for (ExpressionRef &expression : ast_.list(expressions)) {
+			fold(expression);
+		}
+	}
+
+	/**
+	 * @brief push_chain
+	 * @param slot where the chain is
+	 * @param bin the first link of a chain of concatenations
+	 *
+	 * Schedules the operands of every link in the chain to be folded, in
+	 * order, and then the chain as a whole
+	 */
+	void push_chain(ExpressionRef *slot, BinaryExpression *bin) {
+		tasks_.push_back(Task{slot, Task::FoldChain});
+
+		const size_t first = tasks_.size();
+
+		while (true) {
+			tasks_.push_back(Task{&bin->lhs, Task::Visit});
+
+			auto next = ast_.template as<BinaryExpression>(bin->rhs);
+			if (!next || next->op != Token::Concatenate) {
+				tasks_.push_back(Task{&bin->rhs, Task::Visit});
+				break;
+			}
+
+			bin = next;
+		}
+
+		std::reverse(tasks_.begin() + static_cast<std::ptrdiff_t>(first), tasks_.end());
+	}
+
+	/**
+	 * @brief push_operands
+	 * @param operands
+	 *
+	 * Schedules operands to be folded, in order
+	 */
+	template <class List>
+	void push_operands(const List &operands) {
+		for (auto it = operands.end(); it != operands.begin();) {
+			--it;
+			tasks_.push_back(Task{&*it, Task::Visit});
+		}
+	}
+
+	/**
+	 * @brief fold
+	 * @param statement
+	 */
+	void fold(StatementRef &statement) {
+
+		if (!statement) {
+			return;
+		}
+
+		auto folder = Overloaded{
+			[&](DeleteStatement *del) {
+				fold(del->index);
+			},
+			[&](FunctionStatement *function) {
+				fold(function->statements);
+			},
+			[&](BlockStatement *block) {
+				fold(block->statements);
+			},
+			[&](CondStatement *cond) {
+				fold(cond->cond);
+				fold(cond->body);
+				fold(cond->else_);
+			},
+			[&](LoopStatement *loop) {
+				fold(loop->init);
+				fold(loop->cond);
+				fold(loop->incr);
+				fold(loop->body);
+			},
+			[&](ForEachStatement *foreach) {
+				fold(foreach->container);
+				fold(foreach->body);
+			},
+			[&](ExpressionStatement *expr) {
+				fold(expr->expression);
+			},
+			[&](ReturnStatement *ret) {
+				fold(ret->expression);
+			},
+			[](auto) {},
+		};
+
+		ast_.visit(statement, folder);
+	}
+
+private:
+	// NOTE(eteran): a slot refers into a node or a list, neither of which is
+	// ever moved by folding, only new atoms are made
+	struct Task {
+		enum Step : uint8_t {
+			Visit,
+			Fold,
+			FoldChain,
+		};
+
+		ExpressionRef *slot;
+		Step step;
+	};
+
+	Ast &ast_;
+	std::vector<Task> tasks_;
+
+	// the links and operands of the chain being folded, see fold_chain
+	std::vector<BinaryExpression *> links_;
+	std::vector<ExpressionRef> operands_;
+
+	// the expressions left to look at, see integer and safe
+	std::vector<ExpressionRef> pending_;
+};
 
 /**
- * @brief fold
- * @param statement
+ * @brief Removes code which can never run from either form of the AST, Ast is
+ * one of PointerAst or FlatAst. This is meant to run after constant folding,
+ * which is what turns most conditions into constants
  */
-void fold(std::unique_ptr<Statement> &statement) {
+template <class Ast>
+class Eliminator {
+private:
+	using ExpressionRef = typename Ast::ExpressionRef;
+	using StatementRef  = typename Ast::StatementRef;
+	using StatementList = typename Ast::StatementList;
+
+	using AtomExpression = typename Ast::AtomExpression;
 
-	// NOTE(eteran): CondStatement, LoopStatement, ForEachStatement
+	using FunctionStatement = typename Ast::FunctionStatement;
+	using BlockStatement    = typename Ast::BlockStatement;
+	using CondStatement     = typename Ast::CondStatement;
+	using LoopStatement     = typename Ast::LoopStatement;
+	using ForEachStatement  = typename Ast::ForEachStatement;
+	using BreakStatement    = typename Ast::BreakStatement;
+	using ContinueStatement = typename Ast::ContinueStatement;
+	using ReturnStatement   = typename Ast::ReturnStatement;
 
-	Statement *p = statement.get();
-	if (auto block = dynamic_cast<BlockStatement *>(p)) {
-		fold_constant_expressions(block->statements);
-	} else if (auto expr = dynamic_cast<ExpressionStatement *>(p)) {
-		fold(expr->expression);
-	} else if (auto ret = dynamic_cast<ReturnStatement *>(p)) {
-		fold(ret->expression);
+public:
+	explicit Eliminator(Ast &ast) noexcept
+		: ast_(ast) {
 	}
+
+public:
+	/**
+	 * @brief eliminate
+	 * @param statements
+	 * @return true if control never reaches the end of the statements
+	 *
+	 * Removes the statements which are removed entirely, and those which
+	 * follow a statement that always transfers control elsewhere
+	 */
+	bool eliminate(StatementList &statements) {
+
+		auto list        = ast_.list(statements);
+		size_t size      = 0;
+		bool unreachable = false;
+
+		for (StatementRef statement : list) {
+
+			// NOTE(eteran): functions are defined when the macro is loaded, not
+			// when control reaches them, so they are never unreachable
+			if (unreachable && !ast_.template as<FunctionStatement>(statement)) {
+				continue;
+			}
+
+			if (eliminate(statement)) {
+				unreachable = true;
+			}
+
+			if (statement) {
+				list.begin()[size++] = statement;
+			}
+		}
+
+		ast_.truncate(statements, size);
+		return unreachable;
+	}
+
+private:
+	/**
+	 * @brief truth
+	 * @param expression
+	 * @return the value of a condition as NEdit tests it, if it is a constant
+	 * which converts cleanly to a number
+	 */
+	std::optional<bool> truth(ExpressionRef expression) {
+		if (auto atom = ast_.template as<AtomExpression>(expression)) {
+			if (auto n = to_number(ast_.text(atom->value), atom->type)) {
+				return *n != 0;
+			}
+		}
+
+		return {};
+	}
+
+	/**
+	 * @brief eliminate
+	 * @param statement receives what is left of the statement, which is null
+	 * if nothing is
+	 * @return true if control never continues past the statement
+	 */
+	bool eliminate(StatementRef &statement) {
+
+		if (!statement) {
+			return false;
+		}
+
+		auto eliminator = Overloaded{
+			[&](FunctionStatement *function) {
+				eliminate(function->statements);
+				return false;
+			},
+			[&](BlockStatement *block) {
+				return eliminate(block->statements);
+			},
+			[&](CondStatement *cond) {
+				if (const std::optional<bool> taken = truth(cond->cond)) {
+					statement = *taken ? cond->body : cond->else_;
+					return eliminate(statement);
+				}
+
+				const bool body_ends = eliminate(cond->body);
+				const bool else_ends = eliminate(cond->else_);
+				return body_ends && else_ends && cond->else_;
+			},
+			[&](LoopStatement *loop) {
+				// NOTE(eteran): the initializers of a loop which is never
+				// entered still run, so only the rest of it can go
+				if (loop->cond && truth(loop->cond) == false) {
+					if (ast_.list(loop->init).empty()) {
+						statement = StatementRef();
+						return false;
+					}
+
+					ast_.truncate(loop->incr, 0);
+					loop->body = StatementRef();
+					return false;
+				}
+
+				eliminate(loop->body);
+				return false;
+			},
+			[&](ForEachStatement *foreach) {
+				eliminate(foreach->body);
+				return false;
+			},
+			[](BreakStatement *) {
+				return true;
+			},
+			[](ContinueStatement *) {
+				return true;
+			},
+			[](ReturnStatement *) {
+				return true;
+			},
+			[](auto) {
+				return false;
+			},
+		};
+
+		return ast_.visit(statement, eliminator);
+	}
+
+private:
+	Ast &ast_;
+};
+
 }
 
+/**
+ * @brief fold_constant_expressions
+ * @param statements
+ */
+void fold_constant_expressions(Arena &arena, NodeList<Statement> &statements) {
+	PointerAst ast(arena);
+	Folder<PointerAst>(ast).fold(statements);
 }
 
 /**
  * @brief fold_constant_expressions
+ * @param ast
+ */
+void fold_constant_expressions(FlatAst &ast) {
+	Folder<FlatAst>(ast).fold(ast.statements());
+}
+
+/**
+ * @brief eliminate_dead_code
  * @param statements
  */
-void fold_constant_expressions(std::vector<std::unique_ptr<Statement>> &statements) {
+void eliminate_dead_code(NodeList<Statement> &statements) {
+	PointerAst ast;
+	Eliminator<PointerAst>(ast).eliminate(statements);
+}
 
-	for (std::unique_ptr<Statement> &statement : statements) {
-		fold(statement);
-	}
+/**
+ * @brief eliminate_dead_code
+ * @param ast
+ */
+void eliminate_dead_code(FlatAst &ast) {
+	Eliminator<FlatAst>(ast).eliminate(ast.statements());
 }
 
 /**
  * @brief prune_empty_statements
  * @param statements
  */
-void prune_empty_statements(std::vector<std::unique_ptr<Statement>> &statements) {
-	auto it = std::remove_if(statements.begin(), statements.end(), [](const std::unique_ptr<Statement> &stmt) {
-		if (auto expr = dynamic_cast<ExpressionStatement *>(stmt.get())) {
+void prune_empty_statements(NodeList<Statement> &statements) {
+	auto it = std::remove_if(statements.begin(), statements.end(), [](const Statement *stmt) {
+		if (auto expr = node_cast<ExpressionStatement>(stmt)) {
 			if (!expr->expression) {
 				return true;
 			}
@@ -193,4 +1173,25 @@ void prune_empty_statements(std::vector<std::unique_ptr<Statement>> &statements)
 	statements.erase(it, statements.end());
 }
 
+/**
+ * @brief prune_empty_statements
+ * @param ast
+ */
+void prune_empty_statements(FlatAst &ast) {
+	auto &statements = ast.statements();
+	auto list        = ast.list(statements);
+
+	auto it = std::remove_if(list.begin(), list.end(), [&ast](FlatAst::StatementRef stmt) {
+		if (auto expr = ast.as<FlatAst::ExpressionStatement>(stmt)) {
+			if (!expr->expression) {
+				return true;
+			}
+		}
+
+		return false;
+	});
+
+	statements.size = static_cast<FlatAst::Index>(it - list.begin());
+}
+
 }
@@ -2,14 +2,19 @@
 #ifndef OPTIMIZER_H_
 #define OPTIMIZER_H_
 
-#include <memory>
-#include <vector>
+#include "Arena.h"
+
+class FlatAst;
 class Statement;
 
 namespace Optimizer {
 
-void prune_empty_statements(std::vector<std::unique_ptr<Statement>> &statements);
-void fold_constant_expressions(std::vector<std::unique_ptr<Statement>> &statements);
+void prune_empty_statements(NodeList<Statement> &statements);
+void prune_empty_statements(FlatAst &ast);
+void fold_constant_expressions(Arena &arena, NodeList<Statement> &statements);
+void fold_constant_expressions(FlatAst &ast);
+void eliminate_dead_code(NodeList<Statement> &statements);
+void eliminate_dead_code(FlatAst &ast);
 
 }
 
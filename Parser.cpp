@@ -1,54 +1,228 @@
 
 #include "Parser.h"
+#include "Diagnostics.h"
 #include "Error.h"
 #include "Expression.h"
 #include "Statement.h"
+#include "ThreadPool.h"
 #include "Tokenizer.h"
-#include <memory>
+#include "Visitor.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <initializer_list>
+#include <iterator>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief how a token which follows an operand continues the expression
+ */
+struct BinaryOperator {
+	uint8_t precedence = 0; // 0 if the token doesn't continue the expression
+	Token::Type op     = Token::Invalid;
+	bool implicit      = false; // true if there is no operator token to consume
+};
+
+constexpr uint8_t LowestPrecedence = 1;
+
+/**
+ * @brief make_binary_operator_table
+ * @return a table of the binary operators, from loosest to tightest binding
+ *
+ * NOTE(eteran): every one of these is right associative, the code generator
+ * relies on chains of concatenations, && and || nesting to the right.
+ * Unary operators and ^ bind tighter than all of them, and are parsed by
+ * parseUnaryExpression and parsePowerExpression
+ */
+constexpr std::array<BinaryOperator, Token::Concatenate + 1> make_binary_operator_table() {
+	std::array<BinaryOperator, Token::Concatenate + 1> table = {};
+
+	uint8_t precedence = LowestPrecedence;
+
+	auto level = [&table, &precedence](std::initializer_list<Token::Type> types) {
+		for (Token::Type type : types) {
+			table[type] = BinaryOperator{precedence, type, false};
+		}
+
+		++precedence;
+	};
+
+	level({Token::Assign, Token::AddAssign, Token::SubAssign, Token::MulAssign, Token::DivAssign, Token::ModAssign});
+
+	// NOTE(eteran): concatenation has no operator, it is implied by an operand
+	// directly following another one, so the tokens which can start an operand
+	// are what introduce it
+	for (Token::Type type : {Token::LeftParen, Token::Identifier, Token::Integer, Token::String}) {
+		table[type] = BinaryOperator{precedence, Token::Concatenate, true};
+	}
+	++precedence;
+
+	level({Token::LogicalOr});
+	level({Token::LogicalAnd});
+	level({Token::BinaryOr});
+	level({Token::BinaryAnd});
+
+	// NOTE(eteran): according to NEDIT sources "in" shares priority with these
+	level({Token::In, Token::GreaterThan, Token::GreaterThanOrEqual, Token::LessThan, Token::LessThanOrEqual, Token::Equal, Token::NotEqual});
+	level({Token::Add, Token::Sub});
+	level({Token::Mul, Token::Div, Token::Mod});
+	return table;
+}
+
+constexpr auto binary_operators = make_binary_operator_table();
+
+/**
+ * @brief is_prefix_operator
+ * @param type
+ * @return true if type is one of the unary operators -, !, ++ or --
+ */
+constexpr bool is_prefix_operator(Token::Type type) {
+	return type == Token::Increment || type == Token::Decrement || type == Token::Sub || type == Token::Not;
+}
+
+/**
+ * @brief find_functions
+ * @param tokenizer a tokenized input
+ * @return the position of every define which isn't inside of braces
+ *
+ * NOTE(eteran): this only looks at the braces, it is up to the parser to
+ * decide whether they are where a function actually starts
+ */
+std::vector<size_t> find_functions(const Tokenizer &tokenizer) {
+
+	std::vector<size_t> functions;
+	size_t depth = 0;
+
+	for (size_t i = 0; i < tokenizer.size(); ++i) {
+		switch (tokenizer.at(i).type) {
+		case Token::LeftBrace:
+			++depth;
+			break;
+		case Token::RightBrace:
+			// NOTE(eteran): a stray closing brace is a syntax error which the
+			// parser will report, just don't let it wrap around
+			if (depth != 0) {
+				--depth;
+			}
+			break;
+		case Token::Define:
+			if (depth == 0) {
+				functions.push_back(i);
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	return functions;
+}
+
+}
 
 /**
  * @brief Parser::Parser
+ * @param filename
+ * @param arena where the AST nodes will be allocated
  */
-Parser::Parser(const std::string &filename)
-	: tokenizer_(filename) {
+Parser::Parser(const std::string &filename, Arena &arena)
+	: own_tokenizer_(std::make_unique<Tokenizer>(filename)), tokenizer_(*own_tokenizer_), arena_(arena) {
 }
 
 /**
- * @brief Parser::peekToken
- * @return
+ * @brief Parser::Parser
+ * @param parent the parser whose (already tokenized) input to read
+ * @param arena where the AST nodes will be allocated
+ * @param position where in the parent's input to start reading
  */
-Token Parser::peekToken() const {
-	if (index_ < tokenizer_.size()) {
-		return tokenizer_[index_];
+Parser::Parser(Parser &parent, Arena &arena, size_t position)
+	: tokenizer_(parent.tokenizer_), arena_(arena), shared_(true), position_(position) {
+}
+
+/**
+ * @brief Parser::tokenize
+ * @param threads
+ *
+ * Lexes the whole input up front using up to threads workers, instead of
+ * tokenizing on demand as the parser asks for tokens
+ */
+void Parser::tokenize(size_t threads) {
+	tokenizer_.tokenize(threads);
+}
+
+/**
+ * @brief Parser::nextToken
+ * @return the next token as it is, which may be an Error token
+ */
+const Token &Parser::nextToken() {
+	if (shared_) {
+		return tokenizer_.at(position_);
 	}
 
-	return Token();
+	return tokenizer_.peek();
 }
 
 /**
- * @brief Parser::readToken
- * @return
+ * @brief Parser::skipToken
+ *
+ * Consumes the next token, unless we are at the end of the input
  */
-Token Parser::readToken() {
-	Token token = peekToken();
+void Parser::skipToken() {
+	if (shared_) {
+		if (tokenizer_.at(position_).type != Token::Invalid) {
+			++position_;
+		}
 
-	if (token.type != Token::Invalid) {
-		++index_;
+		return;
 	}
 
-	return token;
+	tokenizer_.read();
+}
+
+/**
+ * @brief Parser::rejectToken
+ *
+ * Consumes the next token, which couldn't be lexed, and throws the error
+ * that lexing it gave
+ */
+void Parser::rejectToken() {
+	const Token token = nextToken();
+	skipToken();
+	tokenizer_.throw_error(token);
+}
+
+/**
+ * @brief Parser::text
+ * @param token
+ * @return
+ */
+std::string_view Parser::text(const Token &token) const {
+	return tokenizer_.text(token);
+}
+
+/**
+ * @brief Parser::location
+ * @param index
+ * @return
+ */
+Reader::Location Parser::location(size_t index) const {
+	return tokenizer_.location(index);
 }
 
 /**
  * @brief Parser::parseForStatement
  * @return
  */
-std::unique_ptr<Statement> Parser::parseForStatement() {
+Statement *Parser::parseForStatement() {
 
 	consumeRequired<SyntaxError>(Token::For);
 	consumeRequired<MissingOpenParen>(Token::LeftParen);
 
-	std::vector<std::unique_ptr<Expression>> init_exprs = parseExpressionList();
+	NodeList<Expression> init_exprs = parseExpressionList();
 
 	if (peekToken().type == Token::Semicolon) {
 		// standard C-style FOR loop
@@ -60,7 +234,7 @@ std::unique_ptr<Statement> Parser::parseForStatement() {
 
 		consumeRequired<MissingSemicolon>(Token::Semicolon);
 
-		std::vector<std::unique_ptr<Expression>> incr_exprs = parseExpressionList();
+		NodeList<Expression> incr_exprs = parseExpressionList();
 
 		consumeRequired<MissingClosingParen>(Token::RightParen);
 
@@ -71,11 +245,11 @@ std::unique_ptr<Statement> Parser::parseForStatement() {
 
 		auto body = parseStatement();
 
-		auto loop  = std::make_unique<LoopStatement>();
-		loop->body = std::move(body);
-		loop->init = std::move(init_exprs);
-		loop->incr = std::move(incr_exprs);
-		loop->cond = std::move(cond);
+		auto loop  = arena_.make<LoopStatement>();
+		loop->body = body;
+		loop->init = init_exprs;
+		loop->incr = incr_exprs;
+		loop->cond = cond;
 
 		return loop;
 	}
@@ -83,10 +257,10 @@ std::unique_ptr<Statement> Parser::parseForStatement() {
 	// if we didn't get a semicolon, then we better have a "if(x in y)" expression
 	if (init_exprs.size() == 1) {
 		auto &init = init_exprs[0];
-		if (BinaryExpression *expr = dynamic_cast<BinaryExpression *>(init.get())) {
+		if (BinaryExpression *expr = node_cast<BinaryExpression>(init)) {
 			if (expr->op == Token::In) {
-				auto container = std::move(expr->rhs);
-				auto iterator  = std::move(expr->lhs);
+				auto container = expr->rhs;
+				auto iterator  = expr->lhs;
 
 				consumeRequired<MissingClosingParen>(Token::RightParen);
 
@@ -96,10 +270,10 @@ std::unique_ptr<Statement> Parser::parseForStatement() {
 				}
 				auto body = parseStatement();
 
-				auto loop       = std::make_unique<ForEachStatement>();
-				loop->iterator  = std::move(iterator);
-				loop->container = std::move(container);
-				loop->body      = std::move(body);
+				auto loop       = arena_.make<ForEachStatement>();
+				loop->iterator  = iterator;
+				loop->container = container;
+				loop->body      = body;
 
 				return loop;
 			}
@@ -113,7 +287,7 @@ std::unique_ptr<Statement> Parser::parseForStatement() {
  * @brief Parser::parseIfStatement
  * @return
  */
-std::unique_ptr<CondStatement> Parser::parseIfStatement() {
+CondStatement *Parser::parseIfStatement() {
 
 	consumeRequired<SyntaxError>(Token::If);
 	consumeRequired<MissingOpenParen>(Token::LeftParen);
@@ -129,9 +303,9 @@ std::unique_ptr<CondStatement> Parser::parseIfStatement() {
 
 	auto body = parseStatement();
 
-	auto cond  = std::make_unique<CondStatement>();
-	cond->body = std::move(body);
-	cond->cond = std::move(condition);
+	auto cond  = arena_.make<CondStatement>();
+	cond->body = body;
+	cond->cond = condition;
 
 	// consume any newlines
 	while (peekToken().type == Token::Newline) {
@@ -156,40 +330,40 @@ std::unique_ptr<CondStatement> Parser::parseIfStatement() {
  * @brief parseBreakStatement
  * @return
  */
-std::unique_ptr<BreakStatement> Parser::parseBreakStatement() {
+BreakStatement *Parser::parseBreakStatement() {
 
 	consumeRequired<SyntaxError>(Token::Break);
 	consumeRequired<MissingNewline>(Token::Newline);
 
-	return std::make_unique<BreakStatement>();
+	return arena_.make<BreakStatement>();
 }
 
 /**
  * @brief parseContinueStatement
  * @return
  */
-std::unique_ptr<ContinueStatement> Parser::parseContinueStatement() {
+ContinueStatement *Parser::parseContinueStatement() {
 
 	consumeRequired<SyntaxError>(Token::Continue);
 	consumeRequired<MissingNewline>(Token::Newline);
 
-	return std::make_unique<ContinueStatement>();
+	return arena_.make<ContinueStatement>();
 }
 
 /**
  * @brief Parser::parseDeleteStatement
  * @return
  */
-std::unique_ptr<DeleteStatement> Parser::parseDeleteStatement() {
+DeleteStatement *Parser::parseDeleteStatement() {
 
 	consumeRequired<SyntaxError>(Token::Delete);
 
 	auto expr = parseExpression();
 
-	if (auto indexExpression = dynamic_cast<ArrayIndexExpression *>(expr.get())) {
-		auto stmt        = std::make_unique<DeleteStatement>();
-		stmt->expression = std::move(indexExpression->array);
-		stmt->index      = std::move(indexExpression->index);
+	if (auto indexExpression = node_cast<ArrayIndexExpression>(expr)) {
+		auto stmt        = arena_.make<DeleteStatement>();
+		stmt->expression = indexExpression->array;
+		stmt->index      = indexExpression->index;
 
 		return stmt;
 	}
@@ -201,13 +375,13 @@ std::unique_ptr<DeleteStatement> Parser::parseDeleteStatement() {
  * @brief Parser::parseReturnStatement
  * @return
  */
-std::unique_ptr<ReturnStatement> Parser::parseReturnStatement() {
+ReturnStatement *Parser::parseReturnStatement() {
 
 	consumeRequired<SyntaxError>(Token::Return);
 
 	auto expr       = parseExpression();
-	auto ret        = std::make_unique<ReturnStatement>();
-	ret->expression = std::move(expr);
+	auto ret        = arena_.make<ReturnStatement>();
+	ret->expression = expr;
 
 	return ret;
 }
@@ -216,11 +390,11 @@ std::unique_ptr<ReturnStatement> Parser::parseReturnStatement() {
  * @brief Parser::parseExpressionStatement
  * @return
  */
-std::unique_ptr<ExpressionStatement> Parser::parseExpressionStatement() {
+ExpressionStatement *Parser::parseExpressionStatement() {
 
 	if (auto expression = parseExpression()) {
-		auto statement        = std::make_unique<ExpressionStatement>();
-		statement->expression = std::move(expression);
+		auto statement        = arena_.make<ExpressionStatement>();
+		statement->expression = expression;
 
 		consumeRequired<MissingNewline>(Token::Newline);
 
@@ -239,7 +413,7 @@ std::unique_ptr<ExpressionStatement> Parser::parseExpressionStatement() {
  * @brief Parser::parseEmptyStatement
  * @return
  */
-std::unique_ptr<ExpressionStatement> Parser::parseEmptyStatement() {
+ExpressionStatement *Parser::parseEmptyStatement() {
 	// empty expression
 
 	consumeRequired<MissingNewline>(Token::Newline);
@@ -249,14 +423,14 @@ std::unique_ptr<ExpressionStatement> Parser::parseEmptyStatement() {
 		readToken();
 	}
 
-	return std::make_unique<ExpressionStatement>();
+	return arena_.make<ExpressionStatement>();
 }
 
 /**
  * @brief Parser::parseWhileStatement
  * @return
  */
-std::unique_ptr<LoopStatement> Parser::parseWhileStatement() {
+LoopStatement *Parser::parseWhileStatement() {
 
 	consumeRequired<SyntaxError>(Token::While);
 	consumeRequired<MissingOpenParen>(Token::LeftParen);
@@ -272,9 +446,9 @@ std::unique_ptr<LoopStatement> Parser::parseWhileStatement() {
 
 	auto body = parseStatement();
 
-	auto loop  = std::make_unique<LoopStatement>();
-	loop->body = std::move(body);
-	loop->cond = std::move(condition);
+	auto loop  = arena_.make<LoopStatement>();
+	loop->body = body;
+	loop->cond = condition;
 
 	return loop;
 }
@@ -283,18 +457,24 @@ std::unique_ptr<LoopStatement> Parser::parseWhileStatement() {
  * @brief Parser::parseBlockStatement
  * @return
  */
-std::unique_ptr<BlockStatement> Parser::parseBlockStatement() {
+BlockStatement *Parser::parseBlockStatement() {
 
 	consumeRequired<MissingOpenBrace>(Token::LeftBrace);
 
-	auto block = std::make_unique<BlockStatement>();
+	auto block = arena_.make<BlockStatement>();
 
-	while (peekToken().type != Token::RightBrace) {
-		block->statements.push_back(parseStatement());
+	std::vector<Statement *> statements;
+	Statement *statement;
+	while (parseNextStatement(true, statement)) {
+		if (statement) {
+			statements.push_back(statement);
+		}
 	}
 
 	consumeRequired<MissingClosingBrace>(Token::RightBrace);
 
+	block->statements = arena_.make_list(statements);
+
 	return block;
 }
 
@@ -302,7 +482,7 @@ std::unique_ptr<BlockStatement> Parser::parseBlockStatement() {
  * @brief Parser::parseFunction
  * @return
  */
-std::unique_ptr<FunctionStatement> Parser::parseFunctionStatement() {
+FunctionStatement *Parser::parseFunctionStatement() {
 
 	consumeRequired<SyntaxError>(Token::Define);
 
@@ -312,21 +492,24 @@ std::unique_ptr<FunctionStatement> Parser::parseFunctionStatement() {
 
 	in_function_ = true;
 
-	Token name = readToken();
+	// NOTE(eteran): a copy, since we need the name after reading the body
+	const Token name = peekToken();
 	if (name.type != Token::Identifier) {
 		throw MissingIdentifier(name);
 	}
 
+	readToken();
+
 	// consume any newlines
 	while (peekToken().type == Token::Newline) {
 		readToken();
 	}
 
-	std::unique_ptr<BlockStatement> body = parseBlockStatement();
-	auto function                        = std::make_unique<FunctionStatement>();
+	BlockStatement *body = parseBlockStatement();
+	auto function        = arena_.make<FunctionStatement>();
 
-	function->name       = name.value;
-	function->statements = std::move(body->statements);
+	function->name       = arena_.copy(text(name));
+	function->statements = body->statements;
 
 	in_function_ = false;
 
@@ -337,9 +520,9 @@ std::unique_ptr<FunctionStatement> Parser::parseFunctionStatement() {
  * @brief Parser::parseStatement
  * @return
  */
-std::unique_ptr<Statement> Parser::parseStatement() {
+Statement *Parser::parseStatement() {
 
-	Token token = peekToken();
+	const Token &token = peekToken();
 
 	switch (token.type) {
 	default:
@@ -384,486 +567,740 @@ std::unique_ptr<Statement> Parser::parseStatement() {
 }
 
 /**
- * @brief Parser::parseExpression
- * @return
+ * @brief a run of tokens which starts on a statement boundary, and what
+ * parsing it produced
  */
-std::unique_ptr<Expression> Parser::parseExpression() {
-
-	std::unique_ptr<Expression> expr;
-	parseExpression0(expr);
-	return expr;
-}
+struct Parser::Part {
+	size_t first = 0;
+	size_t last  = 0;
+	size_t end   = 0; // where parsing stopped, equal to last if it stopped on a boundary
+	std::vector<Statement *> statements;
+	std::vector<size_t> starts;
+	std::exception_ptr error;
+	Diagnostics diagnostics;
+};
 
 /**
- * @brief Parser::parseExpression0
- * @param exp
+ * @brief Parser::parseStatements
+ * @param threads
+ * @return every statement in the input
+ *
+ * With more than one thread, the input is tokenized up front and split into
+ * a few parts per thread, just before top level function definitions, which
+ * are then parsed concurrently (see parseConcurrently). Either way, the result
+ * and any error reported are the same as for parsing one statement at a time.
+ *
+ * If the input has already been tokenized, it is parsed again from the top
  */
-void Parser::parseExpression0(std::unique_ptr<Expression> &exp) {
+const std::vector<Statement *> &Parser::parseStatements(size_t threads) {
+
+	statements_.clear();
+	starts_.clear();
+
+	try {
+		if (threads > 1 && !tokenizer_.tokenized()) {
+			tokenize(threads);
+		}
 
-	// =, +=, -=. *=, /=, %=
+		if (tokenizer_.tokenized()) {
+			tokenizer_.seek(0);
+		}
 
-	parseExpression1(exp);
+		in_function_ = false;
 
-	Token op = peekToken();
+		if (threads > 1) {
+			const std::vector<size_t> functions = find_functions(tokenizer_);
 
-	if (op.type == Token::Assign || op.type == Token::AddAssign || op.type == Token::SubAssign || op.type == Token::MulAssign || op.type == Token::DivAssign || op.type == Token::ModAssign) {
+			// NOTE(eteran): macro libraries tend to be a few huge functions and many
+			// tiny ones, so parts are made of whole functions, of about equal size
+			const size_t size   = tokenizer_.size();
+			const size_t target = size / (threads * 4) + 1;
 
-		op = readToken();
+			std::vector<Part> parts(1);
 
-		auto bin = std::make_unique<BinaryExpression>();
+			for (size_t function : functions) {
+				if (function - parts.back().first >= target) {
+					parts.back().last = function;
+					parts.emplace_back();
+					parts.back().first = function;
+				}
+			}
 
-		bin->lhs = std::move(exp);
-		bin->op  = op.type;
+			parts.back().last = size;
 
-		// parse the RHS expression
-		parseExpression0(bin->rhs);
+			if (parts.size() > 1) {
+				parseConcurrently(parts, threads);
+				return statements_;
+			}
+		}
 
-		exp = std::move(bin);
-		op  = peekToken();
+		parseRemaining();
+	} catch (...) {
+		statements_.clear();
+		starts_.clear();
+		throw;
 	}
+
+	return statements_;
 }
 
 /**
- * @brief Parser::parseExpression1
- * @param exp
+ * @brief Parser::parseStatements
+ * @param threads
+ * @param diagnostics receives every error found in the input
+ * @return every statement in the input which could be parsed
+ *
+ * Like parseStatements(threads), except that errors don't stop the parse. A
+ * statement which fails to parse is recorded in diagnostics and skipped (see
+ * synchronize), and parsing carries on with the next one, so a single pass
+ * finds every error rather than just the first. The first one found is the
+ * error which parseStatements(threads) would have thrown
  */
-void Parser::parseExpression1(std::unique_ptr<Expression> &exp) {
+const std::vector<Statement *> &Parser::parseStatements(size_t threads, Diagnostics &diagnostics) {
 
-	// (concatenation)
-	// NOTE(eteran): this "operator when there is no operator" is a very poor
-	// design choice IMO, and requires a bit of hackyness to do correctly :-(
-	// it would have been much better if they did something like: "hello " . "world"
-	// (using something like a dot operator to mean concat, avoid + makes sense
-	// since integers and strings get implicitly converted between each other)
+	diagnostics_ = &diagnostics;
 
-	parseExpression2(exp);
-
-	Token op = peekToken();
-	while (op.type == Token::LeftParen || op.type == Token::Identifier || op.type == Token::Integer || op.type == Token::String) {
-		// NOTE(eteran): NOT a readToken() like the rest, since there is no actual operator in the code!
-		// op = readToken();
+	try {
+		parseStatements(threads);
+	} catch (...) {
+		diagnostics_ = nullptr;
+		throw;
+	}
 
-		auto bin = std::make_unique<BinaryExpression>();
+	diagnostics_ = nullptr;
+	return statements_;
+}
 
-		bin->lhs = std::move(exp);
-		bin->op  = Token::Concatenate;
+/**
+ * @brief Parser::parseRemaining
+ *
+ * Parses statements from the current position up to the end of the input
+ */
+void Parser::parseRemaining() {
+	while (true) {
+		const size_t start = tokenizer_.position();
 
-		// parse the RHS expression
-		parseExpression1(bin->rhs);
+		Statement *statement;
+		if (!parseNextStatement(false, statement)) {
+			break;
+		}
 
-		exp = std::move(bin);
-		op  = peekToken();
+		if (statement) {
+			statements_.push_back(statement);
+			starts_.push_back(start);
+		}
 	}
 }
 
 /**
- * @brief Parser::parseExpression2
- * @param exp
+ * @brief Parser::parseNextStatement
+ * @param in_block true if the statement is inside of braces, which the
+ * closing brace ends as well as the end of the input
+ * @param statement receives the statement, or nullptr if it was skipped
+ * @return false once there are no more statements
+ *
+ * While collecting diagnostics, a statement which fails to parse is reported
+ * and skipped, otherwise the error is thrown
  */
-void Parser::parseExpression2(std::unique_ptr<Expression> &exp) {
-	// ||
-
-	parseExpression3(exp);
+bool Parser::parseNextStatement(bool in_block, Statement *&statement) {
 
-	Token op = peekToken();
+	statement = nullptr;
 
-	while (op.type == Token::LogicalOr) {
+	try {
+		const Token::Type type = peekToken().type;
+		if (type == Token::Invalid || (in_block && type == Token::RightBrace)) {
+			return false;
+		}
 
-		op = readToken();
+		statement = parseStatement();
+		return true;
+	} catch (const SyntaxError &ex) {
+		if (!diagnostics_) {
+			throw;
+		}
 
-		auto bin = std::make_unique<BinaryExpression>();
+		diagnostics_->report(ex);
+	} catch (const TokenizationError &ex) {
+		if (!diagnostics_) {
+			throw;
+		}
 
-		bin->lhs = std::move(exp);
-		bin->op  = op.type;
+		diagnostics_->report(ex);
+	}
 
-		// parse the RHS expression
-		parseExpression2(bin->rhs);
+	synchronize(in_block);
 
-		exp = std::move(bin);
-		op  = peekToken();
+	// NOTE(eteran): at the top level, the statement we skipped may have been a
+	// function which never got to its end
+	if (!in_block) {
+		in_function_ = false;
 	}
+
+	return true;
 }
 
 /**
- * @brief Parser::parseExpression3
- * @param exp
+ * @brief Parser::synchronize
+ * @param in_block true if the statement which failed is inside of braces
+ *
+ * Skips what is left of a statement which failed to parse: up to the next
+ * newline which isn't inside of braces opened since, consuming it and any
+ * blank lines which follow, or up to the brace which closes the enclosing
+ * block. Tokens which couldn't be lexed are still reported along the way
  */
-void Parser::parseExpression3(std::unique_ptr<Expression> &exp) {
-	// &&
-
-	parseExpression4(exp);
-
-	Token op = peekToken();
+void Parser::synchronize(bool in_block) {
 
-	while (op.type == Token::LogicalAnd) {
+	size_t depth = 0;
 
-		op = readToken();
-
-		auto bin = std::make_unique<BinaryExpression>();
-
-		bin->lhs = std::move(exp);
-		bin->op  = op.type;
+	while (true) {
+		const Token &token = nextToken();
+
+		switch (token.type) {
+		case Token::Invalid:
+			return;
+		case Token::Newline:
+			if (depth == 0) {
+				while (nextToken().type == Token::Newline) {
+					skipToken();
+				}
+				return;
+			}
+			break;
+		case Token::LeftBrace:
+			++depth;
+			break;
+		case Token::RightBrace:
+			if (depth == 0 && in_block) {
+				return;
+			}
 
-		// parse the RHS expression
-		parseExpression3(bin->rhs);
+			// NOTE(eteran): at the top level, a stray closing brace is simply
+			// more of the statement which failed
+			if (depth != 0) {
+				--depth;
+			}
+			break;
+		case Token::Error:
+			try {
+				tokenizer_.throw_error(token);
+			} catch (const TokenizationError &ex) {
+				diagnostics_->report(ex);
+			}
+			break;
+		default:
+			break;
+		}
 
-		exp = std::move(bin);
-		op  = peekToken();
+		skipToken();
 	}
 }
 
 /**
- * @brief Parser::parseExpression4
- * @param exp
+ * @brief Parser::parseConcurrently
+ * @param parts consecutive runs of tokens, covering the whole input
+ * @param threads
+ *
+ * Each part is parsed on its own thread, into its own arena, by a parser
+ * which reads the shared tokens. Those parsers see the tokens which follow
+ * their part too, so a part which starts on a statement boundary yields
+ * exactly what parsing serially would have, up to the first statement that
+ * ends on or after the end of the part. The first part starts at the top of
+ * the input, and if it (and so each of them in turn) ends on a boundary, then
+ * the next one starts on one. If a part doesn't, the pre-scan guessed wrong
+ * (say, a define which is the body of an if), and we carry on serially from
+ * wherever it did stop. Errors are reported from the first part which failed,
+ * the same error that parsing serially would have reported. Likewise, when
+ * collecting diagnostics, each part collects its own and they are merged in
+ * order, only up to the part where we carry on serially.
  */
-void Parser::parseExpression4(std::unique_ptr<Expression> &exp) {
-	// |
+void Parser::parseConcurrently(std::vector<Part> &parts, size_t threads) {
+
+	std::vector<Arena> arenas(parts.size());
+
+	{
+		ThreadPool pool(threads);
+		std::vector<std::future<void>> results;
 
-	parseExpression5(exp);
+		for (size_t i = 0; i < parts.size(); ++i) {
+			results.push_back(pool.submit([this, &parts, &arenas, i]() {
+				Parser parser(*this, arenas[i], parts[i].first);
+				if (diagnostics_) {
+					parser.diagnostics_ = &parts[i].diagnostics;
+				}
 
-	Token op = peekToken();
+				parser.parsePart(parts[i]);
+			}));
+		}
 
-	while (op.type == Token::BinaryOr) {
+		for (std::future<void> &result : results) {
+			result.get();
+		}
+	}
 
-		op = readToken();
+	for (size_t i = 0; i < parts.size(); ++i) {
+		Part &part = parts[i];
 
-		auto bin = std::make_unique<BinaryExpression>();
+		if (part.error) {
+			std::rethrow_exception(part.error);
+		}
 
-		bin->lhs = std::move(exp);
-		bin->op  = op.type;
+		if (diagnostics_) {
+			diagnostics_->append(part.diagnostics);
+		}
 
-		// parse the RHS expression
-		parseExpression4(bin->rhs);
+		statements_.insert(statements_.end(), part.statements.begin(), part.statements.end());
+		starts_.insert(starts_.end(), part.starts.begin(), part.starts.end());
+		arena_.splice(arenas[i]);
 
-		exp = std::move(bin);
-		op  = peekToken();
+		if (part.end != part.last) {
+			tokenizer_.seek(part.end);
+			parseRemaining();
+			return;
+		}
 	}
+
+	tokenizer_.seek(tokenizer_.size());
 }
 
 /**
- * @brief Parser::parseExpression5
- * @param exp
+ * @brief Parser::parsePart
+ * @param part
+ *
+ * Parses statements until reaching (or passing) the end of the part
  */
-void Parser::parseExpression5(std::unique_ptr<Expression> &exp) {
-	// &
-
-	parseExpression6(exp);
-
-	Token op = peekToken();
+void Parser::parsePart(Part &part) {
+	try {
+		while (position_ < part.last) {
+			const size_t start = position_;
+
+			Statement *statement;
+			if (!parseNextStatement(false, statement)) {
+				break;
+			}
 
-	while (op.type == Token::BinaryAnd) {
+			if (statement) {
+				part.statements.push_back(statement);
+				part.starts.push_back(start);
+			}
+		}
+	} catch (...) {
+		part.error = std::current_exception();
+	}
 
-		op = readToken();
+	part.end = position_;
+}
 
-		auto bin = std::make_unique<BinaryExpression>();
+/**
+ * @brief Parser::reparse
+ * @param offset where the edit starts
+ * @param removed how many characters to remove, starting at offset
+ * @param inserted the text to insert in their place
+ * @return every statement in the edited input
+ *
+ * Applies an edit to the input, and reparses only the top level statements
+ * (typically whole functions) which the edit may have changed, the others
+ * are reused as is. Input which was parsed one token at a time is tokenized
+ * first (see Tokenizer::edit), its statements start at the same positions.
+ *
+ * Parsing a statement looks at its own tokens and at the first token of the
+ * next one, so we start over with the first statement which looked at one of
+ * the tokens that the edit replaced. From there, statements are parsed until
+ * one ends where an old statement which followed the replaced tokens started,
+ * since the tokens from there on, and so the statements, are as they were.
+ *
+ * NOTE(eteran): the statements which were replaced stay in the arena until it
+ * is reset. If the parse fails, the error is thrown (diagnostics aren't
+ * collected here), and the next reparse will parse the whole input
+ */
+const std::vector<Statement *> &Parser::reparse(size_t offset, size_t removed, std::string_view inserted) {
 
-		bin->lhs = std::move(exp);
-		bin->op  = op.type;
+	const std::vector<Statement *> statements = std::move(statements_);
+	const std::vector<size_t> starts          = std::move(starts_);
 
-		// parse the RHS expression
-		parseExpression5(bin->rhs);
+	statements_.clear();
+	starts_.clear();
 
-		exp = std::move(bin);
-		op  = peekToken();
-	}
-}
+	try {
+		const Tokenizer::Change change = tokenizer_.edit(offset, removed, inserted);
 
-/**
- * @brief Parser::parseExpression6
- * @param exp
- */
-void Parser::parseExpression6(std::unique_ptr<Expression> &exp) {
-	// >=, >, <, <=, ==, !=, in
+		// NOTE(eteran): statement i looked at the tokens up to and including
+		// starts[i + 1], so the first one to redo is the one before the first
+		// statement which starts at or after the first replaced token
+		const auto next    = std::lower_bound(starts.begin(), starts.end(), change.first);
+		const size_t first = next == starts.begin() ? 0 : static_cast<size_t>(std::distance(starts.begin(), next)) - 1;
 
-	// NOTE(eteran): according to NEDIT sources "in" shares priority with these
+		statements_.assign(statements.begin(), statements.begin() + first);
+		starts_.assign(starts.begin(), starts.begin() + first);
 
-	parseExpression7(exp);
+		// the first of the old statements which we may be able to reuse
+		auto reusable = std::lower_bound(starts.begin() + first, starts.end(), change.first + change.removed);
 
-	Token op = peekToken();
+		auto shifted = [&change](size_t start) {
+			return start - change.removed + change.inserted;
+		};
 
-	while (op.type == Token::In || op.type == Token::GreaterThan || op.type == Token::GreaterThanOrEqual || op.type == Token::LessThan || op.type == Token::LessThanOrEqual || op.type == Token::Equal || op.type == Token::NotEqual) {
+		in_function_ = false;
+		tokenizer_.seek(first < starts.size() ? starts[first] : 0);
 
-		op = readToken();
+		while (true) {
+			const size_t start = tokenizer_.position();
 
-		auto bin = std::make_unique<BinaryExpression>();
+			while (reusable != starts.end() && shifted(*reusable) < start) {
+				++reusable;
+			}
 
-		bin->lhs = std::move(exp);
-		bin->op  = op.type;
+			if (reusable != starts.end() && shifted(*reusable) == start) {
+				const auto i = std::distance(starts.begin(), reusable);
+				statements_.insert(statements_.end(), statements.begin() + i, statements.end());
+				std::transform(reusable, starts.end(), std::back_inserter(starts_), shifted);
+				break;
+			}
 
-		// parse the RHS expression
-		parseExpression6(bin->rhs);
+			Statement *statement = parseStatement();
+			if (!statement) {
+				break;
+			}
 
-		exp = std::move(bin);
-		op  = peekToken();
+			statements_.push_back(statement);
+			starts_.push_back(start);
+		}
+	} catch (...) {
+		statements_.clear();
+		starts_.clear();
+		throw;
 	}
+
+	return statements_;
 }
 
 /**
- * @brief Parser::parseExpression7
- * @param exp
+ * @brief Parser::parseExpression
+ * @return
  */
-void Parser::parseExpression7(std::unique_ptr<Expression> &exp) {
-	// +, -
-
-	parseExpression8(exp);
-
-	Token op = peekToken();
-
-	while (op.type == Token::Add || op.type == Token::Sub) {
-		op = readToken();
+Expression *Parser::parseExpression() {
 
-		auto bin = std::make_unique<BinaryExpression>();
+	Expression *expr = nullptr;
 
-		bin->lhs = std::move(exp);
-		bin->op  = op.type;
+	beginExpression();
+	pushFrame(ExpressionFrame::Binary, &expr, LowestPrecedence);
+	parseFrames();
+	return expr;
+}
 
-		// parse the RHS expression
-		parseExpression7(bin->rhs);
+/**
+ * @brief Parser::parseExpressionList
+ * @return
+ */
+NodeList<Expression> Parser::parseExpressionList() {
 
-		exp = std::move(bin);
-		op  = peekToken();
-	}
+	beginExpression();
+	pushFrame(ExpressionFrame::List, nullptr);
+	parseFrames();
+	return list_;
 }
 
 /**
- * @brief Parser::parseExpression8
- * @param exp
+ * @brief Parser::beginExpression
+ *
+ * Discards anything left over from an expression which failed to parse
  */
-void Parser::parseExpression8(std::unique_ptr<Expression> &exp) {
-	// *, /, %
-
-	parseExpression9(exp);
+void Parser::beginExpression() {
+	frames_.clear();
+	list_items_.clear();
+}
 
-	Token op = peekToken();
-	while (op.type == Token::Mul || op.type == Token::Div || op.type == Token::Mod) {
-		op = readToken();
+/**
+ * @brief Parser::pushFrame
+ * @param state where to start parsing
+ * @param slot where to store the expression
+ * @param precedence the lowest precedence of binary operator to accept
+ */
+void Parser::pushFrame(ExpressionFrame::State state, Expression **slot, uint8_t precedence) {
+	ExpressionFrame frame;
+	frame.state      = state;
+	frame.precedence = precedence;
+	frame.first      = static_cast<uint32_t>(list_items_.size());
+	frame.slot       = slot;
+	frames_.push_back(frame);
+}
 
-		auto bin = std::make_unique<BinaryExpression>();
+/**
+ * @brief Parser::parseFrames
+ *
+ * Parses expressions using an explicit stack of frames rather than recursion,
+ * so that neither long chains of operators nor deeply nested expressions can
+ * exhaust the native stack. Each frame is what would have been a call to one
+ * of the parsing functions, its state says where in that function it is.
+ *
+ * NOTE(eteran): pushing a frame may move the others, so no reference to a
+ * frame is used after pushing another one
+ */
+void Parser::parseFrames() {
+
+	while (!frames_.empty()) {
+		ExpressionFrame &frame = frames_.back();
+		Expression **slot      = frame.slot;
+
+		switch (frame.state) {
+		case ExpressionFrame::Binary:
+			// NOTE(eteran): an operand without a prefix operator is by far the
+			// most common case, so rather than push a frame for the unary
+			// level, this frame applies any postfix operators itself
+			if (is_prefix_operator(peekToken().type)) {
+				frame.state = ExpressionFrame::BinaryOperator;
+				pushFrame(ExpressionFrame::Unary, slot);
+			} else {
+				frame.state = ExpressionFrame::Operand;
+				pushFrame(ExpressionFrame::Primary, slot);
+			}
+			break;
 
-		bin->lhs = std::move(exp);
-		bin->op  = op.type;
+		case ExpressionFrame::Operand:
+			parsePostfix(*slot);
+			frame.state = ExpressionFrame::BinaryOperator;
+			[[fallthrough]];
 
-		// parse the RHS expression
-		parseExpression8(bin->rhs);
+		case ExpressionFrame::BinaryOperator: {
+			const BinaryOperator &entry = binary_operators[peekToken().type];
+			if (entry.precedence < frame.precedence) {
+				frames_.pop_back();
+				break;
+			}
 
-		exp = std::move(bin);
-		op  = peekToken();
-	}
-}
+			if (!entry.implicit) {
+				readToken();
+			}
 
-/**
- * @brief Parser::parseExpression9
- * @param exp
- */
-void Parser::parseExpression9(std::unique_ptr<Expression> &exp) {
+			auto bin = arena_.make<BinaryExpression>();
+
+			bin->lhs = *slot;
+			bin->op  = entry.op;
+			*slot    = bin;
+
+			// NOTE(eteran): the RHS consumes every operator with at least its
+			// precedence, so when that is also the lowest that this frame will
+			// accept, there is nothing left for this frame to do once the RHS
+			// is parsed and it can be reused for the RHS. This keeps a chain
+			// of the same operator down to a single frame
+			if (entry.precedence == frame.precedence) {
+				frame.state = ExpressionFrame::Binary;
+				frame.slot  = &bin->rhs;
+			} else {
+				pushFrame(ExpressionFrame::Binary, &bin->rhs, entry.precedence);
+			}
+			break;
+		}
 
-	// -, !, ++, -- (unary)
-	Token op = peekToken();
-	while (op.type == Token::Increment || op.type == Token::Decrement || op.type == Token::Sub || op.type == Token::Not) {
-		op = readToken();
+		case ExpressionFrame::Unary: {
+			// -, !, ++, -- (unary)
+			const Token::Type op = peekToken().type;
+			if (is_prefix_operator(op)) {
+				readToken();
 
-		auto unary = std::make_unique<UnaryExpression>();
+				auto unary = arena_.make<UnaryExpression>();
 
-		unary->op     = op.type;
-		unary->prefix = true;
+				unary->op     = op;
+				unary->prefix = true;
+				*slot         = unary;
 
-		// parse the operand expression
-		parseExpression9(unary->operand);
+				// parse the operand expression
+				pushFrame(ExpressionFrame::Unary, &unary->operand);
+			} else {
+				frame.state = ExpressionFrame::Postfix;
+				pushFrame(ExpressionFrame::Primary, slot);
+			}
+			break;
+		}
 
-		exp = std::move(unary);
-		op  = peekToken();
-	}
+		case ExpressionFrame::Postfix:
+			parsePostfix(*slot);
+			frames_.pop_back();
+			break;
 
-	parseExpression10(exp);
+		case ExpressionFrame::Primary:
+			// ()
+			if (peekToken().type == Token::LeftParen) {
+				readToken();
 
-	// ++, -- (postfix)
-	op = peekToken();
-	while (op.type == Token::Increment || op.type == Token::Decrement) {
-		op = readToken();
+				// get sub-expression
+				frame.state = ExpressionFrame::ClosingParen;
+				pushFrame(ExpressionFrame::Binary, slot, LowestPrecedence);
+				break;
+			}
 
-		auto unary = std::make_unique<UnaryExpression>();
+			parseAtom(*slot);
+			frame.state = ExpressionFrame::ArrayIndex;
+			[[fallthrough]];
 
-		unary->op      = op.type;
-		unary->operand = std::move(exp);
-		unary->prefix  = false;
+		case ExpressionFrame::ArrayIndex:
+			if (peekToken().type == Token::LeftBracket) {
 
-		exp = std::move(unary);
-		op  = peekToken();
-	}
-}
+				// consume the left bracket
+				readToken();
 
-/**
- * @brief Parser::parseExpression10
- * @param exp
- */
-void Parser::parseExpression10(std::unique_ptr<Expression> &exp) {
-	// ^ (power)
+				frame.state = ExpressionFrame::ClosingBracket;
+				pushFrame(ExpressionFrame::List, nullptr);
+				break;
+			}
 
-	parseExpression11(exp);
+			frame.state = ExpressionFrame::Call;
+			[[fallthrough]];
 
-	// NOTE(eteran): we don't loop, as that would make things left-right
-	//               associative, but this operator is right-left associative
-	Token op = peekToken();
-	if (op.type == Token::Exponent) {
-		op = readToken();
+		case ExpressionFrame::Call:
+			if (peekToken().type == Token::LeftParen) {
+				auto a = node_cast<AtomExpression>(*slot);
+				if (a && a->type == Token::Type::Identifier) {
 
-		auto bin = std::make_unique<BinaryExpression>();
+					// consume the left parens
+					readToken();
 
-		bin->lhs = std::move(exp);
-		bin->op  = op.type;
+					if (peekToken().type != Token::RightParen) {
+						frame.state = ExpressionFrame::ClosingCallParen;
+						pushFrame(ExpressionFrame::List, nullptr);
+						break;
+					}
 
-		// parse the RHS expression
-		parseExpression10(bin->rhs);
+					// empty parameter list
+					// consume the closing parameter
+					consumeRequired<MissingClosingParen>(Token::RightParen);
 
-		exp = std::move(bin);
-		op  = peekToken();
-	}
-}
+					auto call      = arena_.make<CallExpression>();
+					call->function = *slot;
 
-/**
- * @brief Parser::parseExpression11
- * @param exp
- */
-void Parser::parseExpression11(std::unique_ptr<Expression> &exp) {
-	// ()
+					*slot = call;
+				}
+			}
 
-	Token token = peekToken();
+			frame.state = ExpressionFrame::PowerOperator;
+			[[fallthrough]];
 
-	if (token.type == Token::LeftParen) {
-		token = readToken();
+		case ExpressionFrame::PowerOperator:
+			// ^ (power)
 
-		// get sub-expression
-		parseExpression0(exp);
+			// NOTE(eteran): we don't loop, as that would make things left-right
+			//               associative, but this operator is right-left associative
+			if (peekToken().type == Token::Exponent) {
+				readToken();
 
-		consumeRequired<MissingClosingParen>(Token::RightParen);
-	} else {
-		parseArrayIndex(exp);
-	}
-}
+				auto bin = arena_.make<BinaryExpression>();
 
-/**
- * @brief Parser::parseArrayIndex
- * @param exp
- */
-void Parser::parseArrayIndex(std::unique_ptr<Expression> &exp) {
+				bin->lhs = *slot;
+				bin->op  = Token::Exponent;
+				*slot    = bin;
 
-	parseAtom(exp);
+				// parse the RHS expression, in place of this frame
+				frame.state = ExpressionFrame::Primary;
+				frame.slot  = &bin->rhs;
+			} else {
+				frames_.pop_back();
+			}
+			break;
 
-	Token leftBracket = peekToken();
-	while (leftBracket.type == Token::LeftBracket) {
+		case ExpressionFrame::ClosingParen:
+			consumeRequired<MissingClosingParen>(Token::RightParen);
+			frame.state = ExpressionFrame::PowerOperator;
+			break;
 
-		// consume the left bracket
-		readToken();
+		case ExpressionFrame::ClosingBracket: {
+			consumeRequired<MissingClosingBracket>(Token::RightBracket);
 
-		std::vector<std::unique_ptr<Expression>> index = parseExpressionList();
+			auto arrayIndex = arena_.make<ArrayIndexExpression>();
 
-		consumeRequired<MissingClosingBracket>(Token::RightBracket);
+			// make note that this is an array, not just an ordinary identifier
+			// i have no idea how we would handle something like:
+			// f()[1]
+			// it may require something much more clever
+			if (auto arr = node_cast<AtomExpression>(*slot)) {
+				arr->type = Token::ArrayIdentifier;
+			}
 
-		auto arrayIndex = std::make_unique<ArrayIndexExpression>();
+			arrayIndex->array = *slot;
+			arrayIndex->index = list_;
 
-		// make note that this is an array, not just an ordinary identifier
-		// i have no idea how we would handle something like:
-		// f()[1]
-		// it may require something much more clever
-		if (auto arr = dynamic_cast<AtomExpression *>(exp.get())) {
-			arr->type = Token::ArrayIdentifier;
+			*slot       = arrayIndex;
+			frame.state = ExpressionFrame::ArrayIndex;
+			break;
 		}
 
-		arrayIndex->array = std::move(exp);
-		arrayIndex->index = std::move(index);
+		case ExpressionFrame::ClosingCallParen: {
+			consumeRequired<MissingClosingParen>(Token::RightParen);
 
-		exp = std::move(arrayIndex);
+			auto call        = arena_.make<CallExpression>();
+			call->function   = *slot;
+			call->parameters = list_;
 
-		leftBracket = peekToken();
-	}
-
-	parseCall(exp);
-}
+			*slot       = call;
+			frame.state = ExpressionFrame::PowerOperator;
+			break;
+		}
 
-/**
- * @brief Parser::parseAtom
- * @param exp
- */
-void Parser::parseAtom(std::unique_ptr<Expression> &exp) {
-	// var, $var, 123, "hello"
+		case ExpressionFrame::List:
+			// NOTE(eteran): list_items_ is a deque, so the slot for this item
+			// stays put while the items of any nested lists come and go
+			list_items_.push_back(nullptr);
+			frame.state = ExpressionFrame::ListItem;
+			pushFrame(ExpressionFrame::Binary, &list_items_.back(), LowestPrecedence);
+			break;
 
-	Token token = peekToken();
+		case ExpressionFrame::ListItem:
+			if (!list_items_.back()) {
+				list_items_.pop_back();
+				if (peekToken().type == Token::Comma) {
+					throw UnexpectedComma(peekToken());
+				}
+			}
 
-	if (token.type == Token::Identifier || token.type == Token::Integer || token.type == Token::String) {
-		Token name = readToken();
+			if (peekToken().type != Token::Comma) {
+				list_ = arena_.make_list(list_items_.begin() + frame.first, list_items_.end());
+				list_items_.resize(frame.first);
+				frames_.pop_back();
+				break;
+			}
 
-		auto atom   = std::make_unique<AtomExpression>();
-		atom->value = name.value;
-		atom->type  = name.type;
-		exp         = std::move(atom);
+			// consume the comma
+			readToken();
+			frame.state = ExpressionFrame::List;
+			break;
+		}
 	}
 }
 
 /**
- * @brief Parser::parseCall
+ * @brief Parser::parsePostfix
  * @param exp
  */
-void Parser::parseCall(std::unique_ptr<Expression> &exp) {
-	Token leftBracket = peekToken();
-	if (leftBracket.type == Token::LeftParen) {
-
-		if (auto a = dynamic_cast<AtomExpression *>(exp.get())) {
-			if (a->type == Token::Type::Identifier) {
-
-				// consume the left parens
-				readToken();
-
-				if (peekToken().type == Token::RightParen) {
-					// empty parameter list
-					// consume the closing parameter
-					consumeRequired<MissingClosingParen>(Token::RightParen);
-
-					auto call      = std::make_unique<CallExpression>();
-					call->function = std::move(exp);
-
-					exp = std::move(call);
-
-				} else {
-					std::vector<std::unique_ptr<Expression>> arguments = parseExpressionList();
+void Parser::parsePostfix(Expression *&exp) {
+	// ++, -- (postfix)
+	Token::Type op = peekToken().type;
+	while (op == Token::Increment || op == Token::Decrement) {
+		readToken();
 
-					consumeRequired<MissingClosingParen>(Token::RightParen);
+		auto unary = arena_.make<UnaryExpression>();
 
-					auto call        = std::make_unique<CallExpression>();
-					call->function   = std::move(exp);
-					call->parameters = std::move(arguments);
+		unary->op      = op;
+		unary->operand = exp;
+		unary->prefix  = false;
 
-					exp = std::move(call);
-				}
-			}
-		}
+		exp = unary;
+		op  = peekToken().type;
 	}
 }
 
 /**
- * @brief Parser::parseExpressionList
- * @return
+ * @brief Parser::parseAtom
+ * @param exp
  */
-std::vector<std::unique_ptr<Expression>> Parser::parseExpressionList() {
-	std::vector<std::unique_ptr<Expression>> expressions;
+void Parser::parseAtom(Expression *&exp) {
+	// var, $var, 123, "hello"
 
-	while (true) {
-		auto expr = parseExpression();
+	const Token &token = peekToken();
 
-		if (expr) {
-			expressions.push_back(std::move(expr));
-		} else {
-			if (peekToken().type == Token::Comma) {
-				throw UnexpectedComma(peekToken());
-			}
-		}
-
-		if (peekToken().type != Token::Comma) {
-			break;
-		}
+	if (token.type == Token::Identifier || token.type == Token::Integer || token.type == Token::String) {
+		const Token &name = readToken();
 
-		// consume the comma
-		readToken();
+		auto atom   = arena_.make<AtomExpression>();
+		atom->value = arena_.copy(text(name));
+		atom->type  = name.type;
+		exp         = atom;
 	}
-
-	return expressions;
 }
@@ -2,71 +2,169 @@
 #ifndef PARSER_H_
 #define PARSER_H_
 
+#include "Arena.h"
+#include "Diagnostics.h"
 #include "Expression.h"
 #include "Statement.h"
 #include "Tokenizer.h"
+#include <cstdint>
+#include <deque>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
 class Input;
 class Token;
 
 class Parser {
 public:
-	explicit Parser(const std::string &filename);
+	Parser(const std::string &filename, Arena &arena);
 	~Parser() = default;
 
 public:
-	std::unique_ptr<BlockStatement> parseBlockStatement();
-	std::unique_ptr<BreakStatement> parseBreakStatement();
-	std::unique_ptr<CondStatement> parseIfStatement();
-	std::unique_ptr<ContinueStatement> parseContinueStatement();
-	std::unique_ptr<DeleteStatement> parseDeleteStatement();
-	std::unique_ptr<Expression> parseExpression();
-	std::unique_ptr<ExpressionStatement> parseEmptyStatement();
-	std::unique_ptr<ExpressionStatement> parseExpressionStatement();
-	std::unique_ptr<FunctionStatement> parseFunctionStatement();
-	std::unique_ptr<LoopStatement> parseWhileStatement();
-	std::unique_ptr<ReturnStatement> parseReturnStatement();
-	std::unique_ptr<Statement> parseForStatement();
-	std::unique_ptr<Statement> parseStatement();
-	std::vector<std::unique_ptr<Expression>> parseExpressionList();
+	BlockStatement *parseBlockStatement();
+	BreakStatement *parseBreakStatement();
+	CondStatement *parseIfStatement();
+	ContinueStatement *parseContinueStatement();
+	DeleteStatement *parseDeleteStatement();
+	Expression *parseExpression();
+	ExpressionStatement *parseEmptyStatement();
+	ExpressionStatement *parseExpressionStatement();
+	FunctionStatement *parseFunctionStatement();
+	LoopStatement *parseWhileStatement();
+	ReturnStatement *parseReturnStatement();
+	Statement *parseForStatement();
+	Statement *parseStatement();
+	NodeList<Expression> parseExpressionList();
+	const std::vector<Statement *> &parseStatements(size_t threads);
+	const std::vector<Statement *> &parseStatements(size_t threads, Diagnostics &diagnostics);
+	const std::vector<Statement *> &reparse(size_t offset, size_t removed, std::string_view inserted);
+
+public:
+	void tokenize(size_t threads);
+	std::string_view text(const Token &token) const;
+	Reader::Location location(size_t index) const;
+
+private:
+	struct Part;
+
+	Parser(Parser &parent, Arena &arena, size_t position);
+	void parsePart(Part &part);
+	void parseConcurrently(std::vector<Part> &parts, size_t threads);
+	void parseRemaining();
+	bool parseNextStatement(bool in_block, Statement *&statement);
+	void synchronize(bool in_block);
 
 private:
-	void parseExpression0(std::unique_ptr<Expression> &exp);
-	void parseExpression1(std::unique_ptr<Expression> &exp);
-	void parseExpression2(std::unique_ptr<Expression> &exp);
-	void parseExpression3(std::unique_ptr<Expression> &exp);
-	void parseExpression4(std::unique_ptr<Expression> &exp);
-	void parseExpression5(std::unique_ptr<Expression> &exp);
-	void parseExpression6(std::unique_ptr<Expression> &exp);
-	void parseExpression7(std::unique_ptr<Expression> &exp);
-	void parseExpression8(std::unique_ptr<Expression> &exp);
-	void parseExpression9(std::unique_ptr<Expression> &exp);
-	void parseExpression10(std::unique_ptr<Expression> &exp);
-	void parseExpression11(std::unique_ptr<Expression> &exp);
-	void parseAtom(std::unique_ptr<Expression> &exp);
-	void parseArrayIndex(std::unique_ptr<Expression> &exp);
-	void parseCall(std::unique_ptr<Expression> &exp);
+	/**
+	 * @brief a pending step of parsing an expression, see parseFrames
+	 */
+	struct ExpressionFrame {
+		enum State : uint8_t {
+			Binary,
+			Operand,
+			BinaryOperator,
+			Unary,
+			Postfix,
+			Primary,
+			ArrayIndex,
+			Call,
+			PowerOperator,
+			ClosingParen,
+			ClosingBracket,
+			ClosingCallParen,
+			List,
+			ListItem,
+		};
+
+		State state;
+		uint8_t precedence;
+		uint32_t first; // where this frame's list starts in list_items_
+		Expression **slot;
+	};
+
+	void beginExpression();
+	void pushFrame(ExpressionFrame::State state, Expression **slot, uint8_t precedence = 0);
+	void parseFrames();
+	void parsePostfix(Expression *&exp);
+	void parseAtom(Expression *&exp);
 
 private:
 	std::string readIdentifier();
-	Token peekToken() const;
-	Token readToken();
+	const Token &nextToken();
+	void skipToken();
+	[[noreturn]] void rejectToken();
+
+	// NOTE(eteran): these are called for nearly every token, so they are kept
+	// inline, a token which couldn't be lexed is rare and handled out of line
+
+	/**
+	 * @brief Parser::peekToken
+	 * @return the next token. If it is one which couldn't be lexed, it is
+	 * consumed and the error thrown instead
+	 */
+	const Token &peekToken() {
+		const Token &token = shared_ ? tokenizer_.at(position_) : tokenizer_.peek();
+		if (token.type == Token::Error) {
+			rejectToken();
+		}
+
+		return token;
+	}
+
+	/**
+	 * @brief Parser::readToken
+	 * @return the next token, consuming it. If it is one which couldn't be
+	 * lexed, the error is thrown instead
+	 */
+	const Token &readToken() {
+		const Token &token = peekToken();
+		if (shared_) {
+			if (token.type != Token::Invalid) {
+				++position_;
+			}
+		} else {
+			tokenizer_.read();
+		}
+
+		return token;
+	}
 
 private:
+	// NOTE(eteran): a token which isn't the one required is left unread, so
+	// that recovering from the error (see synchronize) sees it
 	template <class Ex>
 	void consumeRequired(Token::Type type) {
-		auto token = readToken();
+		const Token &token = peekToken();
 		if (token.type != type) {
 			throw Ex(token);
 		}
+
+		readToken();
 	}
 
 private:
-	Tokenizer tokenizer_;
-	size_t index_     = 0;
+	std::unique_ptr<Tokenizer> own_tokenizer_;
+	Tokenizer &tokenizer_;
+	Arena &arena_;
+	std::vector<ExpressionFrame> frames_;
+	std::deque<Expression *> list_items_;
+	NodeList<Expression> list_;
 	bool in_function_ = false;
+
+	// NOTE(eteran): where errors go while parseStatements is collecting them,
+	// rather than stopping at the first one
+	Diagnostics *diagnostics_ = nullptr;
+
+	// the top level statements, and the position of the first token of each
+	std::vector<Statement *> statements_;
+	std::vector<size_t> starts_;
+
+	// NOTE(eteran): a parser which works on part of another one's input reads
+	// the shared tokens directly, and keeps its own position in them
+	bool shared_     = false;
+	size_t position_ = 0;
 };
 
 #endif
@@ -0,0 +1,755 @@
+
+#include "Peephole.h"
+#include <algorithm>
+#include <cassert>
+#include <charconv>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace Peephole {
+namespace {
+
+/**
+ * @brief instr
+ * @param node
+ * @return the name of the instruction that node holds
+ */
+const std::string &instr(const node_type &node) {
+	return std::visit([](const auto &n) -> const std::string & { return n.instr; }, node);
+}
+
+class Rewriter;
+
+/**
+ * @brief a rewrite of a short run of instructions. A rule is tried wherever
+ * the next one or two instructions have the names that it lists (a name may
+ * be a list of alternatives separated by '|'), apply then checks anything
+ * else that the rule needs and makes the rewrite, returning false if it
+ * doesn't apply after all
+ */
+struct Rule {
+	const char *name;
+	std::string_view first;
+	std::string_view second; // empty if the rule only looks at one instruction
+	bool (Rewriter::*apply)(size_t first, size_t second);
+};
+
+/**
+ * @brief Rewrites the emitted instructions according to a table of rules
+ * until none of them apply any more. The instructions stay in the list they
+ * were emitted into and are reached through an index of it. Instructions are
+ * removed by marking them dead, branch destinations are kept as absolute
+ * indexes so that they survive this, and are turned back into the relative
+ * targets that BranchNode holds once everything is done
+ */
+class Rewriter {
+public:
+	Rewriter(std::list<node_type> &nodes, const Rule *rules, size_t count);
+
+public:
+	void run(size_t *hits);
+
+private:
+	static constexpr size_t NoDestination = SIZE_MAX;
+
+	uint8_t classify(const node_type &node) const;
+	void load();
+	void store();
+	void compact();
+	void count_incoming();
+	void replace(size_t index, node_type node);
+	void rename(size_t index, const char *instr);
+	void remove(size_t index);
+	void retarget(size_t branch, size_t destination);
+	size_t next(size_t index) const;
+	size_t previous(size_t index) const;
+	size_t destination(size_t branch) const { return next(destinations_[branch]); }
+
+	static bool temporary(const std::string &symbol) { return !symbol.empty() && symbol[0] == '<'; }
+
+	template <class T>
+	T *node_as(size_t index, const char *name) {
+		if (index < code_.size()) {
+			auto node = std::get_if<T>(&*code_[index]);
+			if (node && node->instr == name) {
+				return node;
+			}
+		}
+
+		return nullptr;
+	}
+
+public:
+	bool assign_reload(size_t first, size_t second);
+	bool dead_temporary(size_t first, size_t second);
+	bool branch_to_next(size_t first, size_t second);
+	bool branch_never(size_t first, size_t second);
+	bool constant_test(size_t first, size_t second);
+	bool and_test(size_t first, size_t second);
+	bool or_test(size_t first, size_t second);
+	bool thread_branch(size_t first, size_t second);
+	bool branch_to_return(size_t first, size_t second);
+	bool branch_over_branch(size_t first, size_t second);
+	bool unreachable(size_t first, size_t second);
+
+private:
+	bool short_circuit_test(size_t first, size_t second, const char *op);
+	size_t final_destination(size_t branch);
+
+private:
+	// NOTE(eteran): a set of the names that the rules look for, one bit each
+	using Names = uint32_t;
+
+	struct Pattern {
+		Names first;
+		Names second; // 0 if the rule only looks at one instruction
+	};
+
+	std::list<node_type> &nodes_;
+	const Rule *rules_;
+	size_t count_;
+
+	// NOTE(eteran): each instruction is classified once, by which of the names
+	// that the rules look for it has (0 if none), so that looking for places
+	// that a rule may apply doesn't have to go back to the list
+	std::vector<std::string_view> names_;
+	std::vector<Pattern> patterns_;
+	std::vector<uint8_t> ops_;
+	std::vector<size_t> chain_;
+
+	std::vector<std::list<node_type>::iterator> code_;
+	std::vector<bool> dead_;
+
+	// NOTE(eteran): how many times each of the generator's own variables (the
+	// ones whose names start with '<') is read
+	std::unordered_map<std::string, size_t> reads_;
+
+	// for branches, the index of the instruction they go to
+	std::vector<size_t> destinations_;
+
+	// NOTE(eteran): how many branches go to each instruction (with one extra
+	// entry for the end of the code). Only an instruction which nothing
+	// branches to may be rewritten along with the one before it
+	std::vector<size_t> incoming_;
+};
+
+// NOTE(eteran): the stack effect of what is removed must always be made up
+// for by what replaces it, on every path which reaches it, including those
+// which branch into the middle of it
+const Rule peephole_rules[] = {
+	// ASSIGN x, PUSH_SYM x => DUP, ASSIGN x
+	{"assign-reload", "ASSIGN", "PUSH_SYM", &Rewriter::assign_reload},
+	// DUP, ASSIGN <t> where nothing reads <t> => nothing
+	{"dead-temporary", "DUP", "ASSIGN", &Rewriter::dead_temporary},
+	// BRANCH to the next instruction => nothing
+	{"branch-to-next", "BRANCH", "", &Rewriter::branch_to_next},
+	// BRANCH_NEVER => nothing
+	{"branch-never", "BRANCH_NEVER", "", &Rewriter::branch_never},
+	// PUSH_SYM const n, BRANCH_FALSE L => nothing, or BRANCH L if n is 0 (and the reverse)
+	{"constant-test", "PUSH_SYM const", "BRANCH_FALSE|BRANCH_TRUE", &Rewriter::constant_test},
+	// a && b tested by BRANCH_FALSE E => a, BRANCH_FALSE E, b, BRANCH_FALSE E
+	{"and-test", "DUP", "BRANCH_FALSE", &Rewriter::and_test},
+	// a || b tested by BRANCH_FALSE E => a, BRANCH_TRUE past the test, b, BRANCH_FALSE E
+	{"or-test", "DUP", "BRANCH_TRUE", &Rewriter::or_test},
+	// a branch to BRANCH L => a branch to L
+	{"thread-branch", "BRANCH|BRANCH_FALSE|BRANCH_TRUE", "", &Rewriter::thread_branch},
+	// BRANCH to a return => that return
+	{"branch-to-return", "BRANCH", "", &Rewriter::branch_to_return},
+	// BRANCH_FALSE L, BRANCH M, L: => BRANCH_TRUE M, L: (and the reverse)
+	{"branch-over-branch", "BRANCH_FALSE|BRANCH_TRUE", "BRANCH", &Rewriter::branch_over_branch},
+	// BRANCH or a return, followed by instructions that nothing branches to => the BRANCH or return
+	{"unreachable", "BRANCH|RETURN|RETURN_NO_VAL", "", &Rewriter::unreachable},
+};
+
+constexpr size_t RuleCount = sizeof(peephole_rules) / sizeof(peephole_rules[0]);
+
+size_t peephole_hits[RuleCount] = {};
+size_t peephole_removed                 = 0;
+
+/**
+ * @brief Rewriter::Rewriter
+ * @param nodes
+ * @param rules
+ * @param count
+ */
+Rewriter::Rewriter(std::list<node_type> &nodes, const Rule *rules, size_t count)
+	: nodes_(nodes), rules_(rules), count_(count) {
+
+	auto names_of = [this](std::string_view list) {
+		Names names = 0;
+
+		while (!list.empty()) {
+			const size_t n              = list.find('|');
+			const std::string_view name = list.substr(0, n);
+			list.remove_prefix(n == std::string_view::npos ? list.size() : n + 1);
+
+			auto it = std::find(names_.begin(), names_.end(), name);
+			if (it == names_.end()) {
+				it = names_.insert(it, name);
+			}
+
+			// NOTE(eteran): bit 0 is left for instructions with none of the names
+			assert(names_.size() < sizeof(Names) * CHAR_BIT);
+			names |= Names(1) << (it - names_.begin() + 1);
+		}
+
+		return names;
+	};
+
+	for (size_t r = 0; r < count_; ++r) {
+		const Names first = names_of(rules_[r].first);
+		patterns_.push_back(Pattern{first, names_of(rules_[r].second)});
+	}
+}
+
+/**
+ * @brief Rewriter::run
+ * @param hits receives how many times each of the rules was applied
+ */
+void Rewriter::run(size_t *hits) {
+
+	load();
+
+	bool rewritten = false;
+	bool changed   = true;
+	while (changed) {
+		changed = false;
+		count_incoming();
+
+		for (size_t i = 0; i < code_.size(); ++i) {
+			if (dead_[i] || ops_[i] == 0) {
+				continue;
+			}
+
+			const size_t j = next(i + 1);
+
+			for (size_t r = 0; r < count_; ++r) {
+				const Pattern &pattern = patterns_[r];
+
+				if (!(pattern.first & (Names(1) << ops_[i]))) {
+					continue;
+				}
+
+				if (pattern.second && (j == code_.size() || !(pattern.second & (Names(1) << ops_[j])))) {
+					continue;
+				}
+
+				if ((this->*rules_[r].apply)(i, j)) {
+					++hits[r];
+					changed = true;
+					break;
+				}
+			}
+		}
+
+		if (changed) {
+			compact();
+			rewritten = true;
+		}
+	}
+
+	if (rewritten) {
+		store();
+	}
+}
+
+/**
+ * @brief Rewriter::classify
+ * @param node
+ * @return which of the names that the rules look for node has, 0 if none
+ */
+uint8_t Rewriter::classify(const node_type &node) const {
+	auto it = std::find(names_.begin(), names_.end(), instr(node));
+	return it == names_.end() ? 0 : static_cast<uint8_t>(it - names_.begin() + 1);
+}
+
+/**
+ * @brief Rewriter::load
+ *
+ * Indexes the instructions in the list they were emitted into
+ */
+void Rewriter::load() {
+	code_.clear();
+	ops_.clear();
+	destinations_.clear();
+	reads_.clear();
+
+	code_.reserve(nodes_.size());
+	ops_.reserve(nodes_.size());
+	destinations_.reserve(nodes_.size());
+
+	for (auto it = nodes_.begin(); it != nodes_.end(); ++it) {
+		code_.push_back(it);
+		ops_.push_back(classify(*it));
+
+		if (auto br = std::get_if<BranchNode>(&*it)) {
+			destinations_.push_back(static_cast<size_t>(br->location + br->target));
+		} else {
+			destinations_.push_back(NoDestination);
+		}
+
+		if (auto push = std::get_if<PushSymbolNode>(&*it)) {
+			if (temporary(push->symbol)) {
+				++reads_[push->symbol];
+			}
+		} else if (auto push = std::get_if<PushArraySymbolNode>(&*it)) {
+			if (temporary(push->symbol)) {
+				++reads_[push->symbol];
+			}
+		}
+	}
+
+	dead_.assign(code_.size(), false);
+}
+
+/**
+ * @brief Rewriter::store
+ *
+ * Renumbers the instructions, and works out the relative targets of the
+ * branches again
+ */
+void Rewriter::store() {
+	for (size_t i = 0; i < code_.size(); ++i) {
+		const auto location = static_cast<int64_t>(i);
+
+		std::visit([location](auto &node) { node.location = location; }, *code_[i]);
+
+		if (auto br = std::get_if<BranchNode>(&*code_[i])) {
+			br->target = static_cast<int64_t>(destinations_[i]) - location;
+		}
+	}
+}
+
+/**
+ * @brief Rewriter::compact
+ *
+ * Erases the dead instructions, a branch which went to one of them goes to
+ * the next live instruction after it instead
+ */
+void Rewriter::compact() {
+
+	// NOTE(eteran): map[i] is where the first live instruction at or after i ends up
+	std::vector<size_t> map(code_.size() + 1);
+
+	size_t size = 0;
+	for (size_t i = 0; i < code_.size(); ++i) {
+		map[i] = size;
+		if (dead_[i]) {
+			nodes_.erase(code_[i]);
+		} else {
+			code_[size]         = code_[i];
+			ops_[size]          = ops_[i];
+			destinations_[size] = destinations_[i];
+			++size;
+		}
+	}
+
+	map[code_.size()] = size;
+
+	peephole_removed += code_.size() - size;
+
+	code_.resize(size);
+	ops_.resize(size);
+	destinations_.resize(size);
+	dead_.assign(size, false);
+
+	for (size_t &destination : destinations_) {
+		if (destination != NoDestination) {
+			destination = map[destination];
+		}
+	}
+}
+
+/**
+ * @brief Rewriter::count_incoming
+ */
+void Rewriter::count_incoming() {
+	incoming_.assign(code_.size() + 1, 0);
+
+	for (size_t destination : destinations_) {
+		if (destination != NoDestination) {
+			++incoming_[destination];
+		}
+	}
+}
+
+/**
+ * @brief Rewriter::next
+ * @param index
+ * @return the first live instruction at or after index, or the end of the code
+ */
+size_t Rewriter::next(size_t index) const {
+	while (index < code_.size() && dead_[index]) {
+		++index;
+	}
+
+	return index;
+}
+
+/**
+ * @brief Rewriter::previous
+ * @param index
+ * @return the last live instruction before index, or the end of the code if
+ * there is none
+ */
+size_t Rewriter::previous(size_t index) const {
+	while (index-- > 0) {
+		if (!dead_[index]) {
+			return index;
+		}
+	}
+
+	return code_.size();
+}
+
+/**
+ * @brief Rewriter::replace
+ * @param index
+ * @param node must not be a branch
+ */
+void Rewriter::replace(size_t index, node_type node) {
+	if (destinations_[index] != NoDestination) {
+		--incoming_[destination(index)];
+		destinations_[index] = NoDestination;
+	}
+
+	*code_[index] = std::move(node);
+	ops_[index]   = classify(*code_[index]);
+}
+
+/**
+ * @brief Rewriter::rename
+ * @param index
+ * @param instr
+ *
+ * Changes which instruction a node is, keeping its operands
+ */
+void Rewriter::rename(size_t index, const char *instr) {
+	std::visit([instr](auto &node) { node.instr = instr; }, *code_[index]);
+	ops_[index] = classify(*code_[index]);
+}
+
+/**
+ * @brief Rewriter::remove
+ * @param index
+ *
+ * Removes an instruction, branches to it now go to the one after it
+ */
+void Rewriter::remove(size_t index) {
+	dead_[index] = true;
+
+	if (destinations_[index] != NoDestination) {
+		--incoming_[destination(index)];
+	}
+
+	incoming_[next(index)] += incoming_[index];
+	incoming_[index] = 0;
+}
+
+/**
+ * @brief Rewriter::retarget
+ * @param branch
+ * @param destination
+ */
+void Rewriter::retarget(size_t branch, size_t destination) {
+	--incoming_[this->destination(branch)];
+	destinations_[branch] = destination;
+	++incoming_[this->destination(branch)];
+}
+
+/**
+ * @brief Rewriter::assign_reload
+ * @param first an ASSIGN
+ * @param second a PUSH_SYM
+ * @return true if the value just assigned was being read back
+ */
+bool Rewriter::assign_reload(size_t first, size_t second) {
+	auto assign = std::get_if<AssignNode>(&*code_[first]);
+	auto push   = std::get_if<PushSymbolNode>(&*code_[second]);
+
+	if (!assign || !push || assign->symbol != push->symbol || incoming_[second] != 0) {
+		return false;
+	}
+
+	if (temporary(push->symbol)) {
+		--reads_[push->symbol];
+	}
+
+	std::string symbol = std::move(assign->symbol);
+	replace(first, Node{0, "DUP"});
+	replace(second, AssignNode{0, "ASSIGN", std::move(symbol)});
+	return true;
+}
+
+/**
+ * @brief Rewriter::dead_temporary
+ * @param first a DUP
+ * @param second an ASSIGN
+ * @return true if the copy was kept in one of the generator's own variables,
+ * and nothing reads it any more
+ *
+ * This is what is left of a value which is kept for reuse, when the one
+ * place that reuses it came straight after, and assign_reload has turned
+ * that into a DUP
+ */
+bool Rewriter::dead_temporary(size_t first, size_t second) {
+	auto assign = std::get_if<AssignNode>(&*code_[second]);
+
+	if (!assign || !temporary(assign->symbol) || incoming_[second] != 0) {
+		return false;
+	}
+
+	auto it = reads_.find(assign->symbol);
+	if (it != reads_.end() && it->second != 0) {
+		return false;
+	}
+
+	remove(first);
+	remove(second);
+	return true;
+}
+
+/**
+ * @brief Rewriter::branch_to_next
+ * @param first a BRANCH
+ * @return true if it went to the instruction after it
+ */
+bool Rewriter::branch_to_next(size_t first, size_t second) {
+	(void)second;
+
+	if (destination(first) != next(first + 1)) {
+		return false;
+	}
+
+	remove(first);
+	return true;
+}
+
+/**
+ * @brief Rewriter::branch_never
+ * @param first a BRANCH_NEVER, which does nothing
+ * @return true
+ */
+bool Rewriter::branch_never(size_t first, size_t second) {
+	(void)second;
+
+	remove(first);
+	return true;
+}
+
+/**
+ * @brief Rewriter::constant_test
+ * @param first a PUSH_SYM of a constant
+ * @param second a BRANCH_FALSE or BRANCH_TRUE
+ * @return true if the constant is an integer, whose test is decided
+ */
+bool Rewriter::constant_test(size_t first, size_t second) {
+	auto push = std::get_if<PushSymbolNode>(&*code_[first]);
+	if (!push || incoming_[second] != 0) {
+		return false;
+	}
+
+	int32_t n        = 0;
+	const char *last = push->symbol.data() + push->symbol.size();
+
+	auto [ptr, ec] = std::from_chars(push->symbol.data(), last, n, 10);
+	if (push->symbol.empty() || ec != std::errc() || ptr != last) {
+		return false;
+	}
+
+	remove(first);
+
+	const bool taken = (n == 0) == (instr(*code_[second]) == "BRANCH_FALSE");
+	if (taken) {
+		rename(second, "BRANCH");
+	} else {
+		remove(second);
+	}
+
+	return true;
+}
+
+/**
+ * @brief Rewriter::short_circuit_test
+ * @param first a DUP
+ * @param second the BRANCH_FALSE or BRANCH_TRUE after it
+ * @param op the instruction which combines the operands, AND or OR
+ * @return true if they start a && or || whose result goes straight to a test
+ *
+ * The left operand only decides the result when the branch after the DUP is
+ * taken, and then the test can be made on it directly: it goes where the
+ * test goes if they branch on the same condition, and past the test if not.
+ * Otherwise the result is the right operand, so the AND or OR can go and the
+ * test can look at that operand alone. Since the left operand is no longer
+ * needed after the branch, neither is the DUP
+ */
+bool Rewriter::short_circuit_test(size_t first, size_t second, const char *op) {
+	const size_t test    = destination(second);
+	const size_t combine = previous(test);
+
+	if (!node_as<Node>(combine, op) || combine <= second || incoming_[second] != 0) {
+		return false;
+	}
+
+	BranchNode *br = std::get_if<BranchNode>(&*code_[second]);
+	BranchNode *to = nullptr;
+	if (!(to = node_as<BranchNode>(test, "BRANCH_FALSE")) && !(to = node_as<BranchNode>(test, "BRANCH_TRUE"))) {
+		return false;
+	}
+
+	remove(first);
+	retarget(second, br->instr == to->instr ? destination(test) : next(test + 1));
+	remove(combine);
+	return true;
+}
+
+/**
+ * @brief Rewriter::and_test
+ * @param first a DUP
+ * @param second a BRANCH_FALSE
+ * @return true if they start a && whose result goes straight to a test
+ */
+bool Rewriter::and_test(size_t first, size_t second) {
+	return short_circuit_test(first, second, "AND");
+}
+
+/**
+ * @brief Rewriter::or_test
+ * @param first a DUP
+ * @param second a BRANCH_TRUE
+ * @return true if they start a || whose result goes straight to a test
+ */
+bool Rewriter::or_test(size_t first, size_t second) {
+	return short_circuit_test(first, second, "OR");
+}
+
+/**
+ * @brief Rewriter::final_destination
+ * @param branch
+ * @return where control ends up after branch, following any unconditional
+ * branches it lands on, or where it goes directly if those loop forever
+ */
+size_t Rewriter::final_destination(size_t branch) {
+	chain_.clear();
+
+	size_t to = destination(branch);
+	while (node_as<BranchNode>(to, "BRANCH")) {
+		if (to == branch || std::find(chain_.begin(), chain_.end(), to) != chain_.end()) {
+			return destination(branch);
+		}
+
+		chain_.push_back(to);
+		to = destination(to);
+	}
+
+	return to;
+}
+
+/**
+ * @brief Rewriter::thread_branch
+ * @param first a branch
+ * @return true if it landed on an unconditional branch, and now goes where
+ * that one does instead
+ */
+bool Rewriter::thread_branch(size_t first, size_t second) {
+	(void)second;
+
+	// NOTE(eteran): the branch of a && or || is left alone, so that
+	// short_circuit_test can still find the rest of the expression from it
+	if (node_as<Node>(previous(first), "DUP")) {
+		return false;
+	}
+
+	const size_t to = final_destination(first);
+	if (to == destination(first)) {
+		return false;
+	}
+
+	retarget(first, to);
+	return true;
+}
+
+/**
+ * @brief Rewriter::branch_to_return
+ * @param first a BRANCH
+ * @return true if it went to a return, and is now that return instead
+ */
+bool Rewriter::branch_to_return(size_t first, size_t second) {
+	(void)second;
+
+	const size_t to = destination(first);
+	if (!node_as<Node>(to, "RETURN") && !node_as<Node>(to, "RETURN_NO_VAL")) {
+		return false;
+	}
+
+	replace(first, *code_[to]);
+	return true;
+}
+
+/**
+ * @brief Rewriter::branch_over_branch
+ * @param first a BRANCH_FALSE or BRANCH_TRUE
+ * @param second a BRANCH
+ * @return true if the first only skipped the second, they are now one branch
+ * on the opposite condition
+ */
+bool Rewriter::branch_over_branch(size_t first, size_t second) {
+	if (destination(first) != next(second + 1) || incoming_[second] != 0) {
+		return false;
+	}
+
+	auto &br = std::get<BranchNode>(*code_[first]);
+	rename(first, br.instr == "BRANCH_FALSE" ? "BRANCH_TRUE" : "BRANCH_FALSE");
+	retarget(first, destination(second));
+	remove(second);
+	return true;
+}
+
+/**
+ * @brief Rewriter::unreachable
+ * @param first a BRANCH or a return
+ * @return true if anything after it could never be reached, which is now gone
+ */
+bool Rewriter::unreachable(size_t first, size_t second) {
+	(void)first;
+
+	bool removed = false;
+	for (size_t i = second; i < code_.size() && incoming_[i] == 0; i = next(i + 1)) {
+		remove(i);
+		removed = true;
+	}
+
+	return removed;
+}
+}
+
+/**
+ * @brief optimize
+ * @param nodes
+ *
+ * Applies the peephole rules to the code in nodes
+ */
+void optimize(std::list<node_type> &nodes) {
+	Rewriter(nodes, peephole_rules, RuleCount).run(peephole_hits);
+}
+
+/**
+ * @brief print_statistics
+ *
+ * Prints how many times each peephole rule was applied, and how many
+ * instructions that saved
+ */
+void print_statistics() {
+	for (size_t r = 0; r < RuleCount; ++r) {
+		fprintf(stderr, "%-20s %zu\n", peephole_rules[r].name, peephole_hits[r]);
+	}
+
+	fprintf(stderr, "%-20s %zu\n", "removed", peephole_removed);
+}
+
+}
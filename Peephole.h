@@ -0,0 +1,15 @@
+
+#ifndef PEEPHOLE_H_
+#define PEEPHOLE_H_
+
+#include "IR.h"
+#include <list>
+
+namespace Peephole {
+
+void optimize(std::list<node_type> &nodes);
+void print_statistics();
+
+}
+
+#endif
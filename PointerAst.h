@@ -0,0 +1,96 @@
+
+#ifndef POINTER_AST_H_
+#define POINTER_AST_H_
+
+#include "Arena.h"
+#include "Expression.h"
+#include "Statement.h"
+#include "Token.h"
+#include "Visitor.h"
+#include <string_view>
+#include <utility>
+
+/**
+ * @brief Gives the pointer based AST the same interface as FlatAst, so that a
+ * pass written as a template over the form of the AST can walk either one
+ */
+class PointerAst {
+public:
+	using ExpressionRef  = Expression *;
+	using StatementRef   = Statement *;
+	using ExpressionList = NodeList<Expression>;
+	using StatementList  = NodeList<Statement>;
+
+	using BinaryExpression     = ::BinaryExpression;
+	using UnaryExpression      = ::UnaryExpression;
+	using AtomExpression       = ::AtomExpression;
+	using CallExpression       = ::CallExpression;
+	using ArrayIndexExpression = ::ArrayIndexExpression;
+
+	using DeleteStatement     = ::DeleteStatement;
+	using FunctionStatement   = ::FunctionStatement;
+	using BlockStatement      = ::BlockStatement;
+	using CondStatement       = ::CondStatement;
+	using LoopStatement       = ::LoopStatement;
+	using ForEachStatement    = ::ForEachStatement;
+	using BreakStatement      = ::BreakStatement;
+	using ContinueStatement   = ::ContinueStatement;
+	using ExpressionStatement = ::ExpressionStatement;
+	using ReturnStatement     = ::ReturnStatement;
+
+public:
+	PointerAst() = default;
+	explicit PointerAst(Arena &arena) noexcept
+		: arena_(&arena) {
+	}
+
+public:
+	template <class Visitor>
+	decltype(auto) visit(ExpressionRef ref, Visitor &&visitor) {
+		return ::visit(ref, std::forward<Visitor>(visitor));
+	}
+
+	template <class Visitor>
+	decltype(auto) visit(StatementRef ref, Visitor &&visitor) {
+		return ::visit(ref, std::forward<Visitor>(visitor));
+	}
+
+	template <class T, class Node>
+	T *as(Node *node) noexcept {
+		return node_cast<T>(node);
+	}
+
+	const ExpressionList &list(const ExpressionList &list) const noexcept { return list; }
+	const StatementList &list(const StatementList &list) const noexcept { return list; }
+	std::string_view text(std::string_view text) const noexcept { return text; }
+
+	/**
+	 * @brief PointerAst::truncate
+	 * @param list
+	 * @param size
+	 *
+	 * Drops all but the first size entries of a list
+	 */
+	template <class T>
+	void truncate(NodeList<T> &list, size_t size) const noexcept {
+		list.erase(list.begin() + size, list.end());
+	}
+
+	/**
+	 * @brief PointerAst::make_atom
+	 * @param value
+	 * @param type
+	 * @return a new atom, allocated in the arena given at construction
+	 */
+	ExpressionRef make_atom(std::string_view value, Token::Type type) {
+		auto atom   = arena_->make<AtomExpression>();
+		atom->value = arena_->copy(value);
+		atom->type  = type;
+		return atom;
+	}
+
+private:
+	Arena *arena_ = nullptr;
+};
+
+#endif
@@ -1,5 +1,7 @@
 
 #include "Reader.h"
+#include <algorithm>
+#include <cstring>
 
 /**
  * @brief Reader::Reader
@@ -43,6 +45,22 @@ bool Reader::eof() const noexcept {
 	return index_ == input_.size();
 }
 
+/**
+ * @brief Reader::remaining
+ * @return the input which has not been read yet
+ */
+std::string_view Reader::remaining() const noexcept {
+	return input_.substr(index_);
+}
+
+/**
+ * @brief Reader::skip
+ * @param count the number of characters to skip, clamped to the end of the input
+ */
+void Reader::skip(size_t count) noexcept {
+	index_ += std::min(count, input_.size() - index_);
+}
+
 /**
  * @brief Reader::consume
  * @param chars
@@ -84,27 +102,6 @@ auto Reader::match_any() -> std::optional<std::string> {
 	return {};
 }
 
-/**
- * @brief Reader::match
- * @param regex
- * @return
- */
-auto Reader::match(const std::regex &regex) -> std::optional<std::string> {
-
-	std::cmatch matches;
-
-	const char *first = &input_[index_];
-	const char *last  = &input_[input_.size()];
-
-	if (std::regex_search(first, last, matches, regex, std::regex_constants::match_continuous)) {
-		std::string m = std::string(matches[0].first, matches[0].second);
-		index_ += m.size();
-		return m;
-	}
-
-	return {};
-}
-
 /**
  * @brief Reader::match
  * @param s
@@ -152,29 +149,56 @@ size_t Reader::index() const noexcept {
 	return index_;
 }
 
+/**
+ * @brief Reader::index_lines
+ * @param index extend the line table until it covers this offset
+ */
+void Reader::index_lines(size_t index) const {
+
+	if (lines_.empty()) {
+		lines_.push_back(0);
+	}
+
+	while (lines_end_ <= index && lines_end_ < input_.size()) {
+		auto newline = static_cast<const char *>(std::memchr(&input_[lines_end_], '\n', input_.size() - lines_end_));
+		if (!newline) {
+			lines_end_ = input_.size();
+			break;
+		}
+
+		lines_end_ = static_cast<size_t>(newline - input_.data()) + 1;
+		lines_.push_back(lines_end_);
+	}
+}
+
 /**
  * @brief Reader::location
  *
  * @param index
  * @return Reader::Location
  */
-Reader::Location Reader::location(size_t index) const noexcept {
-	size_t line = 1;
-	size_t col  = 1;
-
-	if (index < input_.size()) {
-
-		for (size_t i = 0; i < index; ++i) {
-			if (input_[i] == '\n') {
-				++line;
-				col = 1;
-			} else {
-				++col;
-			}
+Reader::Location Reader::location(size_t index) const {
+
+	index = std::min(index, input_.size());
+	index_lines(index);
+
+	// NOTE(eteran): locations are usually asked for in increasing order, so
+	// check the line we found last time, and the one after it, before
+	// falling back to a binary search
+	auto on_line = [this, index](size_t line) {
+		return lines_[line] <= index && (line + 1 == lines_.size() || index < lines_[line + 1]);
+	};
+
+	if (!on_line(line_cursor_)) {
+		if (line_cursor_ + 1 < lines_.size() && on_line(line_cursor_ + 1)) {
+			++line_cursor_;
+		} else {
+			auto it      = std::upper_bound(lines_.begin(), lines_.end(), index);
+			line_cursor_ = static_cast<size_t>(std::distance(lines_.begin(), it)) - 1;
 		}
 	}
 
-	return Location{line, col};
+	return Location{line_cursor_ + 1, index - lines_[line_cursor_] + 1};
 }
 
 /**
@@ -182,10 +206,66 @@ Reader::Location Reader::location(size_t index) const noexcept {
  *
  * @return Reader::Location
  */
-Reader::Location Reader::location() const noexcept {
+Reader::Location Reader::location() const {
 	return location(index_);
 }
 
+/**
+ * @brief Reader::replace
+ * @param input the edited input
+ * @param offset where the edit starts
+ * @param removed how many characters were removed, starting at offset
+ * @param inserted how many characters were inserted in their place
+ *
+ * Switches to an edited copy of the input, keeping the current position and
+ * whatever part of the line table is still correct
+ */
+void Reader::replace(std::string_view input, size_t offset, size_t removed, size_t inserted) {
+
+	const size_t old_end = offset + removed;
+	const size_t new_end = offset + inserted;
+
+	auto shift = [&](size_t index) {
+		if (index >= old_end) {
+			return index - removed + inserted;
+		}
+
+		return std::min(index, offset);
+	};
+
+	input_       = input;
+	index_       = shift(index_);
+	line_cursor_ = 0;
+
+	if (lines_end_ <= old_end) {
+		// NOTE(eteran): the table doesn't reach past the edit, so just forget
+		// anything inside of it and let it be rebuilt lazily. Nothing between
+		// the last line we keep and offset can be a newline
+		auto it = std::upper_bound(lines_.begin(), lines_.end(), offset);
+		lines_.erase(it, lines_.end());
+		lines_end_ = std::min(lines_end_, offset);
+		return;
+	}
+
+	auto first = std::upper_bound(lines_.begin(), lines_.end(), offset);
+	auto last  = std::upper_bound(first, lines_.end(), old_end);
+
+	std::vector<size_t> added;
+	for (size_t i = offset; i < new_end; ++i) {
+		if (input_[i] == '\n') {
+			added.push_back(i + 1);
+		}
+	}
+
+	std::for_each(last, lines_.end(), [removed, inserted](size_t &line) {
+		line = line - removed + inserted;
+	});
+
+	first = lines_.erase(first, last);
+	lines_.insert(first, added.begin(), added.end());
+	lines_end_ = shift(lines_end_);
+}
+
 /**
  * @brief Reader::push_state
  *
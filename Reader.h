@@ -2,12 +2,13 @@
 #ifndef READER_H_
 #define READER_H_
 
+#include "Dfa.h"
 #include <cstddef>
 #include <optional>
-#include <regex>
 #include <stack>
 #include <string>
 #include <string_view>
+#include <vector>
 
 class Reader {
 public:
@@ -46,11 +47,24 @@ public:
 		return count;
 	}
 
+	std::string_view remaining() const noexcept;
+	void skip(size_t count) noexcept;
+
 	bool match(char ch) noexcept;
 	bool match(std::string_view s) noexcept;
 	std::optional<std::string> match_any();
 
-	std::optional<std::string> match(const std::regex &regex);
+	template <size_t States>
+	std::optional<std::string_view> match(const Dfa<States> &dfa) noexcept {
+		const size_t length = dfa.longest_match(input_.substr(index_));
+		if (length == 0) {
+			return {};
+		}
+
+		std::string_view m = input_.substr(index_, length);
+		index_ += length;
+		return m;
+	}
 
 	template <class Pred>
 	std::optional<std::string> match_while(Pred pred) {
@@ -71,17 +85,28 @@ public:
 	}
 
 	size_t index() const noexcept;
-	Location location() const noexcept;
-	Location location(size_t index) const noexcept;
+	Location location() const;
+	Location location(size_t index) const;
+
+	void replace(std::string_view input, size_t offset, size_t removed, size_t inserted);
 
 	void push_state();
 	void pop_state();
 	void restore_state();
 
+private:
+	void index_lines(size_t index) const;
+
 private:
 	std::string_view input_;
 	size_t index_ = 0;
 	std::stack<size_t> state_;
+
+	// NOTE(eteran): the offsets at which each line starts, built lazily (and
+	// only as far as needed) the first time a location is asked for
+	mutable std::vector<size_t> lines_;
+	mutable size_t lines_end_   = 0;
+	mutable size_t line_cursor_ = 0;
 };
 
 #endif
@@ -0,0 +1,187 @@
+
+#include "Scanner.h"
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCANNER_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+using kernel_type = size_t (*)(std::string_view) noexcept;
+
+struct Kernels {
+	kernel_type skip_blanks;
+	kernel_type find_line_end;
+	kernel_type find_quote_or_backslash;
+};
+
+/**
+ * @brief in_set
+ * @param ch
+ * @return true if ch is one of the characters in Set
+ */
+template <char... Set>
+constexpr bool in_set(char ch) noexcept {
+	return ((ch == Set) || ...);
+}
+
+/**
+ * @brief scan_tail
+ * @param input
+ * @param first the offset to start scanning from
+ * @return the offset of the first byte at or after first whose membership in
+ * Set equals Member
+ */
+template <bool Member, char... Set>
+size_t scan_tail(std::string_view input, size_t first) noexcept {
+	for (size_t i = first; i < input.size(); ++i) {
+		if (in_set<Set...>(input[i]) == Member) {
+			return i;
+		}
+	}
+
+	return input.size();
+}
+
+/**
+ * @brief scan_scalar
+ * @param input
+ * @return
+ */
+template <bool Member, char... Set>
+size_t scan_scalar(std::string_view input) noexcept {
+	return scan_tail<Member, Set...>(input, 0);
+}
+
+#ifdef SCANNER_X86
+/**
+ * @brief scan_sse2
+ * @param input
+ * @return
+ */
+template <bool Member, char... Set>
+__attribute__((target("sse2"))) size_t scan_sse2(std::string_view input) noexcept {
+
+	const char *data = input.data();
+	size_t i         = 0;
+
+	for (; i + 16 <= input.size(); i += 16) {
+		const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+
+		__m128i hits = _mm_setzero_si128();
+		((hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(Set)))), ...);
+
+		auto mask = static_cast<uint32_t>(_mm_movemask_epi8(hits));
+		if (!Member) {
+			mask = ~mask & 0xffff;
+		}
+
+		if (mask) {
+			return i + static_cast<size_t>(__builtin_ctz(mask));
+		}
+	}
+
+	return scan_tail<Member, Set...>(input, i);
+}
+
+/**
+ * @brief scan_avx2
+ * @param input
+ * @return
+ */
+template <bool Member, char... Set>
+__attribute__((target("avx2"))) size_t scan_avx2(std::string_view input) noexcept {
+
+	const char *data = input.data();
+	size_t i         = 0;
+
+	for (; i + 32 <= input.size(); i += 32) {
+		const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+
+		__m256i hits = _mm256_setzero_si256();
+		((hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(Set)))), ...);
+
+		auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(hits));
+		if (!Member) {
+			mask = ~mask;
+		}
+
+		if (mask) {
+			return i + static_cast<size_t>(__builtin_ctz(mask));
+		}
+	}
+
+	return scan_tail<Member, Set...>(input, i);
+}
+#endif
+
+/**
+ * @brief select_kernels
+ * @return the best set of kernels which the host CPU supports
+ */
+Kernels select_kernels() noexcept {
+#ifdef SCANNER_X86
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2")) {
+		return Kernels{
+			scan_avx2<false, ' ', '\f', '\r', '\t', '\b'>,
+			scan_avx2<true, '\r', '\n'>,
+			scan_avx2<true, '"', '\\'>,
+		};
+	}
+
+	if (__builtin_cpu_supports("sse2")) {
+		return Kernels{
+			scan_sse2<false, ' ', '\f', '\r', '\t', '\b'>,
+			scan_sse2<true, '\r', '\n'>,
+			scan_sse2<true, '"', '\\'>,
+		};
+	}
+#endif
+	return Kernels{
+		scan_scalar<false, ' ', '\f', '\r', '\t', '\b'>,
+		scan_scalar<true, '\r', '\n'>,
+		scan_scalar<true, '"', '\\'>,
+	};
+}
+
+/**
+ * @brief kernels
+ * @return
+ */
+const Kernels &kernels() noexcept {
+	static const Kernels k = select_kernels();
+	return k;
+}
+
+}
+
+/**
+ * @brief Scanner::skip_blanks
+ * @param input
+ * @return the offset of the first byte which isn't one of " \f\r\t\b"
+ */
+size_t Scanner::skip_blanks(std::string_view input) noexcept {
+	return kernels().skip_blanks(input);
+}
+
+/**
+ * @brief Scanner::find_line_end
+ * @param input
+ * @return the offset of the first '\r' or '\n'
+ */
+size_t Scanner::find_line_end(std::string_view input) noexcept {
+	return kernels().find_line_end(input);
+}
+
+/**
+ * @brief Scanner::find_quote_or_backslash
+ * @param input
+ * @return the offset of the first '"' or '\\'
+ */
+size_t Scanner::find_quote_or_backslash(std::string_view input) noexcept {
+	return kernels().find_quote_or_backslash(input);
+}
@@ -0,0 +1,21 @@
+
+#ifndef SCANNER_H_
+#define SCANNER_H_
+
+#include <cstddef>
+#include <string_view>
+
+// NOTE(eteran): vectorized kernels for the parts of lexing which just skip over
+// long runs of uninteresting bytes. The best implementation (AVX2, SSE2 or
+// plain scalar code) is chosen once, at runtime, based on the host CPU.
+// Each of them returns the offset of the first interesting byte, or
+// input.size() if there is none
+namespace Scanner {
+
+size_t skip_blanks(std::string_view input) noexcept;
+size_t find_line_end(std::string_view input) noexcept;
+size_t find_quote_or_backslash(std::string_view input) noexcept;
+
+}
+
+#endif
@@ -0,0 +1,171 @@
+
+#include "Source.h"
+#include "Error.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace {
+
+constexpr size_t ChunkSize = 64 * 1024;
+
+/**
+ * @brief closes a file descriptor when it goes out of scope
+ */
+struct FileDescriptor {
+	explicit FileDescriptor(int fd)
+		: fd(fd) {
+	}
+
+	~FileDescriptor() {
+		if (fd > STDIN_FILENO) {
+			::close(fd);
+		}
+	}
+
+	int fd;
+};
+
+}
+
+/**
+ * @brief Source::Source
+ * @param filename the file to load, or "-" for stdin
+ */
+Source::Source(const std::string &filename) {
+
+	FileDescriptor file(filename == "-" ? STDIN_FILENO : ::open(filename.c_str(), O_RDONLY));
+	if (file.fd == -1) {
+		throw FileNotFound(filename);
+	}
+
+	if (!map(file.fd)) {
+		read(file.fd, filename);
+	}
+}
+
+/**
+ * @brief Source::Source
+ * @param other
+ */
+Source::Source(Source &&other) noexcept
+	: map_(std::exchange(other.map_, nullptr)), map_size_(std::exchange(other.map_size_, 0)), buffer_(std::move(other.buffer_)) {
+}
+
+/**
+ * @brief Source::operator =
+ * @param rhs
+ * @return
+ */
+Source &Source::operator=(Source &&rhs) noexcept {
+	if (this != &rhs) {
+		release();
+		map_      = std::exchange(rhs.map_, nullptr);
+		map_size_ = std::exchange(rhs.map_size_, 0);
+		buffer_   = std::move(rhs.buffer_);
+	}
+	return *this;
+}
+
+/**
+ * @brief Source::~Source
+ */
+Source::~Source() {
+	release();
+}
+
+/**
+ * @brief Source::replace
+ * @param offset where the edit starts
+ * @param removed how many characters to remove, starting at offset
+ * @param inserted the text to insert in their place
+ *
+ * A mapped file is copied into memory the first time that it is edited
+ */
+void Source::replace(size_t offset, size_t removed, std::string_view inserted) {
+	if (map_) {
+		buffer_.assign(static_cast<const char *>(map_), map_size_);
+		release();
+	}
+
+	buffer_.replace(offset, removed, inserted);
+}
+
+/**
+ * @brief Source::map
+ * @param fd
+ * @return true if the file was mapped, false if it needs to be read instead
+ */
+bool Source::map(int fd) {
+
+	struct stat st;
+	if (::fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+		return false;
+	}
+
+	const auto size = static_cast<size_t>(st.st_size);
+
+	void *ptr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (ptr == MAP_FAILED) {
+		return false;
+	}
+
+	// NOTE(eteran): we make a single forward pass over the input, so let the
+	// kernel know that it can read ahead aggressively
+	::madvise(ptr, size, MADV_SEQUENTIAL);
+
+	map_      = ptr;
+	map_size_ = size;
+	return true;
+}
+
+/**
+ * @brief Source::read
+ * @param fd
+ * @param filename what fd is, for reporting errors
+ */
+void Source::read(int fd, const std::string &filename) {
+
+	size_t size = 0;
+
+	while (true) {
+		if (buffer_.size() - size < ChunkSize) {
+			buffer_.resize(buffer_.size() + std::max(buffer_.size(), ChunkSize));
+		}
+
+		const ssize_t n = ::read(fd, &buffer_[size], buffer_.size() - size);
+		if (n == 0) {
+			break;
+		}
+
+		if (n == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			// NOTE(eteran): stopping here would compile whatever was read so
+			// far as though it were the whole file
+			throw FileReadError(filename, std::strerror(errno));
+		}
+
+		size += static_cast<size_t>(n);
+	}
+
+	buffer_.resize(size);
+}
+
+/**
+ * @brief Source::release
+ */
+void Source::release() noexcept {
+	if (map_) {
+		::munmap(map_, map_size_);
+		map_      = nullptr;
+		map_size_ = 0;
+	}
+}
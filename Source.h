@@ -0,0 +1,45 @@
+
+#ifndef SOURCE_H_
+#define SOURCE_H_
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief The contents of an input file. Regular files are memory mapped so that
+ * the text can be handed to the Reader without being copied, anything which
+ * can't be mapped (pipes, terminals, stdin via "-") is read in chunks instead.
+ */
+class Source {
+public:
+	explicit Source(const std::string &filename);
+	Source(const Source &other)          = delete;
+	Source &operator=(const Source &rhs) = delete;
+	Source(Source &&other) noexcept;
+	Source &operator=(Source &&rhs) noexcept;
+	~Source();
+
+public:
+	std::string_view data() const noexcept {
+		if (map_) {
+			return std::string_view(static_cast<const char *>(map_), map_size_);
+		}
+
+		return buffer_;
+	}
+
+	void replace(size_t offset, size_t removed, std::string_view inserted);
+
+private:
+	bool map(int fd);
+	void read(int fd, const std::string &filename);
+	void release() noexcept;
+
+private:
+	void *map_       = nullptr;
+	size_t map_size_ = 0;
+	std::string buffer_;
+};
+
+#endif
@@ -2,68 +2,152 @@
 #ifndef STATEMENT_H_
 #define STATEMENT_H_
 
-#include <memory>
-#include <string>
-#include <vector>
+#include "Arena.h"
+#include <cstdint>
+#include <string_view>
 
 class Expression;
 
+// NOTE(eteran): statements are allocated in an Arena and are never destroyed,
+// so they must not own any memory of their own. Each one carries a tag saying
+// which kind of statement it is, see Visitor.h for how to dispatch on it
 class Statement {
 public:
-	virtual ~Statement() = default;
+	enum class Kind : uint8_t {
+		Delete,
+		Function,
+		Block,
+		Cond,
+		Loop,
+		ForEach,
+		Break,
+		Continue,
+		Expression,
+		Return,
+	};
+
+public:
+	explicit Statement(Kind kind) noexcept
+		: kind(kind) {
+	}
+
+public:
+	const Kind kind;
 };
 
 class DeleteStatement : public Statement {
 public:
-	std::unique_ptr<Expression> expression;
-	std::vector<std::unique_ptr<Expression>> index;
+	static constexpr Kind StaticKind = Kind::Delete;
+
+	DeleteStatement() noexcept
+		: Statement(StaticKind) {
+	}
+
+	Expression *expression = nullptr;
+	NodeList<Expression> index;
 };
 
 class FunctionStatement : public Statement {
 public:
-	std::string name;
-	std::vector<std::unique_ptr<Statement>> statements;
+	static constexpr Kind StaticKind = Kind::Function;
+
+	FunctionStatement() noexcept
+		: Statement(StaticKind) {
+	}
+
+	std::string_view name;
+	NodeList<Statement> statements;
 };
 
 class BlockStatement : public Statement {
 public:
-	std::vector<std::unique_ptr<Statement>> statements;
+	static constexpr Kind StaticKind = Kind::Block;
+
+	BlockStatement() noexcept
+		: Statement(StaticKind) {
+	}
+
+	NodeList<Statement> statements;
 };
 
 class CondStatement : public Statement {
 public:
-	std::unique_ptr<Expression> cond;
-	std::unique_ptr<Statement> body;
-	std::unique_ptr<Statement> else_;
+	static constexpr Kind StaticKind = Kind::Cond;
+
+	CondStatement() noexcept
+		: Statement(StaticKind) {
+	}
+
+	Expression *cond = nullptr;
+	Statement *body  = nullptr;
+	Statement *else_ = nullptr;
 };
 
 class LoopStatement : public Statement {
 public:
-	std::vector<std::unique_ptr<Expression>> init;
-	std::unique_ptr<Expression> cond;
-	std::vector<std::unique_ptr<Expression>> incr;
-	std::unique_ptr<Statement> body;
+	static constexpr Kind StaticKind = Kind::Loop;
+
+	LoopStatement() noexcept
+		: Statement(StaticKind) {
+	}
+
+	NodeList<Expression> init;
+	Expression *cond = nullptr;
+	NodeList<Expression> incr;
+	Statement *body = nullptr;
 };
 
 class ForEachStatement : public Statement {
 public:
-	std::unique_ptr<Expression> iterator;
-	std::unique_ptr<Expression> container;
-	std::unique_ptr<Statement> body;
+	static constexpr Kind StaticKind = Kind::ForEach;
+
+	ForEachStatement() noexcept
+		: Statement(StaticKind) {
+	}
+
+	Expression *iterator  = nullptr;
+	Expression *container = nullptr;
+	Statement *body       = nullptr;
 };
 
-class BreakStatement : public Statement {};
+class BreakStatement : public Statement {
+public:
+	static constexpr Kind StaticKind = Kind::Break;
 
-class ContinueStatement : public Statement {};
+	BreakStatement() noexcept
+		: Statement(StaticKind) {
+	}
+};
+
+class ContinueStatement : public Statement {
+public:
+	static constexpr Kind StaticKind = Kind::Continue;
+
+	ContinueStatement() noexcept
+		: Statement(StaticKind) {
+	}
+};
 
 class ExpressionStatement : public Statement {
 public:
-	std::unique_ptr<Expression> expression;
+	static constexpr Kind StaticKind = Kind::Expression;
+
+	ExpressionStatement() noexcept
+		: Statement(StaticKind) {
+	}
+
+	Expression *expression = nullptr;
 };
 
 class ReturnStatement : public Statement {
 public:
-	std::unique_ptr<Expression> expression;
+	static constexpr Kind StaticKind = Kind::Return;
+
+	ReturnStatement() noexcept
+		: Statement(StaticKind) {
+	}
+
+	Expression *expression = nullptr;
 };
 
 #endif
@@ -0,0 +1,64 @@
+
+#include "ThreadPool.h"
+#include <algorithm>
+
+/**
+ * @brief ThreadPool::ThreadPool
+ * @param threads the number of worker threads, at least one is always created
+ */
+ThreadPool::ThreadPool(size_t threads) {
+	threads = std::max<size_t>(threads, 1);
+
+	threads_.reserve(threads);
+	for (size_t i = 0; i < threads; ++i) {
+		threads_.emplace_back(&ThreadPool::worker, this);
+	}
+}
+
+/**
+ * @brief ThreadPool::~ThreadPool
+ */
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+	}
+
+	cv_.notify_all();
+
+	for (std::thread &thread : threads_) {
+		thread.join();
+	}
+}
+
+/**
+ * @brief ThreadPool::worker
+ */
+void ThreadPool::worker() {
+	while (true) {
+		std::function<void()> task;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			cv_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+
+			if (tasks_.empty()) {
+				// stopping, and there is nothing left to do
+				return;
+			}
+
+			task = std::move(tasks_.front());
+			tasks_.pop();
+		}
+
+		task();
+	}
+}
+
+/**
+ * @brief ThreadPool::default_threads
+ * @return the number of threads the hardware can run concurrently
+ */
+size_t ThreadPool::default_threads() noexcept {
+	return std::max(std::thread::hardware_concurrency(), 1u);
+}
@@ -0,0 +1,60 @@
+
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief A fixed size pool of worker threads. Tasks are run in the order in
+ * which they are submitted, and the destructor waits for all of them to finish.
+ */
+class ThreadPool {
+public:
+	explicit ThreadPool(size_t threads);
+	ThreadPool(const ThreadPool &other)          = delete;
+	ThreadPool &operator=(const ThreadPool &rhs) = delete;
+	~ThreadPool();
+
+public:
+	template <class F>
+	auto submit(F &&f) -> std::future<std::invoke_result_t<F>> {
+		using result_type = std::invoke_result_t<F>;
+
+		// NOTE(eteran): std::function needs something copyable, so the task
+		// itself is shared
+		auto task   = std::make_shared<std::packaged_task<result_type()>>(std::forward<F>(f));
+		auto future = task->get_future();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			tasks_.emplace([task]() { (*task)(); });
+		}
+
+		cv_.notify_one();
+		return future;
+	}
+
+public:
+	static size_t default_threads() noexcept;
+
+private:
+	void worker();
+
+private:
+	std::vector<std::thread> threads_;
+	std::queue<std::function<void()>> tasks_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	bool stop_ = false;
+};
+
+#endif
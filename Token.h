@@ -2,7 +2,8 @@
 #ifndef TOKEN_H_
 #define TOKEN_H_
 
-#include <string>
+#include <cstddef>
+#include <cstdint>
 
 class Token {
 public:
@@ -62,19 +63,35 @@ public:
 		String,
 		Identifier,
 		ArrayIdentifier,
+		Error, // input which couldn't be lexed, see Tokenizer::throw_error
 		Concatenate
 	};
 
+public:
+	static constexpr uint32_t NoLiteral = UINT32_MAX;
+
 public:
 	Token() = default;
 
-	Token(Type t, const std::string &v, size_t n)
-		: type(t), value(v), index(n) {
+	Token(Type t, size_t offset, size_t length, uint32_t literal = NoLiteral)
+		: type(t), literal(literal), offset(offset), length(static_cast<uint32_t>(length)) {
 	}
 
+public:
+	// the offset just past the end of the token in the source
+	size_t index() const noexcept {
+		return offset + length;
+	}
+
+public:
 	Type type = Invalid;
-	std::string value;
-	size_t index;
+
+	// NOTE(eteran): a token is just a span of the source text, only string
+	// literals which contain escape sequences need a decoded copy, which is
+	// owned by the Tokenizer and referred to by this index
+	uint32_t literal = NoLiteral;
+	size_t offset    = 0;
+	uint32_t length  = 0;
 };
 
 #endif
@@ -2,17 +2,230 @@
 #include "Tokenizer.h"
 #include "Error.h"
 #include "Reader.h"
+#include "Scanner.h"
+#include "Source.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <array>
+#include <cassert>
 #include <cctype>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
 #include <cstring>
-#include <fstream>
-#include <regex>
+#include <deque>
+#include <iterator>
 #include <string>
+#include <string_view>
 
 namespace {
 
-const std::regex integer_regex(R"((0|[1-9][0-9]*))");
-const std::regex identifier_regex(R"([_a-zA-Z$][_a-zA-Z0-9]*)");
-const std::regex whitespace_regex(R"([ \f\r\t\b]+|#.+)");
+constexpr bool is_digit(char ch) {
+	return ch >= '0' && ch <= '9';
+}
+
+constexpr bool is_alpha(char ch) {
+	return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z');
+}
+
+/**
+ * @brief (0|[1-9][0-9]*)
+ * @return
+ */
+constexpr Dfa<3> make_integer_dfa() {
+	Dfa<3> dfa;
+	dfa.transition(0, 1, [](char ch) { return ch == '0'; });
+	dfa.transition(0, 2, [](char ch) { return ch >= '1' && ch <= '9'; });
+	dfa.transition(2, 2, is_digit);
+	dfa.accept[1] = true;
+	dfa.accept[2] = true;
+	return dfa;
+}
+
+/**
+ * @brief [_a-zA-Z$][_a-zA-Z0-9]*
+ * @return
+ */
+constexpr Dfa<2> make_identifier_dfa() {
+	Dfa<2> dfa;
+	dfa.transition(0, 1, [](char ch) { return is_alpha(ch) || ch == '_' || ch == '$'; });
+	dfa.transition(1, 1, [](char ch) { return is_alpha(ch) || is_digit(ch) || ch == '_'; });
+	dfa.accept[1] = true;
+	return dfa;
+}
+
+constexpr auto integer_dfa    = make_integer_dfa();
+constexpr auto identifier_dfa = make_identifier_dfa();
+
+struct Keyword {
+	std::string_view name;
+	Token::Type type;
+};
+
+// NOTE(eteran): adding a keyword is just a matter of adding it here, the hash
+// table below is rebuilt (and checked to still be perfect) at compile time
+constexpr Keyword keywords[] = {
+	{"while", Token::While},
+	{"define", Token::Define},
+	{"in", Token::In},
+	{"for", Token::For},
+	{"delete", Token::Delete},
+	{"if", Token::If},
+	{"else", Token::Else},
+	{"switch", Token::Switch},
+	{"break", Token::Break},
+	{"continue", Token::Continue},
+	{"return", Token::Return},
+};
+
+constexpr size_t KeywordTableSize = 32;
+
+/**
+ * @brief keyword_hash
+ * @param s
+ * @param seed
+ * @return a seeded FNV-1a hash of s, reduced to a slot in the keyword table
+ */
+constexpr uint32_t keyword_hash(std::string_view s, uint32_t seed) {
+	uint32_t h = seed;
+	for (char ch : s) {
+		h = (h ^ static_cast<uint8_t>(ch)) * 0x01000193;
+	}
+
+	return (h ^ (h >> 15)) % KeywordTableSize;
+}
+
+/**
+ * @brief find_keyword_seed
+ * @return the first seed for which keyword_hash has no collisions
+ */
+constexpr uint32_t find_keyword_seed() {
+	for (uint32_t seed = 0;; ++seed) {
+		bool used[KeywordTableSize] = {};
+		bool perfect                = true;
+
+		for (const Keyword &keyword : keywords) {
+			const uint32_t slot = keyword_hash(keyword.name, seed);
+			if (used[slot]) {
+				perfect = false;
+				break;
+			}
+			used[slot] = true;
+		}
+
+		if (perfect) {
+			return seed;
+		}
+	}
+}
+
+constexpr uint32_t keyword_seed = find_keyword_seed();
+
+/**
+ * @brief make_keyword_table
+ * @return a table mapping each keyword's hash to its index in keywords, or -1
+ */
+constexpr std::array<int8_t, KeywordTableSize> make_keyword_table() {
+	std::array<int8_t, KeywordTableSize> table = {};
+	for (auto &slot : table) {
+		slot = -1;
+	}
+
+	for (size_t i = 0; i < std::size(keywords); ++i) {
+		table[keyword_hash(keywords[i].name, keyword_seed)] = static_cast<int8_t>(i);
+	}
+
+	return table;
+}
+
+constexpr auto keyword_table = make_keyword_table();
+
+/**
+ * @brief keyword_type
+ * @param identifier
+ * @return the keyword's token type, or Token::Identifier if it isn't one
+ */
+Token::Type keyword_type(std::string_view identifier) {
+	const int8_t index = keyword_table[keyword_hash(identifier, keyword_seed)];
+	if (index != -1 && keywords[index].name == identifier) {
+		return keywords[index].type;
+	}
+
+	return Token::Identifier;
+}
+
+enum class CharKind : uint8_t {
+	Invalid,
+	Operator,
+	Digit,
+	IdentifierStart,
+	Quote,
+};
+
+/**
+ * @brief what a token starting with a given character could be
+ */
+struct Dispatch {
+	struct Pair {
+		char second      = '\0';
+		Token::Type type = Token::Invalid;
+	};
+
+	CharKind kind    = CharKind::Invalid;
+	Token::Type type = Token::Invalid;
+	Pair pairs[2]    = {};
+};
+
+/**
+ * @brief make_dispatch_table
+ * @return a table which classifies a token by its first character
+ */
+constexpr std::array<Dispatch, 256> make_dispatch_table() {
+	std::array<Dispatch, 256> table = {};
+
+	auto op = [&table](char ch, Token::Type type, Dispatch::Pair first = {}, Dispatch::Pair second = {}) {
+		Dispatch &entry = table[static_cast<uint8_t>(ch)];
+		entry.kind      = CharKind::Operator;
+		entry.type      = type;
+		entry.pairs[0]  = first;
+		entry.pairs[1]  = second;
+	};
+
+	op('+', Token::Add, {'+', Token::Increment}, {'=', Token::AddAssign});
+	op('-', Token::Sub, {'-', Token::Decrement}, {'=', Token::SubAssign});
+	op('*', Token::Mul, {'=', Token::MulAssign});
+	op('/', Token::Div, {'=', Token::DivAssign});
+	op('%', Token::Mod, {'=', Token::ModAssign});
+	op('<', Token::LessThan, {'=', Token::LessThanOrEqual});
+	op('>', Token::GreaterThan, {'=', Token::GreaterThanOrEqual});
+	op('=', Token::Assign, {'=', Token::Equal});
+	op('!', Token::Not, {'=', Token::NotEqual});
+	op('&', Token::BinaryAnd, {'&', Token::LogicalAnd});
+	op('|', Token::BinaryOr, {'|', Token::LogicalOr});
+	op('^', Token::Exponent);
+	op('{', Token::LeftBrace);
+	op('}', Token::RightBrace);
+	op('(', Token::LeftParen);
+	op(')', Token::RightParen);
+	op('[', Token::LeftBracket);
+	op(']', Token::RightBracket);
+	op(';', Token::Semicolon);
+	op(',', Token::Comma);
+	op('\n', Token::Newline);
+
+	for (size_t ch = 0; ch < 256; ++ch) {
+		if (is_digit(static_cast<char>(ch))) {
+			table[ch].kind = CharKind::Digit;
+		} else if (is_alpha(static_cast<char>(ch)) || ch == '_' || ch == '$') {
+			table[ch].kind = CharKind::IdentifierStart;
+		}
+	}
+
+	table[static_cast<uint8_t>('"')].kind = CharKind::Quote;
+	return table;
+}
+
+constexpr auto dispatch_table = make_dispatch_table();
 
 /**
  * @brief isodigit
@@ -23,275 +236,725 @@ bool isodigit(int ch) {
 	return ch >= '0' && ch < '8';
 }
 
+/**
+ * @brief skip_whitespace
+ * @param reader
+ * consumes whitespace, comments and line continuations up to the next token
+ */
+void skip_whitespace(Reader &reader) {
+	while (true) {
+		reader.skip(Scanner::skip_blanks(reader.remaining()));
+
+		// NOTE(eteran): a comment runs until the end of the line, but it
+		// must have at least one character in it, a lone '#' is an error
+		const std::string_view rest = reader.remaining();
+		if (rest.size() >= 2 && rest[0] == '#' && rest[1] != '\r' && rest[1] != '\n') {
+			reader.skip(1 + Scanner::find_line_end(rest.substr(1)));
+			continue;
+		}
+
+		// a backslash at the end of a line joins it with the next one
+		if (!reader.match("\\\n")) {
+			break;
+		}
+	}
 }
 
 /**
- * @brief Tokenizer::Tokenizer
- * @param filename
+ * @brief lex_token
+ * @param reader a reader positioned at the start of a token
+ * @param literal receives the decoded value of a string literal containing escapes
+ * @param literal_index the index to record in such a token for its decoded value
+ * @return the token
  */
-Tokenizer::Tokenizer(const std::string &filename) {
+Token lex_token(Reader &reader, std::string &literal, uint32_t literal_index) {
 
-	using std::isalpha;
-	using std::isdigit;
 	using std::isxdigit;
 
-	std::ifstream file(filename);
-	if (!file) {
-		throw FileNotFound(filename);
-	}
+	const size_t start    = reader.index();
+	char ch               = reader.peek();
+	const Dispatch &entry = dispatch_table[static_cast<uint8_t>(ch)];
 
-	auto source = std::string(std::istreambuf_iterator<char>{file}, {});
+	switch (entry.kind) {
+	case CharKind::Operator:
+		reader.read();
 
-	Reader reader(source);
+		// NOTE(eteran): two character operators take priority over their
+		// one character prefixes
+		for (const Dispatch::Pair &pair : entry.pairs) {
+			if (pair.type != Token::Invalid && reader.match(pair.second)) {
+				return Token(pair.type, start, reader.index() - start);
+			}
+		}
 
-	while (true) {
+		return Token(entry.type, start, reader.index() - start);
+	case CharKind::Digit: {
+		auto number = reader.match(integer_dfa);
+		if (!number) {
+			throw InvalidNumericConstant(reader.index());
+		}
+
+		// make sure that this is a valid integer that won't overflow
+		// when converted to an integer
+		int value;
+		auto [ptr, ec] = std::from_chars(number->data(), number->data() + number->size(), value, 10);
+		if (ec != std::errc()) {
+			throw InvalidNumericConstant(reader.index());
+		}
+
+		return Token(Token::Integer, start, reader.index() - start);
+	}
+	case CharKind::IdentifierStart: {
+		auto identifier = reader.match(identifier_dfa);
+		if (!identifier) {
+			throw InvalidIdentifier(reader.index());
+		}
+
+		return Token(keyword_type(*identifier), start, reader.index() - start);
+	}
+	case CharKind::Quote: {
+		// NOTE(eteran): most string literals don't contain any escape
+		// sequences, so their value can simply refer to the source text.
+		// We only build a decoded copy once we see the first backslash
+		std::string string;
+		bool escaped = false;
+
+		// consume the leading quote
+		reader.read();
+		const std::string_view contents = reader.remaining();
 
-		// consume whitespace and comments until the next token
 		while (true) {
-			if (!reader.match(whitespace_regex)) {
+			// skip straight to the next quote or backslash, copying the
+			// text in between if we are building a decoded value
+			const std::string_view rest = reader.remaining();
+			const size_t length         = Scanner::find_quote_or_backslash(rest);
+
+			if (escaped) {
+				string.append(rest.substr(0, length));
+			}
+
+			reader.skip(length);
+
+			if (reader.eof()) {
+				throw TokenizationError(reader.index());
+			}
+
+			if (reader.read() == '"') {
 				break;
 			}
-		}
 
-		if (reader.eof()) {
-			break;
-		}
+			if (!escaped) {
+				string.assign(contents.substr(0, reader.index() - start - 2));
+				escaped = true;
+			}
 
-		// NOTE(eteran): these should be ordered by length so that shorter tokens
-		// don't get prioritized over longer ones
-		if (reader.match("\\\n")) {
-			continue;
-		} else if (reader.match("++")) {
-			tokens_.emplace_back(Token::Increment, "++", reader.index());
-		} else if (reader.match("--")) {
-			tokens_.emplace_back(Token::Decrement, "--", reader.index());
-		} else if (reader.match("<=")) {
-			tokens_.emplace_back(Token::LessThanOrEqual, "<=", reader.index());
-		} else if (reader.match(">=")) {
-			tokens_.emplace_back(Token::GreaterThanOrEqual, ">=", reader.index());
-		} else if (reader.match("==")) {
-			tokens_.emplace_back(Token::Equal, "==", reader.index());
-		} else if (reader.match("!=")) {
-			tokens_.emplace_back(Token::NotEqual, "!=", reader.index());
-		} else if (reader.match("+=")) {
-			tokens_.emplace_back(Token::AddAssign, "+=", reader.index());
-		} else if (reader.match("-=")) {
-			tokens_.emplace_back(Token::SubAssign, "-=", reader.index());
-		} else if (reader.match("*=")) {
-			tokens_.emplace_back(Token::MulAssign, "*=", reader.index());
-		} else if (reader.match("/=")) {
-			tokens_.emplace_back(Token::DivAssign, "/=", reader.index());
-		} else if (reader.match("%=")) {
-			tokens_.emplace_back(Token::ModAssign, "%=", reader.index());
-		} else if (reader.match("&&")) {
-			tokens_.emplace_back(Token::LogicalAnd, "&&", reader.index());
-		} else if (reader.match("||")) {
-			tokens_.emplace_back(Token::LogicalOr, "||", reader.index());
-		} else if (reader.match('{')) {
-			tokens_.emplace_back(Token::LeftBrace, "{", reader.index());
-		} else if (reader.match('}')) {
-			tokens_.emplace_back(Token::RightBrace, "}", reader.index());
-		} else if (reader.match(')')) {
-			tokens_.emplace_back(Token::RightParen, ")", reader.index());
-		} else if (reader.match('(')) {
-			tokens_.emplace_back(Token::LeftParen, "(", reader.index());
-		} else if (reader.match(']')) {
-			tokens_.emplace_back(Token::RightBracket, "]", reader.index());
-		} else if (reader.match('[')) {
-			tokens_.emplace_back(Token::LeftBracket, "[", reader.index());
-		} else if (reader.match(';')) {
-			tokens_.emplace_back(Token::Semicolon, ";", reader.index());
-		} else if (reader.match(',')) {
-			tokens_.emplace_back(Token::Comma, ",", reader.index());
-		} else if (reader.match('\n')) {
-			tokens_.emplace_back(Token::Newline, "\n", reader.index());
-		} else if (reader.match('<')) {
-			tokens_.emplace_back(Token::LessThan, "<", reader.index());
-		} else if (reader.match('>')) {
-			tokens_.emplace_back(Token::GreaterThan, ">", reader.index());
-		} else if (reader.match('&')) {
-			tokens_.emplace_back(Token::BinaryAnd, "&", reader.index());
-		} else if (reader.match('|')) {
-			tokens_.emplace_back(Token::BinaryOr, "|", reader.index());
-		} else if (reader.match('!')) {
-			tokens_.emplace_back(Token::Not, "!", reader.index());
-		} else if (reader.match('=')) {
-			tokens_.emplace_back(Token::Assign, "=", reader.index());
-		} else if (reader.match('+')) {
-			tokens_.emplace_back(Token::Add, "+", reader.index());
-		} else if (reader.match('-')) {
-			tokens_.emplace_back(Token::Sub, "-", reader.index());
-		} else if (reader.match('*')) {
-			tokens_.emplace_back(Token::Mul, "*", reader.index());
-		} else if (reader.match('/')) {
-			tokens_.emplace_back(Token::Div, "/", reader.index());
-		} else if (reader.match('%')) {
-			tokens_.emplace_back(Token::Mod, "%", reader.index());
-		} else if (reader.match('^')) {
-			tokens_.emplace_back(Token::Exponent, "^", reader.index());
-		} else {
-			// identifiers/keywords
-			char ch = reader.peek();
-			if (isdigit(ch)) {
-
-				auto number = reader.match(integer_regex);
-				if (!number) {
-					throw InvalidNumericConstant(reader.index());
-				}
+			reader.push_state();
 
-				// make sure that this is a valid integer that won't overflow
-				// when converted to an integer
+			ch = reader.read();
+			switch (ch) {
+			case '\n':
+				reader.pop_state();
+				continue; // NOTE(eteran): support escaping a literal newline in the middle of a string
+			case '\'':
+				ch = '\'';
+				break;
+			case '\"':
+				ch = '\"';
+				break;
+			case '\\':
+				ch = '\\';
+				break;
+			case 'a':
+				ch = '\a';
+				break;
+			case 'b':
+				ch = '\b';
+				break;
+			case 'f':
+				ch = '\f';
+				break;
+			case 'n':
+				ch = '\n';
+				break;
+			case 'r':
+				ch = '\r';
+				break;
+			case 't':
+				ch = '\t';
+				break;
+			case 'v':
+				ch = '\v';
+				break;
+			case 'e':
+				ch = '\x1b';
+				break;
+			case 'x':
+			case 'X':
 				try {
-					(void)std::stoi(*number, nullptr, 10);
-				} catch (const std::out_of_range &ex) {
-					(void)ex;
-					throw InvalidNumericConstant(reader.index());
+					std::string hex;
+
+					while (isxdigit(reader.peek())) {
+						hex.push_back(reader.read());
+					}
+
+					ch = static_cast<char>(std::stoi(hex, nullptr, 16));
+
+					// NOTE(eteran): this is a quirk in the NEdit macro language
+					// which attempts to actively prevent literal NULs in strings
+					// by simply ignoring the leading backslash and reparsing
+					if (ch == 0) {
+						reader.restore_state();
+						continue;
+					}
+
+				} catch (...) {
+					reader.pop_state();
+					throw InvalidEscapeSequence(reader.index());
 				}
+				break;
+			case '0':
+			case '1':
+			case '2':
+			case '3':
+			case '4':
+			case '5':
+			case '6':
+			case '7':
+				try {
+					std::string oct = {ch};
+
+					while (isodigit(reader.peek())) {
+						oct.push_back(reader.read());
+					}
 
-				tokens_.emplace_back(Token::Integer, *number, reader.index());
-			} else if (isalpha(ch) || ch == '_' || ch == '$') {
+					ch = static_cast<char>(std::stoi(oct, nullptr, 8));
+
+					// NOTE(eteran): this is a quirk in the NEdit macro language
+					// which attempts to actively prevent literal NULs in strings
+					// by simply ignoring the leading backslash and reparsing
+					if (ch == 0) {
+						reader.restore_state();
+						continue;
+					}
 
-				auto identifier = reader.match(identifier_regex);
-				if (!identifier) {
-					throw InvalidIdentifier(reader.index());
+				} catch (...) {
+					reader.pop_state();
+					throw InvalidEscapeSequence(reader.index());
 				}
+				break;
+			default:
+				reader.pop_state();
+				throw InvalidEscapeSequence(reader.index());
+			}
 
-				if (*identifier == "while") {
-					tokens_.emplace_back(Token::While, *identifier, reader.index());
-				} else if (*identifier == "define") {
-					tokens_.emplace_back(Token::Define, *identifier, reader.index());
-				} else if (*identifier == "in") {
-					tokens_.emplace_back(Token::In, *identifier, reader.index());
-				} else if (*identifier == "for") {
-					tokens_.emplace_back(Token::For, *identifier, reader.index());
-				} else if (*identifier == "delete") {
-					tokens_.emplace_back(Token::Delete, *identifier, reader.index());
-				} else if (*identifier == "if") {
-					tokens_.emplace_back(Token::If, *identifier, reader.index());
-				} else if (*identifier == "else") {
-					tokens_.emplace_back(Token::Else, *identifier, reader.index());
-				} else if (*identifier == "switch") {
-					tokens_.emplace_back(Token::Switch, *identifier, reader.index());
-				} else if (*identifier == "break") {
-					tokens_.emplace_back(Token::Break, *identifier, reader.index());
-				} else if (*identifier == "continue") {
-					tokens_.emplace_back(Token::Continue, *identifier, reader.index());
-				} else if (*identifier == "return") {
-					tokens_.emplace_back(Token::Return, *identifier, reader.index());
-				} else {
-					tokens_.emplace_back(Token::Identifier, *identifier, reader.index());
+			reader.pop_state();
+			string.push_back(ch);
+		}
+
+		if (escaped) {
+			literal = std::move(string);
+			return Token(Token::String, start, reader.index() - start, literal_index);
+		}
+
+		return Token(Token::String, start, reader.index() - start);
+	}
+	case CharKind::Invalid:
+		break;
+	}
+
+	throw TokenizationError(reader.index());
+}
+
+/**
+ * @brief next_token
+ * @param reader a reader positioned at the start of a token
+ * @param literal receives the decoded value of a string literal containing escapes
+ * @param literal_index the index to record in such a token for its decoded value
+ * @return the token, or if the input there can't be lexed, an Error token
+ * spanning the bad input, so that lexing can carry on after it and one
+ * mistake doesn't hide the rest of the input
+ */
+Token next_token(Reader &reader, std::string &literal, uint32_t literal_index) {
+
+	const size_t start = reader.index();
+	const bool quoted  = reader.peek() == '"';
+
+	try {
+		return lex_token(reader, literal, literal_index);
+	} catch (const TokenizationError &) {
+		if (quoted) {
+			// NOTE(eteran): a bad escape sequence spoils the whole string, so
+			// skip to its closing quote (if there is one), rather than lexing
+			// the rest of it as code
+			while (!reader.eof()) {
+				reader.skip(Scanner::find_quote_or_backslash(reader.remaining()));
+				if (reader.eof() || reader.read() == '"') {
+					break;
 				}
-			} else if (ch == '"') {
-				std::string string;
 
-				// consume the leading quote
 				reader.read();
+			}
+		} else if (reader.index() == start) {
+			reader.read();
+		}
 
-				while ((ch = reader.read()) != '"') {
-					if (ch == '\\') {
-
-						Reader backslash = reader;
-
-						ch = reader.read();
-						switch (ch) {
-						case '\n':
-							continue; // NOTE(eteran): support escaping a literal newline in the middle of a string
-						case '\'':
-							ch = '\'';
-							break;
-						case '\"':
-							ch = '\"';
-							break;
-						case '\\':
-							ch = '\\';
-							break;
-						case 'a':
-							ch = '\a';
-							break;
-						case 'b':
-							ch = '\b';
-							break;
-						case 'f':
-							ch = '\f';
-							break;
-						case 'n':
-							ch = '\n';
-							break;
-						case 'r':
-							ch = '\r';
-							break;
-						case 't':
-							ch = '\t';
-							break;
-						case 'v':
-							ch = '\v';
-							break;
-						case 'e':
-							ch = '\x1b';
-							break;
-						case 'x':
-						case 'X':
-							try {
-								std::string hex;
-
-								while (isxdigit(reader.peek())) {
-									hex.push_back(reader.read());
-								}
-
-								ch = static_cast<char>(std::stoi(hex, nullptr, 16));
-
-								// NOTE(eteran): this is a quirk in the NEdit macro language
-								// which attempts to actively prevent literal NULs in strings
-								// by simply ignoring the leading backslash and reparsing
-								if (ch == 0) {
-									reader = backslash;
-									continue;
-								}
-
-							} catch (...) {
-								throw InvalidEscapeSequence(reader.index());
-							}
-							break;
-						case '0':
-						case '1':
-						case '2':
-						case '3':
-						case '4':
-						case '5':
-						case '6':
-						case '7':
-							try {
-								std::string oct = {ch};
-
-								while (isodigit(reader.peek())) {
-									oct.push_back(reader.read());
-								}
-
-								ch = static_cast<char>(std::stoi(oct, nullptr, 8));
-
-								// NOTE(eteran): this is a quirk in the NEdit macro language
-								// which attempts to actively prevent literal NULs in strings
-								// by simply ignoring the leading backslash and reparsing
-								if (ch == 0) {
-									reader = backslash;
-									continue;
-								}
-
-							} catch (...) {
-								throw InvalidEscapeSequence(reader.index());
-							}
-							break;
-						default:
-							throw InvalidEscapeSequence(reader.index());
-						}
-					}
-					string.push_back(ch);
+		return Token(Token::Error, start, reader.index() - start);
+	}
+}
+
+constexpr size_t MinChunkSize = 256 * 1024;
+
+/**
+ * @brief a piece of the input, lexed independently of the rest
+ */
+struct Chunk {
+	size_t first = 0;
+	size_t last  = 0;
+	std::vector<Token> tokens;
+	std::deque<std::string> literals;
+};
+
+/**
+ * @brief split_chunks
+ * @param source
+ * @param threads
+ * @return the input split into a few chunks per thread, each starting just after a newline
+ */
+std::vector<Chunk> split_chunks(std::string_view source, size_t threads) {
+
+	const size_t count = std::max<size_t>(1, std::min(threads * 4, source.size() / MinChunkSize));
+
+	std::vector<Chunk> chunks;
+	size_t first = 0;
+
+	for (size_t i = 1; i < count && first < source.size(); ++i) {
+		const size_t target = std::max(first, i * source.size() / count);
+		const size_t split  = source.find('\n', target);
+		if (split == std::string_view::npos) {
+			break;
+		}
+
+		Chunk chunk;
+		chunk.first = first;
+		chunk.last  = split + 1;
+		chunks.push_back(std::move(chunk));
+		first = split + 1;
+	}
+
+	Chunk chunk;
+	chunk.first = first;
+	chunk.last  = source.size();
+	chunks.push_back(std::move(chunk));
+	return chunks;
+}
+
+/**
+ * @brief lex_chunk
+ * @param source
+ * @param chunk
+ *
+ * Lexes every token which starts within the chunk, a token may extend past the
+ * end of the chunk. Error tokens here may simply be the result of the chunk
+ * starting in the middle of a token, stitching the chunks together sorts that out
+ */
+void lex_chunk(std::string_view source, Chunk &chunk) {
+
+	Reader reader(source);
+	reader.skip(chunk.first);
+
+	while (true) {
+		skip_whitespace(reader);
+		if (reader.eof() || reader.index() >= chunk.last) {
+			break;
+		}
+
+		std::string literal;
+		const Token token = next_token(reader, literal, static_cast<uint32_t>(chunk.literals.size()));
+		if (token.literal != Token::NoLiteral) {
+			chunk.literals.push_back(std::move(literal));
+		}
+
+		chunk.tokens.push_back(token);
+	}
+}
+
+}
+
+/**
+ * @brief Tokenizer::Tokenizer
+ * @param filename
+ */
+Tokenizer::Tokenizer(const std::string &filename)
+	: source_(filename), reader_(source_.data()) {
+}
+
+/**
+ * @brief Tokenizer::tokenize
+ * @param threads the number of threads to lex with
+ *
+ * Lexes the whole input up front. The input is split into chunks at newlines,
+ * which are lexed concurrently, each one assuming that it starts between two
+ * tokens. That assumption is wrong when the split lands inside of a token
+ * which spans lines (a string literal with embedded or escaped newlines), so
+ * while stitching the chunks back together we check that each one starts
+ * where the previous one actually finished, and if not, relex serially until
+ * we reach a position that the chunk's own tokens agree with.
+ */
+void Tokenizer::tokenize(size_t threads) {
+
+	assert(!materialized_ && count_ == 0 && reader_.index() == 0);
+
+	const std::string_view source = source_.data();
+	std::vector<Chunk> chunks     = split_chunks(source, threads);
+
+	{
+		ThreadPool pool(threads);
+		std::vector<std::future<void>> results;
+
+		for (Chunk &chunk : chunks) {
+			results.push_back(pool.submit([source, &chunk]() {
+				lex_chunk(source, chunk);
+			}));
+		}
+
+		for (std::future<void> &result : results) {
+			result.get();
+		}
+	}
+
+	materialized_ = true;
+	end_          = Token(Token::Invalid, source.size(), 0);
+
+	size_t count = 0;
+	for (const Chunk &chunk : chunks) {
+		count += chunk.tokens.size();
+	}
+
+	tokens_.reserve(count);
+
+	// the position just past the last token we have accepted
+	size_t end = 0;
+
+	auto accept = [this, &end](Token token, std::string literal) {
+		if (token.literal != Token::NoLiteral) {
+			token.literal = static_cast<uint32_t>(strings_.size());
+			strings_.push_back(std::move(literal));
+		}
+
+		tokens_.push_back(token);
+		end = token.index();
+	};
+
+	for (Chunk &chunk : chunks) {
+
+		// find the first of this chunk's tokens which we can trust
+		auto first = chunk.tokens.begin();
+
+		if (end > chunk.first) {
+			// the previous chunk's last token ran into this one, relex from
+			// where it ended until we land on a boundary that this chunk agrees with
+			Reader reader(source);
+			reader.skip(end);
+
+			bool synchronized = false;
+
+			while (true) {
+				auto it = std::lower_bound(chunk.tokens.begin(), chunk.tokens.end(), end, [](const Token &token, size_t index) {
+					return token.index() < index;
+				});
+
+				if (it != chunk.tokens.end() && it->index() == end) {
+					first        = std::next(it);
+					synchronized = true;
+					break;
 				}
 
-				tokens_.emplace_back(Token::String, string, reader.index());
-			} else {
-				throw TokenizationError(reader.index());
+				skip_whitespace(reader);
+				if (reader.eof() || reader.index() >= chunk.last) {
+					break;
+				}
+
+				std::string literal;
+				const Token token = next_token(reader, literal, 0);
+				accept(token, std::move(literal));
 			}
+
+			if (!synchronized) {
+				// NOTE(eteran): we relexed everything that starts in this chunk
+				// ourselves, so none of its tokens can be trusted
+				continue;
+			}
+		}
+
+		for (auto it = first; it != chunk.tokens.end(); ++it) {
+			accept(*it, it->literal != Token::NoLiteral ? std::move(chunk.literals[it->literal]) : std::string());
+		}
+	}
+}
+
+/**
+ * @brief Tokenizer::edit
+ * @param offset where the edit starts
+ * @param removed how many characters to remove, starting at offset
+ * @param inserted the text to insert in their place
+ *
+ * Applies an edit to the input and updates the tokens to match. If the input
+ * hasn't been tokenized yet, that is done first, and any tokens which were
+ * read one at a time are forgotten (they are numbered the same either way).
+ * Lexing restarts at the end of the last token which the edit can't have
+ * affected (a token can look one character past its end) and stops as soon
+ * as it lands on the start of one of the old tokens which followed the edit,
+ * from there on the old tokens are reused, shifted by the change in length.
+ * Afterwards, reading starts over from the first token.
+ *
+ * @return which of the tokens were replaced, and by how many new ones
+ */
+Tokenizer::Change Tokenizer::edit(size_t offset, size_t removed, std::string_view inserted) {
+
+	if (!materialized_) {
+		reader_ = Reader(source_.data());
+		head_   = 0;
+		count_  = 0;
+		tokenize(1);
+	}
+
+	const size_t size = source_.data().size();
+	offset            = std::min(offset, size);
+	removed           = std::min(removed, size - offset);
+
+	source_.replace(offset, removed, inserted);
+	reader_.replace(source_.data(), offset, removed, inserted.size());
+	position_ = 0;
+	end_      = Token(Token::Invalid, source_.data().size(), 0);
+
+	auto first = std::lower_bound(tokens_.begin(), tokens_.end(), offset, [](const Token &token, size_t index) {
+		return token.index() < index;
+	});
+
+	// the old tokens which start after the edit, and so may be reused
+	auto reusable = std::lower_bound(first, tokens_.end(), offset + removed, [](const Token &token, size_t index) {
+		return token.offset < index;
+	});
+
+	Reader reader(source_.data());
+	reader.skip(first == tokens_.begin() ? 0 : std::prev(first)->index());
+
+	std::vector<Token> relexed;
+
+	while (true) {
+		skip_whitespace(reader);
+
+		while (reusable != tokens_.end() && reusable->offset - removed + inserted.size() < reader.index()) {
+			++reusable;
+		}
+
+		if (reader.eof() || (reusable != tokens_.end() && reusable->offset - removed + inserted.size() == reader.index())) {
+			break;
+		}
+
+		std::string literal;
+		Token token = next_token(reader, literal, 0);
+		if (token.literal != Token::NoLiteral) {
+			token.literal = allocate_literal(std::move(literal));
 		}
+
+		relexed.push_back(token);
+	}
+
+	for (auto it = first; it != reusable; ++it) {
+		if (it->literal != Token::NoLiteral) {
+			strings_[it->literal].clear();
+			free_strings_.push_back(it->literal);
+		}
+	}
+
+	if (removed != inserted.size()) {
+		for (auto it = reusable; it != tokens_.end(); ++it) {
+			it->offset = it->offset - removed + inserted.size();
+		}
+	}
+
+	// NOTE(eteran): most edits relex as many tokens as they replace, so
+	// overwrite what we can in place rather than moving the whole tail
+	const auto replaced = std::distance(first, reusable);
+	const auto common   = std::min(replaced, static_cast<std::ptrdiff_t>(relexed.size()));
+
+	Change change;
+	change.first    = static_cast<size_t>(std::distance(tokens_.begin(), first));
+	change.removed  = static_cast<size_t>(replaced);
+	change.inserted = relexed.size();
+
+	first = std::copy_n(relexed.begin(), common, first);
+	if (common < replaced) {
+		tokens_.erase(first, std::next(first, replaced - common));
+	} else {
+		tokens_.insert(first, std::next(relexed.begin(), common), relexed.end());
+	}
+
+	return change;
+}
+
+/**
+ * @brief Tokenizer::allocate_literal
+ * @param literal
+ * @return the index at which the literal was stored, reusing one of the slots
+ * freed by an earlier edit if there is one
+ */
+uint32_t Tokenizer::allocate_literal(std::string literal) {
+
+	if (free_strings_.empty()) {
+		strings_.push_back(std::move(literal));
+		return static_cast<uint32_t>(strings_.size() - 1);
 	}
+
+	const uint32_t index = free_strings_.back();
+	free_strings_.pop_back();
+	strings_[index] = std::move(literal);
+	return index;
+}
+
+/**
+ * @brief Tokenizer::fill
+ * @param n how many tokens to look past the next one, must be less than LookAhead
+ * @return the next token without consuming it, an Invalid token at the end of the input
+ *
+ * The slow path of peek, taken when the token isn't already in the ring
+ */
+const Token &Tokenizer::fill(size_t n) {
+	assert(n < LookAhead);
+
+	if (materialized_) {
+		return at(position_ + n);
+	}
+
+	while (count_ <= n) {
+		const auto slot = static_cast<uint32_t>((head_ + count_) % LookAhead);
+		ring_[slot]     = lex(slot);
+		++count_;
+
+		if (ring_[slot].type == Token::Invalid) {
+			// NOTE(eteran): once we hit the end, keep handing back the same token
+			return ring_[slot];
+		}
+	}
+
+	return ring_[(head_ + n) % LookAhead];
+}
+
+/**
+ * @brief Tokenizer::read
+ * @return the next token, which remains valid until the next call to peek or read
+ */
+const Token &Tokenizer::read() {
+	const Token &token = peek();
+
+	if (token.type != Token::Invalid) {
+		++position_;
+
+		if (!materialized_) {
+			head_ = (head_ + 1) % LookAhead;
+			--count_;
+		}
+	}
+
+	return token;
+}
+
+/**
+ * @brief Tokenizer::at
+ * @param position
+ * @return the token at the given position, an Invalid token past the end of
+ * the input. The input must have been tokenized first
+ *
+ * NOTE(eteran): unlike peek, this doesn't change the tokenizer, so parsers on
+ * other threads may use it to read the tokens concurrently
+ */
+const Token &Tokenizer::at(size_t position) const {
+	assert(materialized_);
+
+	if (position < tokens_.size()) {
+		return tokens_[position];
+	}
+
+	return end_;
+}
+
+/**
+ * @brief Tokenizer::seek
+ * @param position the position of the next token to read, the input must have
+ * been tokenized first
+ */
+void Tokenizer::seek(size_t position) {
+	assert(materialized_);
+	position_ = std::min(position, tokens_.size());
+}
+
+/**
+ * @brief Tokenizer::lex
+ * @param slot the ring buffer slot which will hold the token
+ * @return the next token in the input
+ */
+Token Tokenizer::lex(uint32_t slot) {
+
+	skip_whitespace(reader_);
+
+	// NOTE(eteran): the end of the input is an Invalid token, placed at the
+	// end so that errors found there are reported where they are
+	if (reader_.eof()) {
+		return Token(Token::Invalid, reader_.index(), 0);
+	}
+
+	return next_token(reader_, literals_[slot], slot);
+}
+
+/**
+ * @brief Tokenizer::throw_error
+ * @param token an Error token
+ *
+ * Throws the error which stopped the token from being lexed. Error tokens
+ * only say where the problem is, they are rare enough that the error itself
+ * is simply found again by relexing the token
+ */
+void Tokenizer::throw_error(const Token &token) const {
+	assert(token.type == Token::Error);
+
+	Reader reader(source_.data());
+	reader.skip(token.offset);
+
+	std::string literal;
+	lex_token(reader, literal, 0);
+
+	// NOTE(eteran): not reached, lexing the same text fails the same way
+	throw TokenizationError(token.offset);
+}
+
+/**
+ * @brief Tokenizer::text
+ * @param token
+ * @return the text of the token, for string literals this is the decoded
+ * value without the surrounding quotes
+ */
+std::string_view Tokenizer::text(const Token &token) const {
+
+	if (token.literal != Token::NoLiteral) {
+		return materialized_ ? strings_[token.literal] : literals_[token.literal];
+	}
+
+	std::string_view text = source_.data().substr(token.offset, token.length);
+
+	if (token.type == Token::String) {
+		text.remove_prefix(1);
+		text.remove_suffix(1);
+	}
+
+	return text;
+}
+
+/**
+ * @brief Tokenizer::location
+ * @param index
+ * @return the line and column of the given offset in the source
+ */
+Reader::Location Tokenizer::location(size_t index) const {
+	return reader_.location(index);
 }
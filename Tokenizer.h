@@ -2,29 +2,93 @@
 #ifndef TOKERNIZER_H_
 #define TOKERNIZER_H_
 
+#include "Reader.h"
+#include "Source.h"
 #include "Token.h"
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
 #include <vector>
 
+/**
+ * @brief A pull based tokenizer, tokens are lexed on demand as the parser asks
+ * for them and only a small window of lookahead is ever kept in memory.
+ * Alternatively, tokenize() can lex the whole input up front, in parallel,
+ * after which the tokens are handed out from memory instead, and the input can
+ * be edited, relexing only the part of it which the edit affects. Input which
+ * can't be lexed is handed out as an Error token, rather than stopping lexing.
+ */
 class Tokenizer {
 public:
-	explicit Tokenizer(const std::string &filename);
+	static constexpr size_t LookAhead = 4;
+
+	/**
+	 * @brief what an edit did to the tokens, those before first are unchanged
+	 * and those after the replaced ones are the same as before, but shifted
+	 */
+	struct Change {
+		size_t first    = 0;
+		size_t removed  = 0; // how many of the old tokens were replaced
+		size_t inserted = 0; // and how many new ones replaced them
+	};
 
 public:
-	size_t size() const {
-		return tokens_.size();
-	}
+	explicit Tokenizer(const std::string &filename);
+	Tokenizer(const Tokenizer &other)          = delete;
+	Tokenizer &operator=(const Tokenizer &rhs) = delete;
+	~Tokenizer()                               = default;
 
 public:
-	Token operator[](const size_t index) const {
-		if (index < tokens_.size()) {
-			return tokens_[index];
-		} else {
-			return Token();
+	void tokenize(size_t threads);
+	Change edit(size_t offset, size_t removed, std::string_view inserted);
+	// NOTE(eteran): the parser peeks several times per token, so the common
+	// case of an already lexed token is kept inline
+	const Token &peek(size_t n = 0) {
+		if (n < count_) {
+			return ring_[(head_ + n) % LookAhead];
 		}
+
+		return fill(n);
 	}
 
+	const Token &read();
+	const Token &at(size_t position) const;
+	size_t size() const noexcept { return tokens_.size(); }
+	size_t position() const noexcept { return position_; }
+	bool tokenized() const noexcept { return materialized_; }
+	void seek(size_t position);
+	std::string_view text(const Token &token) const;
+	Reader::Location location(size_t index) const;
+	[[noreturn]] void throw_error(const Token &token) const;
+
 private:
+	const Token &fill(size_t n);
+	Token lex(uint32_t slot);
+	uint32_t allocate_literal(std::string literal);
+
+private:
+	Source source_;
+	Reader reader_;
+	std::array<Token, LookAhead> ring_;
+	size_t head_  = 0;
+	size_t count_ = 0;
+
+	// NOTE(eteran): decoded string literals, one per ring buffer slot, so they
+	// live exactly as long as the token which refers to them
+	std::array<std::string, LookAhead> literals_;
+
+	// NOTE(eteran): only used once tokenize() has been called, a deque so that
+	// references to the strings remain valid as it grows
 	std::vector<Token> tokens_;
+	std::deque<std::string> strings_;
+	std::vector<uint32_t> free_strings_;
+	Token end_;
+	bool materialized_ = false;
+
+	// NOTE(eteran): how many tokens have been read, in either mode
+	size_t position_ = 0;
 };
 
 #endif
@@ -0,0 +1,114 @@
+
+#ifndef VISITOR_H_
+#define VISITOR_H_
+
+#include "Expression.h"
+#include "Statement.h"
+#include <cstdlib>
+#include <type_traits>
+
+// NOTE(eteran): the AST doesn't use RTTI, every node is tagged with its kind
+// instead. node_cast<T> is a cheap replacement for dynamic_cast<T *>, and visit
+// calls the visitor with the node converted to its most derived type, which
+// is a single switch no matter how many kinds of node there are
+
+namespace detail {
+
+template <class To, class From>
+using match_const_t = std::conditional_t<std::is_const_v<From>, const To, To>;
+
+template <class Node, class Base>
+constexpr bool is_node_v = std::is_same_v<std::remove_const_t<Node>, Base>;
+
+}
+
+/**
+ * @brief Combines several lambdas into a single visitor
+ */
+template <class... Ts>
+struct Overloaded : Ts... {
+	using Ts::operator()...;
+};
+
+template <class... Ts>
+Overloaded(Ts...) -> Overloaded<Ts...>;
+
+/**
+ * @brief node_cast
+ * @param node
+ * @return node as a T, or nullptr if node is null or isn't a T
+ */
+template <class T, class Node>
+detail::match_const_t<T, Node> *node_cast(Node *node) noexcept {
+	if (node && node->kind == T::StaticKind) {
+		return static_cast<detail::match_const_t<T, Node> *>(node);
+	}
+
+	return nullptr;
+}
+
+/**
+ * @brief visit
+ * @param expression must not be null
+ * @param visitor
+ * @return whatever the visitor returns
+ */
+template <class E, class Visitor, class = std::enable_if_t<detail::is_node_v<E, Expression>>>
+decltype(auto) visit(E *expression, Visitor &&visitor) {
+
+	using Kind = Expression::Kind;
+
+	switch (expression->kind) {
+	case Kind::Binary:
+		return visitor(static_cast<detail::match_const_t<BinaryExpression, E> *>(expression));
+	case Kind::Unary:
+		return visitor(static_cast<detail::match_const_t<UnaryExpression, E> *>(expression));
+	case Kind::Atom:
+		return visitor(static_cast<detail::match_const_t<AtomExpression, E> *>(expression));
+	case Kind::Call:
+		return visitor(static_cast<detail::match_const_t<CallExpression, E> *>(expression));
+	case Kind::ArrayIndex:
+		return visitor(static_cast<detail::match_const_t<ArrayIndexExpression, E> *>(expression));
+	}
+
+	std::abort();
+}
+
+/**
+ * @brief visit
+ * @param statement must not be null
+ * @param visitor
+ * @return whatever the visitor returns
+ */
+template <class S, class Visitor, class = std::enable_if_t<detail::is_node_v<S, Statement>>, class = void>
+decltype(auto) visit(S *statement, Visitor &&visitor) {
+
+	using Kind = Statement::Kind;
+
+	switch (statement->kind) {
+	case Kind::Delete:
+		return visitor(static_cast<detail::match_const_t<DeleteStatement, S> *>(statement));
+	case Kind::Function:
+		return visitor(static_cast<detail::match_const_t<FunctionStatement, S> *>(statement));
+	case Kind::Block:
+		return visitor(static_cast<detail::match_const_t<BlockStatement, S> *>(statement));
+	case Kind::Cond:
+		return visitor(static_cast<detail::match_const_t<CondStatement, S> *>(statement));
+	case Kind::Loop:
+		return visitor(static_cast<detail::match_const_t<LoopStatement, S> *>(statement));
+	case Kind::ForEach:
+		return visitor(static_cast<detail::match_const_t<ForEachStatement, S> *>(statement));
+	case Kind::Break:
+		return visitor(static_cast<detail::match_const_t<BreakStatement, S> *>(statement));
+	case Kind::Continue:
+		return visitor(static_cast<detail::match_const_t<ContinueStatement, S> *>(statement));
+	case Kind::Expression:
+		return visitor(static_cast<detail::match_const_t<ExpressionStatement, S> *>(statement));
+	case Kind::Return:
+		return visitor(static_cast<detail::match_const_t<ReturnStatement, S> *>(statement));
+	}
+
+	std::abort();
+}
+
+#endif
@@ -1,8 +1,14 @@
 
 #include "CodeGenerator.h"
+#include "CompilationUnit.h"
+#include "Diagnostics.h"
 #include "Error.h"
+#include "FlatAst.h"
 #include "Optimizer.h"
 #include "Parser.h"
+#include "ThreadPool.h"
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <list>
 #include <stack>
@@ -15,45 +21,87 @@
  */
 int main(int argc, char *argv[]) {
 
-	if (argc < 2) {
-		printf("%s <filename>\n", argv[0]);
+	size_t threads = 1;
+	bool flat      = false;
+	bool stats     = false;
+	bool rotate    = false;
+	int argi       = 1;
+
+	for (; argi < argc && argv[argi][0] == '-'; ++argi) {
+		if (std::strncmp(argv[argi], "-j", 2) == 0) {
+			const char *count = argv[argi] + 2;
+			threads           = *count ? std::strtoul(count, nullptr, 10) : ThreadPool::default_threads();
+		} else if (std::strcmp(argv[argi], "-f") == 0) {
+			flat = true;
+		} else if (std::strcmp(argv[argi], "-s") == 0) {
+			stats = true;
+		} else if (std::strcmp(argv[argi], "-r") == 0) {
+			rotate = true;
+		} else {
+			break;
+		}
+	}
+
+	if (argi >= argc || threads == 0 || argv[argi][0] == '-') {
+		printf("%s [-j<threads>] [-f] [-s] [-r] <filename>\n", argv[0]);
 		return -1;
 	}
 
 	try {
-		std::vector<std::unique_ptr<Statement>> statements;
+		CompilationUnit unit;
+		std::vector<Statement *> statements;
 
-		Parser parser(argv[1]);
+		Parser parser(argv[argi], unit.arena);
 
-		while (true) {
-			auto statement = parser.parseStatement();
-			if (!statement) {
-				break;
-			}
+		Diagnostics diagnostics;
+		statements = parser.parseStatements(threads, diagnostics);
 
-			statements.emplace_back(std::move(statement));
+		if (!diagnostics.empty()) {
+			for (const Diagnostic &diagnostic : diagnostics) {
+				const Reader::Location loc = parser.location(diagnostic.syntax ? diagnostic.token.offset : diagnostic.index);
+				std::cerr << diagnostic.what << std::endl;
+				std::cerr << "At Index:  " << diagnostic.index << std::endl;
+				std::cerr << "At Line:   " << loc.line << ", Column: " << loc.column << std::endl;
+				if (diagnostic.syntax) {
+					std::cerr << "Token:     " << parser.text(diagnostic.token) << std::endl;
+				}
+			}
+			return -1;
 		}
 
-		Optimizer::prune_empty_statements(statements);
-#if 0
-        Optimizer::fold_constant_expressions(statements);
-#endif
+		unit.statements = unit.arena.make_list(statements);
+
+		if (flat) {
+			FlatAst ast(unit.statements);
+
+			Optimizer::prune_empty_statements(ast);
+			Optimizer::fold_constant_expressions(ast);
+			Optimizer::eliminate_dead_code(ast);
+
+			CodeGenerator::generate(ast, rotate);
+		} else {
+			Optimizer::prune_empty_statements(unit.statements);
+			Optimizer::fold_constant_expressions(unit.arena, unit.statements);
+			Optimizer::eliminate_dead_code(unit.statements);
 
-		CodeGenerator::generate(statements);
+			CodeGenerator::generate(unit.statements, rotate);
+		}
+
+		CodeGenerator::optimize_ir();
 		CodeGenerator::print_ir();
 
-	} catch (const SyntaxError &ex) {
-		std::cerr << ex.what() << std::endl;
-		std::cerr << "At Index:  " << ex.index() << std::endl;
-		std::cerr << "Token:     " << ex.token().value << std::endl;
-		return -1;
-	} catch (const TokenizationError &ex) {
+		if (stats) {
+			CodeGenerator::print_statistics();
+		}
+
+	} catch (const FileNotFound &ex) {
 		std::cerr << ex.what() << std::endl;
-		std::cerr << "At Index:  " << ex.index() << std::endl;
+		std::cerr << "Filename:   " << ex.filename() << std::endl;
 		return -1;
-	} catch (const FileNotFound &ex) {
+	} catch (const FileReadError &ex) {
 		std::cerr << ex.what() << std::endl;
 		std::cerr << "Filename:   " << ex.filename() << std::endl;
+		std::cerr << "Reason:     " << ex.reason() << std::endl;
 		return -1;
 	}
 }
@@ -0,0 +1,262 @@
+
+#include "Dfa.h"
+#include "Scanner.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+// NOTE(eteran): the patterns which the tokenizer matched with std::regex
+// before the DFA scanner replaced them
+const std::regex integer_regex(R"((0|[1-9][0-9]*))");
+const std::regex identifier_regex(R"([_a-zA-Z$][_a-zA-Z0-9]*)");
+const std::regex whitespace_regex(R"([ \f\r\t\b]+|#.+)");
+
+constexpr bool is_digit(char ch) {
+	return ch >= '0' && ch <= '9';
+}
+
+constexpr bool is_alpha(char ch) {
+	return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z');
+}
+
+// NOTE(eteran): built the same way as the tokenizer's own tables, the
+// benchmark checks that they match what the regexes do
+constexpr Dfa<3> make_integer_dfa() {
+	Dfa<3> dfa;
+	dfa.transition(0, 1, [](char ch) { return ch == '0'; });
+	dfa.transition(0, 2, [](char ch) { return ch >= '1' && ch <= '9'; });
+	dfa.transition(2, 2, is_digit);
+	dfa.accept[1] = true;
+	dfa.accept[2] = true;
+	return dfa;
+}
+
+constexpr Dfa<2> make_identifier_dfa() {
+	Dfa<2> dfa;
+	dfa.transition(0, 1, [](char ch) { return is_alpha(ch) || ch == '_' || ch == '$'; });
+	dfa.transition(1, 1, [](char ch) { return is_alpha(ch) || is_digit(ch) || ch == '_'; });
+	dfa.accept[1] = true;
+	return dfa;
+}
+
+constexpr auto integer_dfa    = make_integer_dfa();
+constexpr auto identifier_dfa = make_identifier_dfa();
+
+/**
+ * @brief matches the way that Reader::match(const std::regex &) used to,
+ * copying what it matched
+ */
+struct RegexMatcher {
+	static size_t match(std::string_view input, const std::regex &regex) {
+		std::cmatch matches;
+		if (std::regex_search(input.data(), input.data() + input.size(), matches, regex, std::regex_constants::match_continuous)) {
+			const std::string m(matches[0].first, matches[0].second);
+			return m.size();
+		}
+
+		return 0;
+	}
+
+	size_t whitespace(std::string_view input) const {
+		size_t length = 0;
+		while (size_t n = match(input.substr(length), whitespace_regex)) {
+			length += n;
+		}
+
+		return length;
+	}
+
+	size_t integer(std::string_view input) const {
+		return match(input, integer_regex);
+	}
+
+	size_t identifier(std::string_view input) const {
+		return match(input, identifier_regex);
+	}
+};
+
+/**
+ * @brief matches the way that the tokenizer does now
+ */
+struct DfaMatcher {
+	size_t whitespace(std::string_view input) const {
+		size_t length = 0;
+		while (true) {
+			length += Scanner::skip_blanks(input.substr(length));
+
+			const std::string_view rest = input.substr(length);
+			if (rest.size() >= 2 && rest[0] == '#' && rest[1] != '\r' && rest[1] != '\n') {
+				length += 1 + Scanner::find_line_end(rest.substr(1));
+				continue;
+			}
+
+			return length;
+		}
+	}
+
+	size_t integer(std::string_view input) const {
+		return integer_dfa.longest_match(input);
+	}
+
+	size_t identifier(std::string_view input) const {
+		return identifier_dfa.longest_match(input);
+	}
+};
+
+struct Span {
+	size_t offset;
+	size_t length;
+
+	bool operator==(const Span &rhs) const {
+		return offset == rhs.offset && length == rhs.length;
+	}
+};
+
+/**
+ * @brief scan
+ * @param input
+ * @param matcher
+ * @return the integers and identifiers in input, skipping whitespace and
+ * comments before each token, and anything else one character at a time
+ * (strings as a whole)
+ */
+template <class Matcher>
+std::vector<Span> scan(std::string_view input, const Matcher &matcher) {
+	std::vector<Span> spans;
+	size_t i = 0;
+
+	while (true) {
+		i += matcher.whitespace(input.substr(i));
+		if (i == input.size()) {
+			break;
+		}
+
+		size_t length = 0;
+		const char ch = input[i];
+		if (is_digit(ch)) {
+			length = matcher.integer(input.substr(i));
+		} else if (is_alpha(ch) || ch == '_' || ch == '$') {
+			length = matcher.identifier(input.substr(i));
+		}
+
+		if (length != 0) {
+			spans.push_back(Span{i, length});
+			i += length;
+		} else if (ch == '"') {
+			i = std::min(input.find('"', i + 1), input.size() - 1) + 1;
+		} else {
+			++i;
+		}
+	}
+
+	return spans;
+}
+
+/**
+ * @brief generate
+ * @param size
+ * @return about size bytes of macro code, the same each time
+ */
+std::string generate(size_t size) {
+	static const char *const words[] = {"define", "while", "for", "if", "else", "return", "in", "delete", "break", "length", "substring", "search_string", "$1", "$n_args", "_tmp", "i", "count", "line_start", "x2"};
+	static const char *const ops[]   = {" = ", " + ", " - ", " * ", " < ", " >= ", " == ", " && ", " || ", "++", "(", ")", "[", "]", ", ", " { ", " }"};
+
+	std::mt19937 engine(1);
+	std::string text;
+
+	while (text.size() < size) {
+		switch (engine() % 8) {
+		case 0:
+			text += std::to_string(engine() % 4 == 0 ? 0 : engine() % 100000);
+			break;
+		case 1:
+			text += "\"some text ";
+			text += std::to_string(engine() % 100);
+			text += "\"";
+			break;
+		case 2:
+			text += ops[engine() % (sizeof(ops) / sizeof(ops[0]))];
+			break;
+		case 3:
+			text += engine() % 4 == 0 ? "\t# a comment about the line\n" : "\n\t";
+			break;
+		default:
+			text += words[engine() % (sizeof(words) / sizeof(words[0]))];
+			text += ' ';
+			break;
+		}
+	}
+
+	return text;
+}
+
+/**
+ * @brief measure
+ * @param input
+ * @param matcher
+ * @param repetitions
+ * @param spans receives the tokens found
+ * @return the best throughput of repetitions scans, in MB/s
+ */
+template <class Matcher>
+double measure(std::string_view input, const Matcher &matcher, int repetitions, std::vector<Span> &spans) {
+	double best = 0;
+
+	for (int i = 0; i < repetitions; ++i) {
+		const auto start = std::chrono::steady_clock::now();
+		spans            = scan(input, matcher);
+		const auto end   = std::chrono::steady_clock::now();
+
+		const double seconds = std::chrono::duration<double>(end - start).count();
+		best                 = std::max(best, input.size() / 1e6 / seconds);
+	}
+
+	return best;
+}
+
+}
+
+/**
+ * @brief main
+ *
+ * Compares the throughput of matching integers, identifiers, whitespace and
+ * comments with the regexes that the tokenizer used to use and with the DFA
+ * scanner, and checks that both find the same tokens.
+ *
+ * usage: nedit-nm-bench-scanner [megabytes] [repetitions]
+ */
+int main(int argc, char *argv[]) {
+
+	const double megabytes = argc > 1 ? std::atof(argv[1]) : 4;
+	const int repetitions  = argc > 2 ? std::atoi(argv[2]) : 3;
+
+	if (megabytes <= 0 || repetitions <= 0) {
+		fprintf(stderr, "usage: %s [megabytes] [repetitions]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	const std::string input = generate(static_cast<size_t>(megabytes * 1e6));
+
+	std::vector<Span> regex_spans;
+	std::vector<Span> dfa_spans;
+	const double regex_rate = measure(input, RegexMatcher{}, repetitions, regex_spans);
+	const double dfa_rate   = measure(input, DfaMatcher{}, repetitions, dfa_spans);
+
+	if (regex_spans != dfa_spans) {
+		fprintf(stderr, "the regexes found %zu tokens and the DFAs %zu, which differ\n", regex_spans.size(), dfa_spans.size());
+		return EXIT_FAILURE;
+	}
+
+	printf("%.1f MB, %zu tokens, best of %d\n", input.size() / 1e6, dfa_spans.size(), repetitions);
+	printf("%-8s %8.1f MB/s\n", "regex", regex_rate);
+	printf("%-8s %8.1f MB/s\n", "dfa", dfa_rate);
+	return EXIT_SUCCESS;
+}
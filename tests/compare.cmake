@@ -0,0 +1,27 @@
+
+# Compiles SOURCE with COMPILER and FLAGS, in both forms of the AST, and fails
+# unless the IR printed each time is exactly the contents of EXPECTED. If
+# STATS is set, the statistics that -s prints must be exactly its contents too
+
+file(READ ${EXPECTED} expected)
+
+if(STATS)
+	file(READ ${STATS} expected_stats)
+	list(APPEND FLAGS "-s")
+endif()
+
+foreach(form "" "-f")
+	execute_process(COMMAND ${COMPILER} ${FLAGS} ${form} ${SOURCE} OUTPUT_VARIABLE actual ERROR_VARIABLE actual_stats RESULT_VARIABLE status)
+
+	if(NOT status EQUAL 0)
+		message(FATAL_ERROR "${COMPILER} ${FLAGS} ${form} ${SOURCE} failed (${status})")
+	endif()
+
+	if(NOT actual STREQUAL expected)
+		message(FATAL_ERROR "${COMPILER} ${FLAGS} ${form} ${SOURCE} printed:\n${actual}\nexpected:\n${expected}")
+	endif()
+
+	if(STATS AND NOT actual_stats STREQUAL expected_stats)
+		message(FATAL_ERROR "${COMPILER} ${FLAGS} ${form} ${SOURCE} reported:\n${actual_stats}\nexpected:\n${expected_stats}")
+	endif()
+endforeach()
@@ -0,0 +1,388 @@
+
+#include "Arena.h"
+#include "Error.h"
+#include "Parser.h"
+#include "Visitor.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+
+const char Sample[] = "define f {\n"
+					  "\tx = 1 + 2\n"
+					  "\tif (x) { y = \"a\" } else { y = \"b\" }\n"
+					  "}\n"
+					  "a = f()\n"
+					  "define g {\n"
+					  "\treturn $1 * 2\n"
+					  "}\n"
+					  "b = \"str\" # comment\n"
+					  "c = g(3)\n"
+					  "for (i = 0; i < 3; i++) { delete d[i] }\n";
+
+const char *const Pieces[] = {
+	"\"", "#", "\n", " ", "x", "12", "\\n", "\"q\"", "# c\n", "define h {", "}", "{", "+", "=", "(", ")", "[", "]", ";", "if", "else", "z = 1\n", "return",
+};
+
+/**
+ * @brief prints a tree in a form which two trees can be compared by
+ */
+struct Dump {
+	std::string &out;
+
+	void operator()(const Expression *expression) {
+		if (!expression) {
+			out += "-";
+			return;
+		}
+
+		visit(expression, *this);
+	}
+
+	void operator()(const Statement *statement) {
+		if (!statement) {
+			out += "-";
+			return;
+		}
+
+		visit(statement, *this);
+	}
+
+	template <class T>
+	void operator()(const NodeList<T> &list) {
+		out += "[";
+		for (const T *node : list) {
+			(*this)(node);
+			out += " ";
+		}
+		out += "]";
+	}
+
+	void operator()(const BinaryExpression *e) {
+		out += "(binary " + std::to_string(e->op) + " ";
+		(*this)(e->lhs);
+		out += " ";
+		(*this)(e->rhs);
+		out += ")";
+	}
+
+	void operator()(const UnaryExpression *e) {
+		out += "(unary " + std::to_string(e->op) + (e->prefix ? " prefix " : " postfix ");
+		(*this)(e->operand);
+		out += ")";
+	}
+
+	void operator()(const AtomExpression *e) {
+		out += "(atom " + std::to_string(e->type) + " \"" + std::string(e->value) + "\")";
+	}
+
+	void operator()(const CallExpression *e) {
+		out += "(call ";
+		(*this)(e->function);
+		(*this)(e->parameters);
+		out += ")";
+	}
+
+	void operator()(const ArrayIndexExpression *e) {
+		out += "(index ";
+		(*this)(e->array);
+		(*this)(e->index);
+		out += ")";
+	}
+
+	void operator()(const DeleteStatement *s) {
+		out += "(delete ";
+		(*this)(s->expression);
+		(*this)(s->index);
+		out += ")";
+	}
+
+	void operator()(const FunctionStatement *s) {
+		out += "(define " + std::string(s->name) + " ";
+		(*this)(s->statements);
+		out += ")";
+	}
+
+	void operator()(const BlockStatement *s) {
+		out += "(block ";
+		(*this)(s->statements);
+		out += ")";
+	}
+
+	void operator()(const CondStatement *s) {
+		out += "(if ";
+		(*this)(s->cond);
+		out += " ";
+		(*this)(s->body);
+		out += " ";
+		(*this)(s->else_);
+		out += ")";
+	}
+
+	void operator()(const LoopStatement *s) {
+		out += "(loop ";
+		(*this)(s->init);
+		(*this)(s->cond);
+		(*this)(s->incr);
+		(*this)(s->body);
+		out += ")";
+	}
+
+	void operator()(const ForEachStatement *s) {
+		out += "(foreach ";
+		(*this)(s->iterator);
+		(*this)(s->container);
+		(*this)(s->body);
+		out += ")";
+	}
+
+	void operator()(const BreakStatement *) {
+		out += "(break)";
+	}
+
+	void operator()(const ContinueStatement *) {
+		out += "(continue)";
+	}
+
+	void operator()(const ExpressionStatement *s) {
+		out += "(expression ";
+		(*this)(s->expression);
+		out += ")";
+	}
+
+	void operator()(const ReturnStatement *s) {
+		out += "(return ";
+		(*this)(s->expression);
+		out += ")";
+	}
+};
+
+/**
+ * @brief write
+ * @param filename
+ * @param text
+ */
+void write(const std::string &filename, const std::string &text) {
+	std::ofstream file(filename, std::ios::binary);
+	file << text;
+}
+
+/**
+ * @brief describe
+ * @param ex
+ * @return the error, and where it was found
+ */
+std::string describe(const Error &ex) {
+	std::string error = ex.what();
+
+	if (auto syntax = dynamic_cast<const SyntaxError *>(&ex)) {
+		error += " at " + std::to_string(syntax->index());
+	} else if (auto tokenization = dynamic_cast<const TokenizationError *>(&ex)) {
+		error += " at " + std::to_string(tokenization->index());
+	}
+
+	return error;
+}
+
+/**
+ * @brief parse
+ * @param edit parses the input, or applies an edit to it and reparses it
+ * @return the statements, or the error that parsing them ran into
+ */
+template <class F>
+std::string parse(F edit) {
+	std::string out;
+
+	try {
+		Dump dump{out};
+		for (const Statement *statement : edit()) {
+			dump(statement);
+			out += "\n";
+		}
+	} catch (const Error &ex) {
+		out = describe(ex);
+	}
+
+	return out;
+}
+
+/**
+ * @brief Reparses its input after each of a series of edits, and checks that
+ * the statements are the same as those of parsing the edited input afresh
+ */
+class Editor {
+public:
+	/**
+	 * @brief Editor::Editor
+	 * @param tokenized if true, the input is tokenized before it is first
+	 * parsed, otherwise it is read one token at a time
+	 */
+	explicit Editor(bool tokenized)
+		: filename_("reparse_" + std::to_string(getpid()) + ".nm"), fresh_("reparse_" + std::to_string(getpid()) + "_fresh.nm"), text_(Sample) {
+
+		write(filename_, text_);
+		parser_ = std::make_unique<Parser>(filename_, arena_);
+
+		if (tokenized) {
+			parser_->tokenize(1);
+		}
+
+		parse([this]() -> const std::vector<Statement *> & { return parser_->parseStatements(1); });
+	}
+
+	~Editor() {
+		std::remove(filename_.c_str());
+		std::remove(fresh_.c_str());
+	}
+
+public:
+	/**
+	 * @brief Editor::edit
+	 * @param offset
+	 * @param removed
+	 * @param inserted
+	 * @return true if the reparsed statements are the same as a fresh parse's
+	 */
+	bool edit(size_t offset, size_t removed, const std::string &inserted) {
+
+		const std::string reparsed = parse([&]() -> const std::vector<Statement *> & { return parser_->reparse(offset, removed, inserted); });
+		text_.replace(offset, removed, inserted);
+
+		write(fresh_, text_);
+
+		Arena arena;
+		Parser parser(fresh_, arena);
+		const std::string parsed = parse([&]() -> const std::vector<Statement *> & { return parser.parseStatements(1); });
+
+		if (reparsed != parsed) {
+			std::cerr << removed << " characters at " << offset << " replaced with \"" << inserted << "\", giving:\n"
+					  << text_ << "\nreparsed:\n"
+					  << reparsed << "\nparsed:\n"
+					  << parsed << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	/**
+	 * @brief Editor::edit
+	 * @param before the text to find
+	 * @param after what to replace it with
+	 * @return true if the reparsed statements are the same as a fresh parse's
+	 */
+	bool edit(const std::string &before, const std::string &after) {
+		const size_t offset = text_.find(before);
+		if (offset == std::string::npos) {
+			std::cerr << "\"" << before << "\" not found" << std::endl;
+			return false;
+		}
+
+		return edit(offset, before.size(), after);
+	}
+
+	const std::string &text() const {
+		return text_;
+	}
+
+private:
+	std::string filename_;
+	std::string fresh_;
+	std::string text_;
+	Arena arena_;
+	std::unique_ptr<Parser> parser_;
+};
+
+/**
+ * @brief planned_edits
+ * @param tokenized
+ * @return true if edits of each kind which matters to which statements are
+ * reparsed give the same statements as parsing afresh
+ */
+bool planned_edits(bool tokenized) {
+	Editor editor(tokenized);
+
+	return
+		// inside of a define
+		editor.edit("1 + 2", "1 + 3 * x") &&
+		editor.edit("return $1 * 2", "return $1 * 2\n\treturn 4") &&
+		// between statements
+		editor.edit("b = ", "z = 5\nb = ") &&
+		editor.edit("z = 5\n", "") &&
+		editor.edit("}\na = f()", "}\n\n\na = f()") &&
+		// opening a string, and closing it again
+		editor.edit("b = \"str\"", "b = \"q \"str\"") &&
+		editor.edit("b = \"q \"str\"", "b = \"str\"") &&
+		// a string which runs on past the end of its line
+		editor.edit("a = f()", "a = \"f()") &&
+		editor.edit("a = \"f()", "a = f()") &&
+		// opening a comment, and closing it again
+		editor.edit("a = f()", "# a = f()") &&
+		editor.edit("# a = f()", "a = f()") &&
+		editor.edit("\"b\" }\n}", "\"b\" }\n# }") &&
+		editor.edit("\"b\" }\n# }", "\"b\" }\n}") &&
+		editor.edit("x = 1", "# x = 1") &&
+		editor.edit("# x = 1", "x = 1") &&
+		// splitting and joining defines
+		editor.edit("\tif (x)", "}\ndefine k {\n\tif (x)") &&
+		editor.edit("}\ndefine k {\n\tif (x)", "\tif (x)") &&
+		// at either end
+		editor.edit(0, 0, "w = 0\n") &&
+		editor.edit(editor.text().size(), 0, "v = 1\n");
+}
+
+/**
+ * @brief random_edits
+ * @param seed
+ * @return true if after each of a series of random edits, the reparsed
+ * statements are the same as those of parsing afresh
+ */
+bool random_edits(unsigned int seed) {
+	Editor editor(seed % 2 == 0);
+	std::mt19937 engine(seed);
+
+	for (int i = 0; i < 100; ++i) {
+		const std::string &text = editor.text();
+		const size_t offset     = engine() % (text.size() + 1);
+		const size_t removed    = std::min<size_t>(engine() % 4, text.size() - offset);
+
+		std::string inserted;
+		for (size_t n = engine() % 3; n != 0; --n) {
+			inserted += Pieces[engine() % (sizeof(Pieces) / sizeof(Pieces[0]))];
+		}
+
+		if (!editor.edit(offset, removed, inserted)) {
+			std::cerr << "seed " << seed << ", edit " << i << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+}
+
+/**
+ * @brief main
+ *
+ * Checks that reparsing after an edit gives the same statements, or the
+ * same error, as parsing the edited input from scratch
+ */
+int main() {
+
+	bool ok = planned_edits(false) && planned_edits(true);
+
+	for (unsigned int seed = 0; seed < 40 && ok; ++seed) {
+		ok = random_edits(seed);
+	}
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,204 @@
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace {
+
+/**
+ * @brief repeat
+ * @param text
+ * @param count
+ * @return text, count times over
+ */
+std::string repeat(const std::string &text, size_t count) {
+	std::string result;
+	result.reserve(text.size() * count);
+	for (size_t i = 0; i < count; ++i) {
+		result += text;
+	}
+
+	return result;
+}
+
+/**
+ * @brief generate
+ * @param shape
+ * @param terms
+ * @return a macro made of one expression of the given shape with terms
+ * terms, or an empty string if there is no such shape
+ */
+std::string generate(const std::string &shape, size_t terms) {
+
+	if (shape == "add") {
+		return "x = a" + repeat(" + a", terms - 1) + "\n";
+	}
+
+	if (shape == "and") {
+		return "x = a" + repeat(" && a", terms - 1) + "\n";
+	}
+
+	if (shape == "cat") {
+		return "x = a" + repeat(" a", terms - 1) + "\n";
+	}
+
+	if (shape == "string") {
+		return "x = \"s\"" + repeat(" \"s\"", terms - 1) + "\n";
+	}
+
+	if (shape == "call") {
+		return "x = " + repeat("f(", terms) + "a" + repeat(")", terms) + "\n";
+	}
+
+	if (shape == "index") {
+		return "x = " + repeat("$x[", terms) + "1" + repeat("]", terms) + "\n";
+	}
+
+	// NOTE(eteran): the second copy is read back from the first, one level
+	// at a time, as each level of it is found to be the same
+	if (shape == "repeat") {
+		const std::string index = repeat("$x[", terms / 2) + "1" + repeat("]", terms / 2);
+		return "x = " + index + "\ny = " + index + "\n";
+	}
+
+	if (shape == "paren") {
+		return "x = " + repeat("(", terms) + "a" + repeat(")", terms) + "\n";
+	}
+
+	if (shape == "neg") {
+		return "x = " + repeat("- ", terms) + "a\n";
+	}
+
+	return std::string();
+}
+
+/**
+ * @brief children_time
+ * @return the CPU time used by every child which has finished, in seconds
+ */
+double children_time() {
+	rusage usage;
+	getrusage(RUSAGE_CHILDREN, &usage);
+
+	return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) + static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/**
+ * @brief compile
+ * @param compiler
+ * @param flags
+ * @param filename
+ * @return the CPU time compiling the file took, in seconds, or a negative
+ * number if it failed
+ *
+ * NOTE(eteran): this is CPU time rather than elapsed time, so that it doesn't
+ * depend on what else the machine is doing, such as other tests run by
+ * ctest -j
+ */
+double compile(const std::string &compiler, const std::string &flags, const std::string &filename) {
+
+	const std::string command = "\"" + compiler + "\" " + flags + " \"" + filename + "\" > /dev/null";
+
+	const double start = children_time();
+	const int status   = std::system(command.c_str());
+	const double end   = children_time();
+
+	if (status != 0) {
+		std::cerr << command << " failed (" << status << ")" << std::endl;
+		return -1;
+	}
+
+	return end - start;
+}
+
+/**
+ * @brief run
+ * @param compiler
+ * @param shape
+ * @param terms
+ * @param flags
+ * @return the CPU time compiling a macro of the given shape took, in seconds,
+ * or a negative number if it failed
+ *
+ * The macro is written to the working directory under a name which includes
+ * this process's id, so that tests run at the same time don't share a file
+ */
+double run(const std::string &compiler, const std::string &shape, size_t terms, const std::string &flags) {
+
+	const std::string filename = "stress_" + shape + "_" + std::to_string(terms) + "_" + std::to_string(getpid()) + ".nm";
+
+	{
+		std::ofstream file(filename, std::ios::binary);
+		file << generate(shape, terms);
+		if (!file) {
+			std::cerr << "couldn't write " << filename << std::endl;
+			return -1;
+		}
+	}
+
+	const double seconds = compile(compiler, flags, filename);
+	std::remove(filename.c_str());
+
+	if (seconds >= 0) {
+		std::cout << shape << " " << terms << " " << flags << ": " << seconds << "s" << std::endl;
+	}
+
+	return seconds;
+}
+
+}
+
+/**
+ * @brief main
+ *
+ * Compiles a generated macro with one very large expression, in both forms of
+ * the AST, and fails if either doesn't compile. With -l, it also compiles one
+ * a quarter of the size, and fails if the time taken grows much faster than
+ * the size does
+ */
+int main(int argc, char *argv[]) {
+
+	const bool linear = argc > 1 && std::strcmp(argv[1], "-l") == 0;
+	if (linear) {
+		--argc;
+		++argv;
+	}
+
+	const size_t terms = argc == 4 ? std::strtoul(argv[3], nullptr, 10) : 0;
+
+	if (terms < 4 || generate(argv[2], 1).empty()) {
+		std::cerr << "nedit-nm-stress [-l] <nedit-nm> <add|and|cat|string|call|index|repeat|paren|neg> <terms>" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	for (const char *flags : {"", "-f"}) {
+		const double seconds = run(argv[1], argv[2], terms, flags);
+		if (seconds < 0) {
+			return EXIT_FAILURE;
+		}
+
+		if (!linear) {
+			continue;
+		}
+
+		// NOTE(eteran): linear growth takes four times as long, quadratic
+		// sixteen. The slack is for a quarter which is too quick to measure
+		const double quarter = run(argv[1], argv[2], terms / 4, flags);
+		if (quarter < 0) {
+			return EXIT_FAILURE;
+		}
+
+		if (seconds > 8 * quarter + 0.5) {
+			std::cerr << argv[2] << " " << flags << ": " << seconds << "s for " << terms << " terms, " << quarter << "s for a quarter of them" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,174 @@
+
+#include "Tokenizer.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+
+#include <unistd.h>
+
+namespace {
+
+// NOTE(eteran): a bit of everything which lexes differently depending on
+// what is around it: strings with escapes and newlines, comments, and
+// input which doesn't lex at all
+const char Sample[] = "define f {\n"
+					  "\tx = \"a\\\"b\" \"c\\n\" # comment \"x\n"
+					  "\treturn $1 + 12 * y[2, \"k\"]\n"
+					  "}\n"
+					  "s = \"multi\n"
+					  "line\" # not \"closed\n"
+					  "t = f(1) >= -3 && !z\n"
+					  "while (i++ < 10) { a[i] = i; }\n"
+					  "u = 99999999999 @ v\n";
+
+const char *const Pieces[] = {
+	"\"", "#", "\n", " ", "\t", "x", "12", "\\", "\\n", "\"q\"", "a\"b", "# c\n", "define g {", "}", "{", "+", "+=", "=", "==", "$", "$1", "@", "(", ")", "[", "]", ",", ";", "if", "else", "-", "++",
+};
+
+/**
+ * @brief write
+ * @param filename
+ * @param text
+ */
+void write(const std::string &filename, const std::string &text) {
+	std::ofstream file(filename, std::ios::binary);
+	file << text;
+}
+
+/**
+ * @brief same
+ * @param edited a tokenizer whose input has been edited
+ * @param fresh a tokenizer which has tokenized the edited input from scratch
+ * @return true if they hold the same tokens, at the same offsets and with the
+ * same text
+ */
+bool same(const Tokenizer &edited, const Tokenizer &fresh) {
+
+	if (edited.size() != fresh.size()) {
+		std::cerr << "edit() made " << edited.size() << " tokens, tokenize() made " << fresh.size() << std::endl;
+		return false;
+	}
+
+	for (size_t i = 0; i < edited.size(); ++i) {
+		const Token &a = edited.at(i);
+		const Token &b = fresh.at(i);
+
+		if (a.type != b.type || a.offset != b.offset || a.length != b.length || edited.text(a) != fresh.text(b)) {
+			std::cerr << "token " << i << " differs: " << int(a.type) << "@" << a.offset << "+" << a.length << " \"" << edited.text(a) << "\" vs " << int(b.type) << "@" << b.offset << "+" << b.length << " \"" << fresh.text(b) << "\"" << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * @brief random_edits
+ * @param seed
+ * @param start how the tokenizer is used before the first edit, 0 not at
+ * all, 1 a few tokens are read one at a time, 2 it is tokenized
+ * @return true if after each of a series of random edits, the tokens are the
+ * same as those of tokenizing the edited text from scratch
+ */
+bool random_edits(unsigned int seed, int start) {
+
+	const std::string filename = "tokens_" + std::to_string(getpid()) + ".nm";
+	const std::string fresh    = "tokens_" + std::to_string(getpid()) + "_fresh.nm";
+
+	std::string text = Sample;
+	write(filename, text);
+
+	Tokenizer edited(filename);
+	if (start == 1) {
+		for (int i = 0; i < 5; ++i) {
+			edited.read();
+		}
+	} else if (start == 2) {
+		edited.tokenize(1);
+	}
+
+	std::mt19937 engine(seed);
+	bool ok = true;
+
+	for (int i = 0; i < 200 && ok; ++i) {
+		const size_t offset  = engine() % (text.size() + 1);
+		const size_t removed = std::min<size_t>(engine() % 4 == 0 ? engine() % 12 : engine() % 3, text.size() - offset);
+
+		std::string inserted;
+		for (size_t n = engine() % 3; n != 0; --n) {
+			inserted += Pieces[engine() % (sizeof(Pieces) / sizeof(Pieces[0]))];
+		}
+
+		edited.edit(offset, removed, inserted);
+		text.replace(offset, removed, inserted);
+
+		write(fresh, text);
+		Tokenizer tokenizer(fresh);
+		tokenizer.tokenize(1);
+
+		if (!same(edited, tokenizer)) {
+			std::cerr << "seed " << seed << ", edit " << i << ": " << removed << " characters at " << offset << " replaced with \"" << inserted << "\"" << std::endl;
+			ok = false;
+		}
+	}
+
+	std::remove(filename.c_str());
+	std::remove(fresh.c_str());
+	return ok;
+}
+
+/**
+ * @brief small_edit
+ * @return true if changing one character in a large input only relexes the
+ * token it is in, and the one before it (which may have looked at it)
+ */
+bool small_edit() {
+
+	const std::string filename = "tokens_" + std::to_string(getpid()) + ".nm";
+
+	std::string text;
+	for (int i = 0; i < 10000; ++i) {
+		text += "x = y + \"s\"\n";
+	}
+
+	write(filename, text);
+
+	Tokenizer tokenizer(filename);
+	tokenizer.tokenize(1);
+
+	const size_t size              = tokenizer.size();
+	const Tokenizer::Change change = tokenizer.edit(text.size() / 2, 1, "long_name");
+
+	std::remove(filename.c_str());
+
+	if (change.removed > 2 || change.inserted > 2 || tokenizer.size() != size) {
+		std::cerr << "one character edit replaced " << change.removed << " tokens with " << change.inserted << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+}
+
+/**
+ * @brief main
+ *
+ * Checks that editing tokenized input gives the same tokens as tokenizing
+ * the edited input from scratch, and that an edit only relexes what it has to
+ */
+int main() {
+
+	bool ok = small_edit();
+
+	for (unsigned int seed = 0; seed < 60 && ok; ++seed) {
+		ok = random_edits(seed, static_cast<int>(seed % 3));
+	}
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}